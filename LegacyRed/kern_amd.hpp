@@ -41,6 +41,11 @@ constexpr uint32_t mmMP1_SMN_C2PMSG_66 = 0x282;
 constexpr uint32_t mmPCIE_INDEX2 = 0xE;
 constexpr uint32_t mmPCIE_DATA2 = 0xF;
 
+// Framebuffer offset in 16MiB units
+constexpr uint32_t mmFB_OFFSET = 0x296B;
+// Silicon revision in bits 24-27
+constexpr uint32_t mmREVISION = 0xD2F;
+
 struct CommonFirmwareHeader {
     uint32_t size;
     uint32_t headerSize;
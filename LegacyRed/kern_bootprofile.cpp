@@ -0,0 +1,139 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+#include "kern_bootprofile.hpp"
+#include <libkern/c++/OSArray.h>
+#include <libkern/c++/OSDictionary.h>
+#include <libkern/c++/OSNumber.h>
+#include <libkern/c++/OSString.h>
+
+bool BootProfile::isEnabled = false;
+uint64_t BootProfile::base = 0;
+BootProfile::Span BootProfile::spans[MaxSpans] {};
+size_t BootProfile::spanCount = 0;
+uint32_t BootProfile::dropped = 0;
+IORegistryEntry *BootProfile::target = nullptr;
+const char *BootProfile::mode = nullptr;
+BootProfile::Counter BootProfile::counters[MaxCounters] {};
+size_t BootProfile::counterCount = 0;
+thread_call_t BootProfile::publishCall = nullptr;
+uint64_t BootProfile::publishDelay = 0;
+
+void BootProfile::init() {
+    isEnabled = !checkKernelArgument("-lrednoprof");
+    base = mach_absolute_time();
+    if (!isEnabled) { return; }
+    publishCall = thread_call_allocate([](thread_call_param_t, thread_call_param_t) { publish(); }, nullptr);
+    SYSLOG_COND(!publishCall, "profile", "Failed to allocate publish thread call");
+    nanoseconds_to_absolutetime(NSEC_PER_SEC, &publishDelay);
+}
+
+size_t BootProfile::begin(const char *name) {
+    if (!isEnabled) { return NoSpan; }
+    auto span = __atomic_fetch_add(&spanCount, 1, __ATOMIC_RELAXED);
+    if (span >= MaxSpans) {
+        __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+        return NoSpan;
+    }
+    spans[span] = {name, mach_absolute_time(), 0};
+    return span;
+}
+
+void BootProfile::end(size_t span) {
+    if (span == NoSpan) { return; }
+    __atomic_store_n(&spans[span].end, mach_absolute_time(), __ATOMIC_RELEASE);
+}
+
+void BootProfile::addCounter(const char *name, const uint64_t *counter) {
+    if (!isEnabled) { return; }
+    for (size_t i = 0; i < counterCount; i++) {
+        if (counters[i].value == counter) { return; }
+    }
+    if (counterCount >= MaxCounters) {
+        SYSLOG("profile", "Too many counters, dropping %s", name);
+        return;
+    }
+    counters[counterCount++] = {name, counter};
+}
+
+void BootProfile::publishLater() {
+    if (!isEnabled || !publishCall) { return; }
+    uint64_t deadline;
+    clock_absolutetime_interval_to_deadline(publishDelay, &deadline);
+    thread_call_enter_delayed(publishCall, deadline);
+}
+
+void BootProfile::attach(IORegistryEntry *entry) {
+    if (!isEnabled) { return; }
+    target = entry;
+    publish();
+}
+
+static bool setNumber(OSDictionary *dict, const char *key, uint64_t value) {
+    auto *number = OSNumber::withNumber(value, 64);
+    if (!number) { return false; }
+    auto ret = dict->setObject(key, number);
+    number->release();
+    return ret;
+}
+
+static uint64_t toNanoseconds(uint64_t abstime) {
+    uint64_t ns;
+    absolutetime_to_nanoseconds(abstime, &ns);
+    return ns;
+}
+
+void BootProfile::publish() {
+    if (!isEnabled || !target) { return; }
+
+    auto count = __atomic_load_n(&spanCount, __ATOMIC_RELAXED);
+    if (count > MaxSpans) { count = MaxSpans; }
+    auto *profile = OSDictionary::withCapacity(3);
+    auto *list = OSArray::withCapacity(static_cast<unsigned int>(count));
+    if (!profile || !list) {
+        OSSafeReleaseNULL(profile);
+        OSSafeReleaseNULL(list);
+        SYSLOG("profile", "Failed to allocate the profile");
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        auto &span = spans[i];
+        auto end = __atomic_load_n(&span.end, __ATOMIC_ACQUIRE);
+        // Still running, it will be in the next publish
+        if (!end) { continue; }
+        auto *entry = OSDictionary::withCapacity(3);
+        if (!entry) { continue; }
+        auto *name = OSString::withCString(span.name);
+        if (name) {
+            entry->setObject("Name", name);
+            name->release();
+        }
+        setNumber(entry, "Start", toNanoseconds(span.start - base));
+        setNumber(entry, "Duration", toNanoseconds(end - span.start));
+        list->setObject(entry);
+        entry->release();
+    }
+
+    profile->setObject("Spans", list);
+    list->release();
+    auto *values = OSDictionary::withCapacity(static_cast<unsigned int>(counterCount));
+    if (values) {
+        for (size_t i = 0; i < counterCount; i++) {
+            setNumber(values, counters[i].name, __atomic_load_n(counters[i].value, __ATOMIC_RELAXED));
+        }
+        profile->setObject("Counters", values);
+        values->release();
+    }
+    setNumber(profile, "Dropped", __atomic_load_n(&dropped, __ATOMIC_RELAXED));
+    setNumber(profile, "Published", toNanoseconds(mach_absolute_time() - base));
+    if (mode) {
+        auto *modeString = OSString::withCString(mode);
+        if (modeString) {
+            profile->setObject("Mode", modeString);
+            modeString->release();
+        }
+    }
+    target->setProperty("LRedBootProfile", profile);
+    profile->release();
+}
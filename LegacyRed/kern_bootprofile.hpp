@@ -0,0 +1,72 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+#ifndef kern_bootprofile_hpp
+#define kern_bootprofile_hpp
+#include <Headers/kern_util.hpp>
+#include <IOKit/IORegistryEntry.h>
+#include <kern/thread_call.h>
+
+/**
+ * Where boot time goes, published as `LRedBootProfile` on the iGPU.
+ * Spans go into a static buffer; once it is full, further spans are only counted.
+ * Kext loads only schedule a publish, which happens once they have stopped for a second.
+ * `-lrednoprof` turns recording and publishing off.
+ */
+class BootProfile {
+    public:
+    static constexpr size_t MaxSpans = 96;
+    static constexpr size_t NoSpan = ~static_cast<size_t>(0);
+    static constexpr size_t MaxCounters = 8;
+
+    static void init();
+    /** Boot mode the profile was taken in, to tell profiles apart when comparing them */
+    static void setMode(const char *mode) { BootProfile::mode = mode; }
+    /** Publish the current value of the counter under `Counters` along with the spans */
+    static void addCounter(const char *name, const uint64_t *counter);
+    static bool enabled() { return isEnabled; }
+    static size_t begin(const char *name);
+    static void end(size_t span);
+    /** Publish to this entry from now on, does nothing until one is set */
+    static void attach(IORegistryEntry *entry);
+    static void publish();
+    /** Publish from a thread call a second from now, each call before then pushes it back */
+    static void publishLater();
+
+    private:
+    struct Counter {
+        const char *name;
+        const uint64_t *value;
+    };
+
+    struct Span {
+        const char *name;
+        uint64_t start;
+        uint64_t end;
+    };
+
+    static bool isEnabled;
+    static uint64_t base;
+    static Span spans[MaxSpans];
+    static size_t spanCount;
+    static uint32_t dropped;
+    static IORegistryEntry *target;
+    static const char *mode;
+    static Counter counters[MaxCounters];
+    static size_t counterCount;
+    static thread_call_t publishCall;
+    static uint64_t publishDelay;
+};
+
+/** Records the lifetime of the object as a span */
+class ProfileSpan {
+    size_t span;
+
+    public:
+    explicit ProfileSpan(const char *name) : span {BootProfile::begin(name)} {}
+    ~ProfileSpan() { BootProfile::end(this->span); }
+    ProfileSpan(const ProfileSpan &) = delete;
+    ProfileSpan &operator=(const ProfileSpan &) = delete;
+};
+
+#endif /* kern_bootprofile_hpp */
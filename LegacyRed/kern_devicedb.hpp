@@ -0,0 +1,182 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+#ifndef kern_devicedb_hpp
+#define kern_devicedb_hpp
+#include "kern_lred.hpp"
+#include "kern_model.hpp"
+#include <Headers/kern_util.hpp>
+
+/** What the revision read from `mmREVISION` makes of the device, the range is inclusive */
+struct ChipRevision {
+    uint16_t first;
+    uint16_t last;
+    ChipType type;
+    ChipVariant variant;
+    uint16_t enumeratedRevision;
+};
+
+// Kaveri
+
+static constexpr ChipRevision revSpectre[] = {
+    {0x00, 0xFF, ChipType::Spectre, ChipVariant::Kaveri, 0x01},
+};
+
+static constexpr ChipRevision revSpooky[] = {
+    {0x00, 0xFF, ChipType::Spooky, ChipVariant::Kaveri, 0x41},
+};
+
+// Kabini/Kalindi, other revisions are not supported
+
+static constexpr ChipRevision revKalindi[] = {
+    {0x00, 0x00, ChipType::Kalindi, ChipVariant::Kabini, 0x81},
+    {0x01, 0x01, ChipType::Kalindi, ChipVariant::Kabini, 0x82},
+    {0x02, 0x02, ChipType::Kalindi, ChipVariant::Bhavani, 0x85},
+};
+
+// Mullins/Godavari
+
+static constexpr ChipRevision revGodavari[] = {
+    {0x00, 0xFF, ChipType::Godavari, ChipVariant::Mullins, 0xA1},
+};
+
+// Carrizo, Bristol is a Carrizo refresh
+
+static constexpr ChipRevision revCarrizo[] = {
+    {0x00, 0xC7, ChipType::Carrizo, ChipVariant::Unknown, 0x01},
+    {0xC8, 0xCE, ChipType::Carrizo, ChipVariant::Bristol, 0x01},
+    {0xCF, 0xE0, ChipType::Carrizo, ChipVariant::Unknown, 0x01},
+    {0xE1, 0xE6, ChipType::Carrizo, ChipVariant::Bristol, 0x01},
+    {0xE7, 0xFF, ChipType::Carrizo, ChipVariant::Unknown, 0x01},
+};
+
+// Stoney, R4 and up have 3 compute units while the others have 2
+
+static constexpr ChipRevision revStoney[] = {
+    {0x00, 0x81, ChipType::Stoney, ChipVariant::s3CU, 0x61},
+    {0x82, 0xBF, ChipType::Stoney, ChipVariant::s2CU, 0x61},
+    {0xC0, 0xCF, ChipType::Stoney, ChipVariant::s3CU, 0x61},
+    {0xD0, 0xD8, ChipType::Stoney, ChipVariant::s2CU, 0x61},
+    {0xD9, 0xDA, ChipType::Stoney, ChipVariant::s3CU, 0x61},
+    {0xDB, 0xE8, ChipType::Stoney, ChipVariant::s2CU, 0x61},
+    {0xE9, 0xFF, ChipType::Stoney, ChipVariant::s3CU, 0x61},
+};
+
+static constexpr const char *brandingKabini = "AMD Radeon HD 8XXX";
+static constexpr const char *brandingGeneric = "AMD Radeon R Graphics";
+
+/**
+ * Everything known about a PCI device ID.
+ * Scripts/PCIMatchGen.py generates the `IOPCIMatch` strings in Info.plist from `devices`, rerun it after editing.
+ */
+struct DeviceEntry {
+    uint16_t deviceId;
+    const ChipRevision *revisions;
+    size_t revisionNum;
+    const Model *models;
+    size_t modelNum;
+    /** When no model matches the PCI revision */
+    const char *branding;
+
+    constexpr const ChipRevision *chip(uint16_t revision) const {
+        for (size_t i = 0; i < this->revisionNum; i++) {
+            if (revision >= this->revisions[i].first && revision <= this->revisions[i].last) {
+                return &this->revisions[i];
+            }
+        }
+        return nullptr;
+    }
+
+    constexpr const char *brandingFor(uint16_t rev) const {
+        for (size_t i = 0; i < this->modelNum; i++) {
+            if (this->models[i].rev == rev) { return this->models[i].name; }
+        }
+        return this->branding;
+    }
+};
+
+template<size_t R, size_t M>
+constexpr DeviceEntry makeDevice(uint16_t deviceId, const ChipRevision (&revisions)[R], const Model (&models)[M],
+    const char *branding) {
+    return {deviceId, revisions, R, models, M, branding};
+}
+
+/** No model names known, always uses `branding` */
+template<size_t R>
+constexpr DeviceEntry makeDevice(uint16_t deviceId, const ChipRevision (&revisions)[R], const char *branding) {
+    return {deviceId, revisions, R, nullptr, 0, branding};
+}
+
+// Sorted by device ID
+static constexpr DeviceEntry devices[] = {
+    makeDevice(0x1309, revSpectre, dev1309, brandingGeneric),
+    makeDevice(0x130A, revSpectre, dev130A, brandingGeneric),
+    makeDevice(0x130B, revSpectre, dev130B, brandingGeneric),
+    makeDevice(0x130C, revSpectre, dev130C, brandingGeneric),
+    makeDevice(0x130D, revSpectre, dev130D, brandingGeneric),
+    makeDevice(0x130E, revSpectre, dev130E, brandingGeneric),
+    makeDevice(0x130F, revSpectre, dev130F, brandingGeneric),
+    makeDevice(0x1312, revSpooky, brandingGeneric),
+    makeDevice(0x1313, revSpectre, dev1313, brandingGeneric),
+    makeDevice(0x1315, revSpectre, dev1315, brandingGeneric),
+    makeDevice(0x1316, revSpooky, dev1316, brandingGeneric),
+    makeDevice(0x1317, revSpooky, brandingGeneric),
+    makeDevice(0x1318, revSpectre, dev1318, brandingGeneric),
+    makeDevice(0x131B, revSpectre, dev131B, brandingGeneric),
+    makeDevice(0x131C, revSpectre, brandingGeneric),
+    makeDevice(0x131D, revSpectre, brandingGeneric),
+    makeDevice(0x9830, revKalindi, dev9830, brandingKabini),
+    makeDevice(0x9831, revKalindi, dev9831, brandingKabini),
+    makeDevice(0x9832, revKalindi, dev9832, brandingKabini),
+    makeDevice(0x9833, revKalindi, dev9833, brandingKabini),
+    makeDevice(0x9834, revKalindi, dev9834, brandingKabini),
+    makeDevice(0x9835, revKalindi, dev9835, brandingKabini),
+    makeDevice(0x9836, revKalindi, dev9836, brandingKabini),
+    makeDevice(0x9837, revKalindi, dev9837, brandingKabini),
+    makeDevice(0x9838, revKalindi, dev9838, brandingKabini),
+    makeDevice(0x9839, revKalindi, dev9839, brandingKabini),
+    makeDevice(0x983D, revKalindi, dev983D, brandingKabini),
+    makeDevice(0x9850, revGodavari, dev9850, brandingGeneric),
+    makeDevice(0x9851, revGodavari, dev9851, brandingGeneric),
+    makeDevice(0x9852, revGodavari, dev9852, brandingGeneric),
+    makeDevice(0x9853, revGodavari, dev9853, brandingGeneric),
+    makeDevice(0x9854, revGodavari, dev9854, brandingGeneric),
+    makeDevice(0x9855, revGodavari, dev9855, brandingGeneric),
+    makeDevice(0x9856, revGodavari, dev9856, brandingGeneric),
+    makeDevice(0x9874, revCarrizo, dev9874, brandingGeneric),
+    makeDevice(0x98E4, revStoney, dev98E4, brandingGeneric),
+};
+
+static constexpr bool devicesSorted() {
+    for (size_t i = 1; i < arrsize(devices); i++) {
+        if (devices[i - 1].deviceId >= devices[i].deviceId) { return false; }
+    }
+    return true;
+}
+
+static_assert(devicesSorted(), "devices must be sorted by ID and unique, findDevice bisects it");
+
+static constexpr const DeviceEntry *findDevice(uint32_t deviceId) {
+    size_t low = 0, high = arrsize(devices);
+    while (low < high) {
+        auto mid = (low + high) / 2;
+        if (devices[mid].deviceId == deviceId) { return &devices[mid]; }
+        if (devices[mid].deviceId < deviceId) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return nullptr;
+}
+
+static_assert(findDevice(0x1317)->chip(0)->type == ChipType::Spooky, "0x1317 is a Spooky");
+static_assert(findDevice(0x98E4)->chip(0xE1)->variant == ChipVariant::s2CU, "Stoney revision ranges are off");
+static_assert(!findDevice(0x1310), "0x1310 is not supported");
+
+static inline const char *getBranding(uint16_t dev, uint16_t rev) {
+    auto *device = findDevice(dev);
+    return device ? device->brandingFor(rev) : brandingGeneric;
+}
+
+#endif /* kern_devicedb_hpp */
@@ -5,6 +5,7 @@
 #include "kern_lred.hpp"
 #include "kern_patches.hpp"
 #include <Headers/kern_api.hpp>
+#include <kern/cpu_number.h>
 
 static const char *pathRadeonGFX7Con =
     "/System/Library/Extensions/AMD8000Controller.kext/Contents/MacOS/AMD8000Controller";
@@ -28,86 +29,135 @@ GFXCon *GFXCon::callback = nullptr;
 
 void GFXCon::init() {
     callback = this;
-    lilu.onKextLoadForce(&kextRadeonGFX7Con);
-    lilu.onKextLoadForce(&kextRadeonGFX8Con);
-    lilu.onKextLoadForce(&kextRadeonPolarisCon);
+    // -lredregdbg traces every register read, see Scripts/RegTrace.py
+    if (checkKernelArgument("-lredregdbg")) {
+        this->traceCall = thread_call_allocate(
+            [](thread_call_param_t param0, thread_call_param_t) { static_cast<GFXCon *>(param0)->publishTrace(); },
+            this);
+        PANIC_COND(!this->traceCall, "gfxcon", "Failed to allocate trace thread call");
+        nanoseconds_to_absolutetime(NSEC_PER_SEC, &this->tracePublishInterval);
+    }
+    auto &kexts = LRed::callback->kexts;
+    kexts.add<GFXCon, &GFXCon::processGFX7Con>(&kextRadeonGFX7Con, "gfx7con", this);
+    kexts.add<GFXCon, &GFXCon::processGFX8Con>(&kextRadeonGFX8Con, "gfx8con", this);
+    kexts.add<GFXCon, &GFXCon::processPolarisCon>(&kextRadeonPolarisCon, "polariscon", this);
 }
 
-bool GFXCon::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size) {
-    if (kextRadeonGFX7Con.loadIndex == index) {
-        LRed::callback->setRMMIOIfNecessary();
-        auto highsierra = getKernelVersion() == KernelVersion::HighSierra;
-        auto regDbg = checkKernelArgument("-lredregdbg");
-
-        RouteRequestPlus requests[] = {
-            {"__ZN18CISharedController11getFamilyIdEv", wrapGetFamilyId, orgGetFamilyId, highsierra},
-            {"__ZNK18CISharedController11getFamilyIdEv", wrapGetFamilyId, orgGetFamilyId, !highsierra},
-            {"__ZN17CIRegisterService10hwReadReg8Ej", wrapHwReadReg8, this->orgHwReadReg8, regDbg},
-            {"__ZN17CIRegisterService11hwReadReg16Ej", wrapHwReadReg16, this->orgHwReadReg16, regDbg},
-            {"__ZN17CIRegisterService11hwReadReg32Ej", wrapHwReadReg32, this->orgHwReadReg32, regDbg},
-            {"__ZN13ASIC_INFO__CI18populateDeviceInfoEv", wrapPopulateDeviceInfo, this->orgPopulateDeviceInfo,
-                !highsierra},
-        };
-        PANIC_COND(!RouteRequestPlus::routeAll(patcher, index, requests, address, size), "gfxcon",
-            "Failed to route symbols");
-
-        return true;
-    } else if (kextRadeonGFX8Con.loadIndex == index) {
-        LRed::callback->setRMMIOIfNecessary();
-        auto highsierra = getKernelVersion() == KernelVersion::HighSierra;
-        auto regDbg = checkKernelArgument("-lredregdbg");
-
-        RouteRequestPlus requests[] = {
-            {"__ZN18VISharedController11getFamilyIdEv", wrapGetFamilyId, orgGetFamilyId, highsierra},
-            {"__ZNK18VISharedController11getFamilyIdEv", wrapGetFamilyId, orgGetFamilyId, !highsierra},
-            {"__ZN17VIRegisterService10hwReadReg8Ej", wrapHwReadReg8, this->orgHwReadReg8, regDbg},
-            {"__ZN17VIRegisterService11hwReadReg16Ej", wrapHwReadReg16, this->orgHwReadReg16, regDbg},
-            {"__ZN17VIRegisterService11hwReadReg32Ej", wrapHwReadReg32, this->orgHwReadReg32, regDbg},
-            {"__ZN13ASIC_INFO__VI18populateDeviceInfoEv", wrapPopulateDeviceInfo, this->orgPopulateDeviceInfo,
-                !highsierra},
-        };
-        PANIC_COND(!RouteRequestPlus::routeAll(patcher, index, requests, address, size), "gfxcon",
-            "Failed to route symbols");
-
-        return true;
-    } else if (kextRadeonPolarisCon.loadIndex == index) {
-        LRed::callback->setRMMIOIfNecessary();
-        auto highsierra = getKernelVersion() == KernelVersion::HighSierra;
-        auto regDbg = checkKernelArgument("-lredregdbg");
-
-        RouteRequestPlus requests[] = {
-            {"__ZNK22BaffinSharedController11getFamilyIdEv", wrapGetFamilyId, orgGetFamilyId, !highsierra},
-            {"__ZN21BaffinRegisterService10hwReadReg8Ej", wrapHwReadReg8, this->orgHwReadReg8, regDbg},
-            {"__ZN21BaffinRegisterService11hwReadReg16Ej", wrapHwReadReg16, this->orgHwReadReg16, regDbg},
-            {"__ZN21BaffinRegisterService11hwReadReg32Ej", wrapHwReadReg32, this->orgHwReadReg32, regDbg},
-            {"__ZN17ASIC_INFO__BAFFIN18populateDeviceInfoEv", wrapPopulateDeviceInfo, this->orgPopulateDeviceInfo,
-                !highsierra},
-        };
-        PANIC_COND(!RouteRequestPlus::routeAll(patcher, index, requests, address, size), "gfxcon",
-            "Failed to route symbols");
-
-        return true;
-    }
+void GFXCon::processGFX7Con(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size) {
+    LRed::callback->setRMMIOIfNecessary();
+    this->controllerStart = address;
+    this->controllerSize = size;
+    auto highsierra = getKernelVersion() == KernelVersion::HighSierra;
+    // The register accesses of CAIL go through these, trace them for -lredregdbg and -lredmmiorec
+    auto hwRegs = this->traceCall || LRed::callback->regs.recorder().enabled();
+
+    RouteRequestPlus requests[] = {
+        {"__ZN18CISharedController11getFamilyIdEv", wrapGetFamilyId, orgGetFamilyId, highsierra},
+        {"__ZNK18CISharedController11getFamilyIdEv", wrapGetFamilyId, orgGetFamilyId, !highsierra},
+        {"__ZN17CIRegisterService10hwReadReg8Ej", wrapHwReadReg8, this->orgHwReadReg8, hwRegs},
+        {"__ZN17CIRegisterService11hwReadReg16Ej", wrapHwReadReg16, this->orgHwReadReg16, hwRegs},
+        {"__ZN17CIRegisterService11hwReadReg32Ej", wrapHwReadReg32, this->orgHwReadReg32, hwRegs},
+        {"__ZN17CIRegisterService11hwWriteReg8Ejh", wrapHwWriteReg8, this->orgHwWriteReg8, hwRegs},
+        {"__ZN17CIRegisterService12hwWriteReg16Ejt", wrapHwWriteReg16, this->orgHwWriteReg16, hwRegs},
+        {"__ZN17CIRegisterService12hwWriteReg32Ejj", wrapHwWriteReg32, this->orgHwWriteReg32, hwRegs},
+        {"__ZN13ASIC_INFO__CI18populateDeviceInfoEv", wrapPopulateDeviceInfo, this->orgPopulateDeviceInfo, !highsierra},
+    };
+    PANIC_COND(!RouteRequestPlus::routeAll(patcher, index, requests, address, size), "gfxcon",
+        "Failed to route symbols");
+}
 
-    return false;
+void GFXCon::processGFX8Con(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size) {
+    LRed::callback->setRMMIOIfNecessary();
+    this->controllerStart = address;
+    this->controllerSize = size;
+    auto highsierra = getKernelVersion() == KernelVersion::HighSierra;
+    auto hwRegs = this->traceCall || LRed::callback->regs.recorder().enabled();
+
+    RouteRequestPlus requests[] = {
+        {"__ZN18VISharedController11getFamilyIdEv", wrapGetFamilyId, orgGetFamilyId, highsierra},
+        {"__ZNK18VISharedController11getFamilyIdEv", wrapGetFamilyId, orgGetFamilyId, !highsierra},
+        {"__ZN17VIRegisterService10hwReadReg8Ej", wrapHwReadReg8, this->orgHwReadReg8, hwRegs},
+        {"__ZN17VIRegisterService11hwReadReg16Ej", wrapHwReadReg16, this->orgHwReadReg16, hwRegs},
+        {"__ZN17VIRegisterService11hwReadReg32Ej", wrapHwReadReg32, this->orgHwReadReg32, hwRegs},
+        {"__ZN17VIRegisterService11hwWriteReg8Ejh", wrapHwWriteReg8, this->orgHwWriteReg8, hwRegs},
+        {"__ZN17VIRegisterService12hwWriteReg16Ejt", wrapHwWriteReg16, this->orgHwWriteReg16, hwRegs},
+        {"__ZN17VIRegisterService12hwWriteReg32Ejj", wrapHwWriteReg32, this->orgHwWriteReg32, hwRegs},
+        {"__ZN13ASIC_INFO__VI18populateDeviceInfoEv", wrapPopulateDeviceInfo, this->orgPopulateDeviceInfo, !highsierra},
+    };
+    PANIC_COND(!RouteRequestPlus::routeAll(patcher, index, requests, address, size), "gfxcon",
+        "Failed to route symbols");
 }
 
-uint8_t GFXCon::wrapHwReadReg8(void *that, uint8_t reg) {
-    DBGLOG("gfxcon", "readReg8: reg: %x", reg);
-    // turned on by using -lredregdbg
-    return FunctionCast(wrapHwReadReg8, callback->orgHwReadReg8)(that, reg);
+void GFXCon::processPolarisCon(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size) {
+    LRed::callback->setRMMIOIfNecessary();
+    this->controllerStart = address;
+    this->controllerSize = size;
+    auto highsierra = getKernelVersion() == KernelVersion::HighSierra;
+    auto hwRegs = this->traceCall || LRed::callback->regs.recorder().enabled();
+
+    RouteRequestPlus requests[] = {
+        {"__ZNK22BaffinSharedController11getFamilyIdEv", wrapGetFamilyId, orgGetFamilyId, !highsierra},
+        {"__ZN21BaffinRegisterService10hwReadReg8Ej", wrapHwReadReg8, this->orgHwReadReg8, hwRegs},
+        {"__ZN21BaffinRegisterService11hwReadReg16Ej", wrapHwReadReg16, this->orgHwReadReg16, hwRegs},
+        {"__ZN21BaffinRegisterService11hwReadReg32Ej", wrapHwReadReg32, this->orgHwReadReg32, hwRegs},
+        {"__ZN21BaffinRegisterService11hwWriteReg8Ejh", wrapHwWriteReg8, this->orgHwWriteReg8, hwRegs},
+        {"__ZN21BaffinRegisterService12hwWriteReg16Ejt", wrapHwWriteReg16, this->orgHwWriteReg16, hwRegs},
+        {"__ZN21BaffinRegisterService12hwWriteReg32Ejj", wrapHwWriteReg32, this->orgHwWriteReg32, hwRegs},
+        {"__ZN17ASIC_INFO__BAFFIN18populateDeviceInfoEv", wrapPopulateDeviceInfo, this->orgPopulateDeviceInfo,
+            !highsierra},
+    };
+    PANIC_COND(!RouteRequestPlus::routeAll(patcher, index, requests, address, size), "gfxcon",
+        "Failed to route symbols");
 }
 
-uint16_t GFXCon::wrapHwReadReg16(void *that, uint16_t reg) {
-    DBGLOG("gfxcon", "readReg16: reg: %x", reg);
-    // turned on by using -lredregdbg
-    return FunctionCast(wrapHwReadReg16, callback->orgHwReadReg16)(that, reg);
+void GFXCon::publishTrace() { this->tracer.publish(LRed::callback->iGPU); }
+
+void GFXCon::traceAccess(MMIOAccess access, uint8_t width, uint32_t reg, uint32_t value, const void *caller) {
+    LRed::callback->regs.recorder().record(access, reg, value, false, width, MMIOSource::Controller);
+    if (!this->traceCall || access != MMIOAccess::Read) { return; }
+    auto now = mach_absolute_time();
+    auto offset = reinterpret_cast<mach_vm_address_t>(caller) - this->controllerStart;
+    this->tracer.record(static_cast<uint32_t>(cpu_number()), width, reg, value,
+        offset < this->controllerSize ? offset : 0, now);
+    // Can't allocate here, publish from a thread call at most once per interval
+    auto last = __atomic_load_n(&this->tracePublished, __ATOMIC_RELAXED);
+    if (now - last < this->tracePublishInterval) { return; }
+    if (__atomic_compare_exchange_n(&this->tracePublished, &last, now, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        thread_call_enter(this->traceCall);
+    }
+}
+
+uint8_t GFXCon::wrapHwReadReg8(void *that, uint32_t reg) {
+    auto ret = FunctionCast(wrapHwReadReg8, callback->orgHwReadReg8)(that, reg);
+    callback->traceAccess(MMIOAccess::Read, 8, reg, ret, __builtin_return_address(0));
+    return ret;
+}
+
+uint16_t GFXCon::wrapHwReadReg16(void *that, uint32_t reg) {
+    auto ret = FunctionCast(wrapHwReadReg16, callback->orgHwReadReg16)(that, reg);
+    callback->traceAccess(MMIOAccess::Read, 16, reg, ret, __builtin_return_address(0));
+    return ret;
 }
 
 uint32_t GFXCon::wrapHwReadReg32(void *that, uint32_t reg) {
-    DBGLOG("gfxcon", "readReg32: reg: %x", reg);
-    // turned on by using -lredregdbg
-    return FunctionCast(wrapHwReadReg32, callback->orgHwReadReg32)(that, reg);
+    auto ret = FunctionCast(wrapHwReadReg32, callback->orgHwReadReg32)(that, reg);
+    callback->traceAccess(MMIOAccess::Read, 32, reg, ret, __builtin_return_address(0));
+    return ret;
+}
+
+void GFXCon::wrapHwWriteReg8(void *that, uint32_t reg, uint8_t value) {
+    FunctionCast(wrapHwWriteReg8, callback->orgHwWriteReg8)(that, reg, value);
+    callback->traceAccess(MMIOAccess::Write, 8, reg, value, __builtin_return_address(0));
+}
+
+void GFXCon::wrapHwWriteReg16(void *that, uint32_t reg, uint16_t value) {
+    FunctionCast(wrapHwWriteReg16, callback->orgHwWriteReg16)(that, reg, value);
+    callback->traceAccess(MMIOAccess::Write, 16, reg, value, __builtin_return_address(0));
+}
+
+void GFXCon::wrapHwWriteReg32(void *that, uint32_t reg, uint32_t value) {
+    FunctionCast(wrapHwWriteReg32, callback->orgHwWriteReg32)(that, reg, value);
+    callback->traceAccess(MMIOAccess::Write, 32, reg, value, __builtin_return_address(0));
 }
 
 uint16_t GFXCon::wrapGetFamilyId(void) {
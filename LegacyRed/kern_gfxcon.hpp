@@ -4,27 +4,49 @@
 #ifndef kern_gfxcon_hpp
 #define kern_gfxcon_hpp
 #include "kern_amd.hpp"
+#include "kern_mmiotrace.hpp"
 #include "kern_patcherplus.hpp"
+#include "kern_regtrace.hpp"
 #include <Headers/kern_util.hpp>
+#include <kern/thread_call.h>
 
 class GFXCon {
     public:
     static GFXCon *callback;
     void init();
-    bool processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size);
 
     private:
     mach_vm_address_t orgGetFamilyId {0};
     mach_vm_address_t orgHwReadReg8 {0};
     mach_vm_address_t orgHwReadReg16 {0};
     mach_vm_address_t orgHwReadReg32 {0};
+    mach_vm_address_t orgHwWriteReg8 {0};
+    mach_vm_address_t orgHwWriteReg16 {0};
+    mach_vm_address_t orgHwWriteReg32 {0};
     mach_vm_address_t orgPopulateDeviceInfo {0};
+    RegTracer tracer;
+    thread_call_t traceCall {nullptr};
+    uint64_t tracePublished {0};
+    uint64_t tracePublishInterval {0};
+    mach_vm_address_t controllerStart {0};
+    size_t controllerSize {0};
+
+    /** Hands the access to the MMIO recorder, and reads also to the tracer of `-lredregdbg` */
+    void traceAccess(MMIOAccess access, uint8_t width, uint32_t reg, uint32_t value, const void *caller);
+    void publishTrace();
+
+    void processGFX7Con(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size);
+    void processGFX8Con(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size);
+    void processPolarisCon(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size);
 
     static IOReturn wrapPopulateDeviceInfo(void *that);
     static uint16_t wrapGetFamilyId(void);
-    static uint8_t wrapHwReadReg8(void *that, uint8_t param1);
-    static uint16_t wrapHwReadReg16(void *that, uint16_t param1);
-    static uint32_t wrapHwReadReg32(void *that, uint32_t param1);
+    static uint8_t wrapHwReadReg8(void *that, uint32_t reg);
+    static uint16_t wrapHwReadReg16(void *that, uint32_t reg);
+    static uint32_t wrapHwReadReg32(void *that, uint32_t reg);
+    static void wrapHwWriteReg8(void *that, uint32_t reg, uint8_t value);
+    static void wrapHwWriteReg16(void *that, uint32_t reg, uint16_t value);
+    static void wrapHwWriteReg32(void *that, uint32_t reg, uint32_t value);
 };
 
 #endif /* kern_gfxcon_hpp */
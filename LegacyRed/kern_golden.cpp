@@ -0,0 +1,132 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+#include "kern_golden.hpp"
+#include <libkern/c++/OSArray.h>
+#include <libkern/c++/OSDictionary.h>
+#include <libkern/c++/OSNumber.h>
+
+// mmGRBM_GFX_INDEX and mmSRBM_GFX_CNTL on CI/VI, they steer the writes after them to an SE/SH or VMID.
+// Each with what it's put back to: broadcast to all SEs, SHs and instances, and VMID 0
+static constexpr RegOp selectors[] = {
+    {0xC200, ~0U, 0xE0000000},
+    {0x391, ~0U, 0},
+};
+
+bool GoldenSettings::isOrderSensitive(uint32_t reg) {
+    for (auto &selector : selectors) {
+        if (reg == selector.reg) { return true; }
+    }
+    return false;
+}
+
+bool GoldenSettings::parse(const uint32_t *table) {
+    if (!table) { return false; }
+
+    size_t count = 0;
+    bool ordered = false;
+    while (table[count * 3] != EndOfTable) {
+        if (count >= MaxSettings) {
+            SYSLOG("golden", "Golden settings table is not terminated within %zu settings", MaxSettings);
+            return false;
+        }
+        ordered |= isOrderSensitive(table[count * 3]);
+        count++;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        auto reg = table[i * 3], andMask = table[i * 3 + 1], orMask = table[i * 3 + 2];
+        // Clearing `and_mask` then setting `or_mask` is a masked write of `or_mask` over both
+        this->ops[i] = {reg, andMask | orMask, orMask};
+    }
+    this->opCount = count;
+    this->ordered = ordered;
+    this->sortAndCoalesce();
+    DBGLOG("golden", "Parsed %zu golden settings into %zu operations%s", count, this->opCount,
+        ordered ? " in table order" : "");
+    return true;
+}
+
+void GoldenSettings::sortAndCoalesce() {
+    // Stable insertion sort, the tables are short and mostly sorted already
+    if (!this->ordered) {
+        for (size_t i = 1; i < this->opCount; i++) {
+            auto op = this->ops[i];
+            auto j = i;
+            for (; j > 0 && this->ops[j - 1].reg > op.reg; j--) { this->ops[j] = this->ops[j - 1]; }
+            this->ops[j] = op;
+        }
+    }
+
+    size_t out = 0;
+    for (size_t i = 0; i < this->opCount; i++) {
+        auto &op = this->ops[i];
+        if (out && this->ops[out - 1].reg == op.reg) {
+            auto &prev = this->ops[out - 1];
+            prev.value = (prev.value & ~op.mask) | (op.value & op.mask);
+            prev.mask |= op.mask;
+            continue;
+        }
+        this->ops[out++] = op;
+    }
+    this->opCount = out;
+}
+
+size_t GoldenSettings::diff(RegisterAccess &regs, GoldenMismatch *out, size_t max) const {
+    size_t mismatches = 0;
+    for (size_t i = 0; i < this->opCount; i++) {
+        auto &op = this->ops[i];
+        // The settings after a selector are for the bank it selects, so select it before reading them
+        if (this->ordered && isOrderSensitive(op.reg)) {
+            regs.apply(&op, 1);
+            continue;
+        }
+        auto actual = regs.read(op.reg);
+        if ((actual & op.mask) == (op.value & op.mask)) { continue; }
+        if (mismatches < max) { out[mismatches] = {op.reg, op.mask, op.value & op.mask, actual}; }
+        mismatches++;
+    }
+    for (size_t i = 0; this->ordered && i < arrsize(selectors); i++) {
+        for (size_t j = 0; j < this->opCount; j++) {
+            if (this->ops[j].reg == selectors[i].reg) {
+                regs.apply(&selectors[i], 1);
+                break;
+            }
+        }
+    }
+    return mismatches;
+}
+
+static void setNumber(OSDictionary *dict, const char *key, uint32_t value) {
+    auto *number = OSNumber::withNumber(value, 32);
+    if (!number) { return; }
+    dict->setObject(key, number);
+    number->release();
+}
+
+size_t GoldenSettings::report(RegisterAccess &regs, IORegistryEntry *entry) const {
+    static constexpr size_t MaxReported = 32;
+    GoldenMismatch mismatches[MaxReported];
+    auto total = this->diff(regs, mismatches, MaxReported);
+    auto reported = total < MaxReported ? total : MaxReported;
+
+    auto *list = OSArray::withCapacity(static_cast<unsigned int>(reported));
+    if (!list) {
+        SYSLOG("golden", "Failed to allocate the golden settings report");
+        return total;
+    }
+    for (size_t i = 0; i < reported; i++) {
+        auto *dict = OSDictionary::withCapacity(4);
+        if (!dict) { continue; }
+        setNumber(dict, "Register", mismatches[i].reg);
+        setNumber(dict, "Mask", mismatches[i].mask);
+        setNumber(dict, "Expected", mismatches[i].expected);
+        setNumber(dict, "Actual", mismatches[i].actual & mismatches[i].mask);
+        list->setObject(dict);
+        dict->release();
+    }
+    entry->setProperty("LRedGoldenDiff", list);
+    list->release();
+    DBGLOG("golden", "%zu of %zu golden registers differ", total, this->opCount);
+    return total;
+}
@@ -0,0 +1,52 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+#ifndef kern_golden_hpp
+#define kern_golden_hpp
+#include "kern_regaccess.hpp"
+#include <Headers/kern_util.hpp>
+#include <IOKit/IORegistryEntry.h>
+
+struct GoldenMismatch {
+    uint32_t reg;
+    uint32_t mask;
+    uint32_t expected;
+    uint32_t actual;
+};
+
+/**
+ * The golden register settings of an ASIC, read from the HWLibs `*_GoldenSettings_*` tables.
+ * The tables are `{reg, and_mask, or_mask}` triples up to a register of `0xFFFFFFFF`; like amdgpu on CI/VI, a setting
+ * clears `and_mask` and then sets `or_mask`.
+ * Settings are kept as `RegOp`s sorted by register with one operation per register, so they apply in a single pass.
+ */
+class GoldenSettings {
+    public:
+    static constexpr size_t MaxSettings = 256;
+    static constexpr uint32_t EndOfTable = 0xFFFFFFFF;
+
+    /** Fails without changing anything when the table isn't terminated within `MaxSettings` */
+    bool parse(const uint32_t *table);
+    size_t count() const { return this->opCount; }
+
+    void apply(RegisterAccess &regs) const { regs.apply(this->ops, this->opCount); }
+    /**
+     * Returns how many registers differ from their golden value, the first `max` of them go to `out`.
+     * Selector registers are written as the table has them, so that the registers after them are read in the right
+     * bank, and put back to broadcast at the end.
+     */
+    size_t diff(RegisterAccess &regs, GoldenMismatch *out, size_t max) const;
+    /** Publishes the differences as `LRedGoldenDiff`, returns how many there are */
+    size_t report(RegisterAccess &regs, IORegistryEntry *entry) const;
+
+    private:
+    RegOp ops[MaxSettings] {};
+    size_t opCount {0};
+    /** Selects where later writes go, settings around them keep the order of the table */
+    bool ordered {false};
+
+    static bool isOrderSensitive(uint32_t reg);
+    void sortAndCoalesce();
+};
+
+#endif /* kern_golden_hpp */
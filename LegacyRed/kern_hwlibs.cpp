@@ -16,116 +16,116 @@ HWLibs *HWLibs::callback = nullptr;
 
 void HWLibs::init() {
     callback = this;
-    lilu.onKextLoadForce(&kextRadeonX4000HWLibs);
+    LRed::callback->kexts.add<HWLibs, &HWLibs::processKext>(&kextRadeonX4000HWLibs, "hwlibs", this);
 }
 
-bool HWLibs::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size) {
-    if (kextRadeonX4000HWLibs.loadIndex == index) {
-        LRed::callback->setRMMIOIfNecessary();
-
-        CailAsicCapEntry *orgAsicCapsTable = nullptr;
-        CailInitAsicCapEntry *orgAsicInitCapsTable = nullptr;
-        const void *goldenSettings[static_cast<uint32_t>(ChipType::Unknown)] = {nullptr};
-        const uint32_t *ddiCaps[static_cast<uint32_t>(ChipType::Unknown)] = {nullptr};
-
-        // The pains of supporting more than two iGPU generations
-        switch (LRed::callback->chipVariant) {
-            case ChipVariant::s2CU: {
-                SolveRequestPlus solveRequests[] = {
-                    {"_STONEY_GoldenSettings_A0_2CU", goldenSettings[static_cast<uint32_t>(ChipType::Stoney)]},
-                    {"_CAIL_DDI_CAPS_STONEY_A0", ddiCaps[static_cast<uint32_t>(ChipType::Stoney)]},
-                };
-                PANIC_COND(!SolveRequestPlus::solveAll(&patcher, index, solveRequests, address, size), "hwlibs",
-                    "Failed to resolve symbols");
-                DBGLOG("hwlibs", "Stoney ASIC is 2CU model");
-                break;
-            }
-            case ChipVariant::s3CU: {
-                SolveRequestPlus solveRequests[] = {
-                    {"_STONEY_GoldenSettings_A0_3CU", goldenSettings[static_cast<uint32_t>(ChipType::Stoney)]},
-                    {"_CAIL_DDI_CAPS_STONEY_A0", ddiCaps[static_cast<uint32_t>(ChipType::Stoney)]},
-                };
-                PANIC_COND(!SolveRequestPlus::solveAll(&patcher, index, solveRequests, address, size), "hwlibs",
-                    "Failed to resolve symbols");
-                DBGLOG("hwlibs", "Stoney ASIC is 3CU model");
-                break;
-            }
-            case ChipVariant::Bristol: {
-                SolveRequestPlus solveRequests[] = {
-                    {"_CARRIZO_GoldenSettings_A1", goldenSettings[static_cast<uint32_t>(ChipType::Carrizo)]},
-                    {"_CAIL_DDI_CAPS_CARRIZO_A1", ddiCaps[static_cast<uint32_t>(ChipType::Carrizo)]},
-                };
-                PANIC_COND(!SolveRequestPlus::solveAll(&patcher, index, solveRequests, address, size), "hwlibs",
-                    "Failed to resolve symbols");
-                DBGLOG("hwlibs", "Carrizo ASIC is Bristol Ridge model");
-                break;
-            }
-            default: {
-                SolveRequestPlus solveRequests[] = {
-                    {"_CAIL_DDI_CAPS_SPECTRE_A0", ddiCaps[static_cast<uint32_t>(ChipType::Spectre)]},
-                    {"_SPECTRE_GoldenSettings_A0_8812", goldenSettings[static_cast<uint32_t>(ChipType::Spectre)]},
-                    {"_CAIL_DDI_CAPS_SPECTRE_A0", ddiCaps[static_cast<uint32_t>(ChipType::Spooky)]},
-                    {"_SPECTRE_GoldenSettings_A0_8812", goldenSettings[static_cast<uint32_t>(ChipType::Spooky)]},
-                    {"_CAIL_DDI_CAPS_KALINDI_A0", ddiCaps[static_cast<uint32_t>(ChipType::Kalindi)]},
-                    {"_KALINDI_GoldenSettings_A0_4882", goldenSettings[static_cast<uint32_t>(ChipType::Kalindi)]},
-                    {"_CAIL_DDI_CAPS_KALINDI_A1", ddiCaps[static_cast<uint32_t>(ChipType::Godavari)]},
-                    {"_GODAVARI_GoldenSettings_A0_2411", goldenSettings[static_cast<uint32_t>(ChipType::Godavari)]},
-                    {"_CARRIZO_GoldenSettings_A0", goldenSettings[static_cast<uint32_t>(ChipType::Carrizo)]},
-                    {"_CAIL_DDI_CAPS_CARRIZO_A0", ddiCaps[static_cast<uint32_t>(ChipType::Carrizo)]},
-                    /** Spectre appears to be another name for Kaveri, so that's the logic we'll use for it */
-                    // Spooky has no DDI caps or GoldenSettings, uses Spectre on AMDGPU so that's what we'll use
-                };
-                PANIC_COND(!SolveRequestPlus::solveAll(&patcher, index, solveRequests, address, size), "hwlibs",
-                    "Failed to resolve symbols");
-                DBGLOG("hwlibs", "Using Normal Golden Settings and DDI Caps");
-                break;
-            }
+void HWLibs::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size) {
+    LRed::callback->setRMMIOIfNecessary();
+
+    CailAsicCapEntry *orgAsicCapsTable = nullptr;
+    CailInitAsicCapEntry *orgAsicInitCapsTable = nullptr;
+    const void *goldenSettings[static_cast<uint32_t>(ChipType::Unknown)] = {nullptr};
+    const uint32_t *ddiCaps[static_cast<uint32_t>(ChipType::Unknown)] = {nullptr};
+
+    // The pains of supporting more than two iGPU generations
+    switch (LRed::callback->chipVariant) {
+        case ChipVariant::s2CU: {
+            SolveRequestPlus solveRequests[] = {
+                {"_STONEY_GoldenSettings_A0_2CU", goldenSettings[static_cast<uint32_t>(ChipType::Stoney)]},
+                {"_CAIL_DDI_CAPS_STONEY_A0", ddiCaps[static_cast<uint32_t>(ChipType::Stoney)]},
+            };
+            PANIC_COND(!SolveRequestPlus::solveAll(&patcher, index, solveRequests, address, size), "hwlibs",
+                "Failed to resolve symbols");
+            DBGLOG("hwlibs", "Stoney ASIC is 2CU model");
+            break;
+        }
+        case ChipVariant::s3CU: {
+            SolveRequestPlus solveRequests[] = {
+                {"_STONEY_GoldenSettings_A0_3CU", goldenSettings[static_cast<uint32_t>(ChipType::Stoney)]},
+                {"_CAIL_DDI_CAPS_STONEY_A0", ddiCaps[static_cast<uint32_t>(ChipType::Stoney)]},
+            };
+            PANIC_COND(!SolveRequestPlus::solveAll(&patcher, index, solveRequests, address, size), "hwlibs",
+                "Failed to resolve symbols");
+            DBGLOG("hwlibs", "Stoney ASIC is 3CU model");
+            break;
+        }
+        case ChipVariant::Bristol: {
+            SolveRequestPlus solveRequests[] = {
+                {"_CARRIZO_GoldenSettings_A1", goldenSettings[static_cast<uint32_t>(ChipType::Carrizo)]},
+                {"_CAIL_DDI_CAPS_CARRIZO_A1", ddiCaps[static_cast<uint32_t>(ChipType::Carrizo)]},
+            };
+            PANIC_COND(!SolveRequestPlus::solveAll(&patcher, index, solveRequests, address, size), "hwlibs",
+                "Failed to resolve symbols");
+            DBGLOG("hwlibs", "Carrizo ASIC is Bristol Ridge model");
+            break;
+        }
+        default: {
+            SolveRequestPlus solveRequests[] = {
+                {"_CAIL_DDI_CAPS_SPECTRE_A0", ddiCaps[static_cast<uint32_t>(ChipType::Spectre)]},
+                {"_SPECTRE_GoldenSettings_A0_8812", goldenSettings[static_cast<uint32_t>(ChipType::Spectre)]},
+                {"_CAIL_DDI_CAPS_SPECTRE_A0", ddiCaps[static_cast<uint32_t>(ChipType::Spooky)]},
+                {"_SPECTRE_GoldenSettings_A0_8812", goldenSettings[static_cast<uint32_t>(ChipType::Spooky)]},
+                {"_CAIL_DDI_CAPS_KALINDI_A0", ddiCaps[static_cast<uint32_t>(ChipType::Kalindi)]},
+                {"_KALINDI_GoldenSettings_A0_4882", goldenSettings[static_cast<uint32_t>(ChipType::Kalindi)]},
+                {"_CAIL_DDI_CAPS_KALINDI_A1", ddiCaps[static_cast<uint32_t>(ChipType::Godavari)]},
+                {"_GODAVARI_GoldenSettings_A0_2411", goldenSettings[static_cast<uint32_t>(ChipType::Godavari)]},
+                {"_CARRIZO_GoldenSettings_A0", goldenSettings[static_cast<uint32_t>(ChipType::Carrizo)]},
+                {"_CAIL_DDI_CAPS_CARRIZO_A0", ddiCaps[static_cast<uint32_t>(ChipType::Carrizo)]},
+                /** Spectre appears to be another name for Kaveri, so that's the logic we'll use for it */
+                // Spooky has no DDI caps or GoldenSettings, uses Spectre on AMDGPU so that's what we'll use
+            };
+            PANIC_COND(!SolveRequestPlus::solveAll(&patcher, index, solveRequests, address, size), "hwlibs",
+                "Failed to resolve symbols");
+            DBGLOG("hwlibs", "Using Normal Golden Settings and DDI Caps");
+            break;
         }
-
-        SolveRequestPlus solveRequests[] = {
-            {"__ZN31AtiAppleHawaiiPowerTuneServicesC1EP11PP_InstanceP18PowerPlayCallbacks",
-                this->orgHawaiiPowerTuneConstructor, !LRed::callback->isGCN3},
-            {"__ZN30AtiAppleTongaPowerTuneServicesC1EP11PP_InstanceP18PowerPlayCallbacks",
-                this->orgTongaPowerTuneConstructor, LRed::callback->isGCN3},
-            {"__ZL20CAIL_ASIC_CAPS_TABLE", orgAsicCapsTable},
-            {"_CAILAsicCapsInitTable", orgAsicInitCapsTable},
-            {"_CIslands_SendMsgToSmc", this->orgCISendMsgToSmc, LRed::callback->chipType < ChipType::Carrizo},
-        };
-        PANIC_COND(!SolveRequestPlus::solveAll(&patcher, index, solveRequests, address, size), "hwlibs",
-            "Failed to resolve symbols");
-
-        KernelPatcher::RouteRequest requests[] = {
-            {"__ZN15AmdCailServicesC2EP11IOPCIDevice", wrapAmdCailServicesConstructor, orgAmdCailServicesConstructor},
-            {"__ZN25AtiApplePowerTuneServices23createPowerTuneServicesEP11PP_InstanceP18PowerPlayCallbacks",
-                wrapCreatePowerTuneServices},
-            {"__ZN15AmdCailServices23queryEngineRunningStateEP17CailHwEngineQueueP22CailEngineRunningState",
-                wrapCAILQueryEngineRunningState, orgCAILQueryEngineRunningState},
-            {"_CailMonitorPerformanceCounter", wrapCailMonitorPerformanceCounter, orgCailMonitorPerformanceCounter},
-            {"_CailMonitorEngineInternalState", wrapCailMonitorEngineInternalState, orgCailMonitorEngineInternalState},
-            {"_MCILDebugPrint", wrapMCILDebugPrint, orgMCILDebugPrint},
-            {"_SMUM_Initialize", wrapSMUMInitialize, orgSMUMInitialize},
-            //{"_SmuCz_Initialize", wrapSmuCzInitialize, this->orgSmuCzInitialize},
-        };
-        PANIC_COND(!patcher.routeMultiple(index, requests, address, size), "hwlibs", "Failed to route symbols");
-
-        PANIC_COND(MachInfo::setKernelWriting(true, KernelPatcher::kernelWriteLock) != KERN_SUCCESS, "hwlibs",
-            "Failed to enable kernel writing");
-        orgAsicInitCapsTable->familyId = orgAsicCapsTable->familyId =
-            LRed::callback->isGCN3 ? AMDGPU_FAMILY_CZ : AMDGPU_FAMILY_KV;
-        orgAsicInitCapsTable->deviceId = orgAsicCapsTable->deviceId = LRed::callback->deviceId;
-        orgAsicInitCapsTable->revision = orgAsicCapsTable->revision = LRed::callback->revision;
-        orgAsicInitCapsTable->emulatedRev = orgAsicCapsTable->emulatedRev =
-            static_cast<uint32_t>(LRed::callback->enumeratedRevision) + LRed::callback->revision;
-        orgAsicInitCapsTable->pciRev = orgAsicCapsTable->pciRev = 0xFFFFFFFF;
-        orgAsicInitCapsTable->caps = orgAsicCapsTable->caps = ddiCaps[static_cast<uint32_t>(LRed::callback->chipType)];
-        orgAsicInitCapsTable->goldenCaps = goldenSettings[static_cast<uint32_t>(LRed::callback->chipType)];
-        MachInfo::setKernelWriting(false, KernelPatcher::kernelWriteLock);
-        DBGLOG("hwlibs", "Applied DDI Caps patches");
-
-        return true;
     }
 
-    return false;
+    SolveRequestPlus solveRequests[] = {
+        {"__ZN31AtiAppleHawaiiPowerTuneServicesC1EP11PP_InstanceP18PowerPlayCallbacks",
+            this->orgHawaiiPowerTuneConstructor, !LRed::callback->isGCN3},
+        {"__ZN30AtiAppleTongaPowerTuneServicesC1EP11PP_InstanceP18PowerPlayCallbacks",
+            this->orgTongaPowerTuneConstructor, LRed::callback->isGCN3},
+        {"__ZL20CAIL_ASIC_CAPS_TABLE", orgAsicCapsTable},
+        {"_CAILAsicCapsInitTable", orgAsicInitCapsTable},
+        {"_CIslands_SendMsgToSmc", this->orgCISendMsgToSmc, LRed::callback->chipType < ChipType::Carrizo},
+    };
+    PANIC_COND(!SolveRequestPlus::solveAll(&patcher, index, solveRequests, address, size), "hwlibs",
+        "Failed to resolve symbols");
+
+    RouteRequestPlus requests[] = {
+        {"__ZN15AmdCailServicesC2EP11IOPCIDevice", wrapAmdCailServicesConstructor, orgAmdCailServicesConstructor},
+        {"__ZN25AtiApplePowerTuneServices23createPowerTuneServicesEP11PP_InstanceP18PowerPlayCallbacks",
+            wrapCreatePowerTuneServices},
+        {"__ZN15AmdCailServices23queryEngineRunningStateEP17CailHwEngineQueueP22CailEngineRunningState",
+            wrapCAILQueryEngineRunningState, orgCAILQueryEngineRunningState},
+        {"_CailMonitorPerformanceCounter", wrapCailMonitorPerformanceCounter, orgCailMonitorPerformanceCounter},
+        {"_CailMonitorEngineInternalState", wrapCailMonitorEngineInternalState, orgCailMonitorEngineInternalState},
+        {"_MCILDebugPrint", wrapMCILDebugPrint, orgMCILDebugPrint},
+        {"_SMUM_Initialize", wrapSMUMInitialize, orgSMUMInitialize},
+        //{"_SmuCz_Initialize", wrapSmuCzInitialize, this->orgSmuCzInitialize},
+    };
+    PatchTransaction transaction {patcher, index, address, size};
+    transaction.route(requests);
+
+    auto asicCaps = *orgAsicCapsTable;
+    auto asicInitCaps = *orgAsicInitCapsTable;
+    asicInitCaps.familyId = asicCaps.familyId = LRed::callback->isGCN3 ? AMDGPU_FAMILY_CZ : AMDGPU_FAMILY_KV;
+    asicInitCaps.deviceId = asicCaps.deviceId = LRed::callback->deviceId;
+    asicInitCaps.revision = asicCaps.revision = LRed::callback->revision;
+    asicInitCaps.emulatedRev = asicCaps.emulatedRev =
+        static_cast<uint32_t>(LRed::callback->enumeratedRevision) + LRed::callback->revision;
+    asicInitCaps.pciRev = asicCaps.pciRev = 0xFFFFFFFF;
+    asicInitCaps.caps = asicCaps.caps = ddiCaps[static_cast<uint32_t>(LRed::callback->chipType)];
+    asicInitCaps.goldenCaps = goldenSettings[static_cast<uint32_t>(LRed::callback->chipType)];
+    if (LRed::callback->goldenDiff) {
+        SYSLOG_COND(!LRed::callback->golden.parse(static_cast<const uint32_t *>(asicInitCaps.goldenCaps)), "hwlibs",
+            "Failed to parse the golden settings");
+    }
+    transaction.write(orgAsicCapsTable, asicCaps);
+    transaction.write(orgAsicInitCapsTable, asicInitCaps);
+    PANIC_COND(!transaction.commit(), "hwlibs", "Failed to apply patches");
+    DBGLOG("hwlibs", "Applied DDI Caps patches");
 }
 
 void HWLibs::wrapAmdCailServicesConstructor(void *that, IOPCIDevice *provider) {
@@ -15,7 +15,6 @@ class HWLibs {
     public:
     static HWLibs *callback;
     void init();
-    bool processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size);
 
     private:
     t_XPowerTuneConstructor orgHawaiiPowerTuneConstructor {nullptr};
@@ -30,6 +29,8 @@ class HWLibs {
     mach_vm_address_t orgSmuCzInitialize {0};
     mach_vm_address_t orgMCILDebugPrint {};
 
+    void processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size);
+
     static void wrapAmdCailServicesConstructor(void *that, IOPCIDevice *provider);
     static uint64_t wrapCAILQueryEngineRunningState(void *param1, uint32_t *param2, uint64_t param3);
     static uint64_t wrapCailMonitorEngineInternalState(void *that, uint32_t param1, uint32_t *param2);
@@ -0,0 +1,52 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+#include "kern_kextdispatch.hpp"
+#include "kern_bootprofile.hpp"
+#include "kern_symindex.hpp"
+
+bool KextDispatcher::add(KernelPatcher::KextInfo *info, const char *name, LiluAPI::t_kextLoaded callback,
+    void *user) {
+    if (this->handlerCount >= MaxHandlers || !info || !callback) {
+        SYSLOG("dispatch", "Failed to add handler for %s", name);
+        return false;
+    }
+
+    this->handlers[this->handlerCount++] = {info, name, callback, user};
+    if (this->handlerCount == 1) {
+        lilu.onKextLoadForce(
+            info, 1,
+            [](void *user, KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size) {
+                static_cast<KextDispatcher *>(user)->dispatch(patcher, index, address, size);
+            },
+            this);
+    } else {
+        lilu.onKextLoadForce(info);
+    }
+    return true;
+}
+
+KextDispatcher::Handler *KextDispatcher::resolve(size_t index) {
+    auto cached = index < MaxLoadIndices ? this->byLoadIndex[index] : Unresolved;
+    if (cached == NoHandler) { return nullptr; }
+    if (cached != Unresolved) { return &this->handlers[cached - 1]; }
+
+    for (size_t i = 0; i < this->handlerCount; i++) {
+        if (this->handlers[i].info->loadIndex != index) { continue; }
+        if (index < MaxLoadIndices) { this->byLoadIndex[index] = static_cast<uint8_t>(i + 1); }
+        return &this->handlers[i];
+    }
+    if (index < MaxLoadIndices) { this->byLoadIndex[index] = NoHandler; }
+    return nullptr;
+}
+
+void KextDispatcher::dispatch(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size) {
+    auto *handler = this->resolve(index);
+    if (!handler) { return; }
+
+    auto span = BootProfile::begin(handler->name);
+    handler->callback(handler->user, patcher, index, address, size);
+    SymbolIndex::release();
+    BootProfile::end(span);
+    BootProfile::publishLater();
+}
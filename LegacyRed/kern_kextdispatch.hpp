@@ -0,0 +1,52 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+#ifndef kern_kextdispatch_hpp
+#define kern_kextdispatch_hpp
+#include <Headers/kern_api.hpp>
+#include <Headers/kern_patcher.hpp>
+
+/**
+ * Routes each kext load straight to the handler registered for that kext.
+ * Lilu assigns load indices on load, so an index is resolved once and then looked up directly.
+ * Each run is a span of the boot profile under the handler's name, the profile is published once loads settle.
+ */
+class KextDispatcher {
+    public:
+    struct Handler {
+        KernelPatcher::KextInfo *info;
+        const char *name;
+        LiluAPI::t_kextLoaded callback;
+        void *user;
+    };
+
+    static constexpr size_t MaxHandlers = 16;
+
+    /** Registers the kext with Lilu, the first one also carries the dispatch callback */
+    bool add(KernelPatcher::KextInfo *info, const char *name, LiluAPI::t_kextLoaded callback, void *user);
+
+    template<typename T, void (T::*Process)(KernelPatcher &, size_t, mach_vm_address_t, size_t)>
+    bool add(KernelPatcher::KextInfo *info, const char *name, T *owner) {
+        return this->add(
+            info, name,
+            [](void *user, KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size) {
+                (static_cast<T *>(user)->*Process)(patcher, index, address, size);
+            },
+            owner);
+    }
+
+    private:
+    static constexpr size_t MaxLoadIndices = 64;
+    static constexpr uint8_t Unresolved = 0;
+    static constexpr uint8_t NoHandler = 0xFF;
+
+    Handler handlers[MaxHandlers] {};
+    size_t handlerCount {0};
+    /** Per load index, the handler + 1, or `NoHandler` for kexts other plugins asked for */
+    uint8_t byLoadIndex[MaxLoadIndices] {};
+
+    Handler *resolve(size_t index);
+    void dispatch(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size);
+};
+
+#endif /* kern_kextdispatch_hpp */
@@ -0,0 +1,15 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+// Generated by Scripts/PatchPlanGen.py, do not edit.
+
+#ifndef kern_kextplans_hpp
+#define kern_kextplans_hpp
+#include "kern_symindex.hpp"
+
+// Symbols are sorted within each plan, the last entry keeps the array from being empty
+static const KextPlan kextPlans[] = {
+    {{0}, nullptr, 0, nullptr, 0},
+};
+
+#endif /* kern_kextplans_hpp */
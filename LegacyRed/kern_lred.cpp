@@ -2,15 +2,18 @@
 //  details.
 
 #include "kern_lred.hpp"
+#include "kern_bootprofile.hpp"
+#include "kern_devicedb.hpp"
 #include "kern_gfxcon.hpp"
 #include "kern_hwlibs.hpp"
-#include "kern_model.hpp"
+#include "kern_pagepatch.hpp"
 #include "kern_patches.hpp"
 #include "kern_support.hpp"
 #include "kern_x4000.hpp"
 #include <Headers/kern_api.hpp>
 #include <Headers/kern_devinfo.hpp>
 #include <IOKit/IODeviceTreeSupport.h>
+#include <IOKit/IOLib.h>
 
 static const char *pathAGDP = "/System/Library/Extensions/AppleGraphicsControl.kext/Contents/PlugIns/"
                               "AppleGraphicsDevicePolicy.kext/Contents/MacOS/AppleGraphicsDevicePolicy";
@@ -30,29 +33,71 @@ static GFXCon gfxcon;
 static Support support;
 static HWLibs hwlibs;
 static X4000 x4000;
+static PagePatcher pagePatcher;
+
+// Registers that identify the ASIC, they don't change once it's up
+// Each of these is read once during boot for now, so nothing gets served from the shadow yet
+static const RegShadow shadowedRegisters[] = {
+    {mmFB_OFFSET, RegPolicy::Immutable},
+    {mmREVISION, RegPolicy::Immutable},
+};
+
+// What `WIOKit::awaitPublishing` allows for one device, here shared by all of them
+static constexpr uint32_t PublishDeadlineMs = 5120;
+static constexpr uint32_t PublishPollMs = 10;
+
+/** Polls until every entry is published or the absolute `deadline` passed */
+static void awaitPublishingAll(IORegistryEntry **entries, size_t count, uint64_t deadline) {
+    ProfileSpan span {"awaitPublishing"};
+    size_t pending = count;
+    for (uint32_t waited = 0;; waited += PublishPollMs) {
+        for (size_t i = 0; i < count; i++) {
+            if (entries[i] && entries[i]->inPlane(gIOServicePlane)) {
+                entries[i] = nullptr;
+                pending--;
+            }
+        }
+        if (!pending) {
+            DBGLOG("lred", "Devices published after %u ms", waited);
+            return;
+        }
+        if (mach_absolute_time() >= deadline) { break; }
+        IOSleep(PublishPollMs);
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (entries[i]) { SYSLOG("lred", "%s was not published in time", safeString(entries[i]->getName())); }
+    }
+}
 
 void LRed::init() {
     SYSLOG("lred", "Copyright © 2023 ChefKiss Inc. If you've paid for this, you've been scammed.");
     callback = this;
+    BootProfile::init();
+    this->fbOnly = checkKernelArgument("-lredfbonly");
+    BootProfile::setMode(this->fbOnly ? "FramebufferOnly" : "Full");
+    this->goldenDiff = checkKernelArgument("-lredgoldendiff");
+    // Records register accesses from the first one on, see Scripts/MMIOTrace.py
+    if (checkKernelArgument("-lredmmiorec")) { this->regs.recorder().enable(MMIORecorder::DefaultCapacity); }
 
     lilu.onPatcherLoadForce(
         [](void *user, KernelPatcher &patcher) { static_cast<LRed *>(user)->processPatcher(patcher); }, this);
-    lilu.onKextLoadForce(
-        nullptr, 0,
-        [](void *user, KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size) {
-            static_cast<LRed *>(user)->processKext(patcher, index, address, size);
-        },
-        this);
     lilu.onKextLoadForce(&kextAGDP);
-    lilu.onKextLoadForce(&kextBacklight);
-    lilu.onKextLoadForce(&kextMCCSControl);
-    hwlibs.init();
+    this->kexts.add<LRed, &LRed::processBacklight>(&kextBacklight, "backlight", this);
+    this->kexts.add<LRed, &LRed::processMCCSControl>(&kextMCCSControl, "mccs", this);
+    // Without the `Drivers` personalities the accelerator never loads, nothing of it needs patching
+    if (this->fbOnly) {
+        DBGLOG("lred", "Framebuffer only, skipping the accelerator");
+    } else {
+        hwlibs.init();
+        x4000.init();
+    }
     gfxcon.init();
-    x4000.init();
     support.init();
+    pagePatcher.init();
 }
 
 void LRed::processPatcher(KernelPatcher &patcher) {
+    auto span = BootProfile::begin("processPatcher");
     auto *devInfo = DeviceInfo::create();
     if (devInfo) {
         devInfo->processSwitchOff();
@@ -77,31 +122,45 @@ void LRed::processPatcher(KernelPatcher &patcher) {
                 "lred", "videoBuiltin is not AMD");
         }
 
+        // IOKit publishes the renamed devices on its own. Only the VFCT fetch overlaps with that, it reads the table
+        // of the platform expert; the iGPU is waited for before anything else uses it, the others at the end.
+        // Both waits share one deadline
+        uint64_t deadline;
+        clock_interval_to_deadline(PublishDeadlineMs, kMillisecondScale, &deadline);
         WIOKit::renameDevice(this->iGPU, "IGPU");
-        WIOKit::awaitPublishing(this->iGPU);
+        auto externalSize = devInfo->videoExternal.size();
+        auto **external = externalSize ? Buffer::create<IORegistryEntry *>(externalSize) : nullptr;
+        PANIC_COND(externalSize && !external, "lred", "Failed to allocate the external GPU list");
+        size_t externalCount = 0;
         char name[256] = {0};
-        for (size_t i = 0, ii = 0; i < devInfo->videoExternal.size(); i++) {
+        for (size_t i = 0; i < externalSize; i++) {
             auto *device = OSDynamicCast(IOPCIDevice, devInfo->videoExternal[i].video);
             if (device) {
-                snprintf(name, arrsize(name), "GFX%zu", ii++);
+                snprintf(name, arrsize(name), "GFX%zu", externalCount);
                 WIOKit::renameDevice(device, name);
-                WIOKit::awaitPublishing(device);
+                external[externalCount++] = device;
             }
         }
 
-        static uint8_t builtin[] = {0x01};
-        this->iGPU->setProperty("built-in", builtin, arrsize(builtin));
-        this->deviceId = WIOKit::readPCIConfigValue(this->iGPU, WIOKit::kIOPCIConfigDeviceID);
-
-        if (UNLIKELY(this->iGPU->getProperty("ATY,bin_image"))) {
+        auto vbios = this->getVBIOSFromProperty(this->iGPU);
+        if (UNLIKELY(vbios)) {
             DBGLOG("lred", "VBIOS manually overridden");
         } else {
-            if (!this->getVBIOSFromVFCT(this->iGPU)) {
-                SYSLOG("lred", "Failed to get VBIOS from VFCT.");
-                PANIC_COND(!this->getVBIOSFromVRAM(this->iGPU), "lred", "Failed to get VBIOS from VRAM");
-            }
+            vbios = this->getVBIOSFromVFCT(this->iGPU);
+            SYSLOG_COND(!vbios, "lred", "Failed to get VBIOS from VFCT.");
         }
 
+        IORegistryEntry *iGPU = this->iGPU;
+        awaitPublishingAll(&iGPU, 1, deadline);
+        BootProfile::attach(this->iGPU);
+        static uint8_t builtin[] = {0x01};
+        this->iGPU->setProperty("built-in", builtin, arrsize(builtin));
+        this->deviceId = WIOKit::readPCIConfigValue(this->iGPU, WIOKit::kIOPCIConfigDeviceID);
+        PANIC_COND(!vbios && !this->getVBIOSFromVRAM(this->iGPU), "lred", "Failed to get VBIOS from VRAM");
+
+        awaitPublishingAll(external, externalCount, deadline);
+        if (external) { Buffer::deleter(external); }
+        PagePatcher::callback->publishState();
         DeviceInfo::deleter(devInfo);
     } else {
         SYSLOG("lred", "Failed to create DeviceInfo");
@@ -114,7 +173,8 @@ void LRed::processPatcher(KernelPatcher &patcher) {
 
     size_t num = arrsize(requests);
     if (lilu.getRunMode() & LiluAPI::RunningNormal) {
-        auto *entry = IORegistryEntry::fromPath("/", gIODTPlane);
+        if (!PagePatcher::callback->needsPageHook()) { num -= 1; }
+        auto *entry = this->fbOnly ? nullptr : IORegistryEntry::fromPath("/", gIODTPlane);
         if (entry) {
             DBGLOG("lred", "Setting hwgva-id to iMacPro1,1");
             entry->setProperty("hwgva-id", const_cast<char *>("Mac-7BA5B2D9E42DDD94"),
@@ -126,209 +186,67 @@ void LRed::processPatcher(KernelPatcher &patcher) {
     }
     PANIC_COND(!patcher.routeMultipleLong(KernelPatcher::KernelID, requests, num), "lred",
         "Failed to route kernel symbols");
+    BootProfile::end(span);
+    BootProfile::publish();
 }
 
 OSMetaClassBase *LRed::wrapSafeMetaCast(const OSMetaClassBase *anObject, const OSMetaClass *toMeta) {
     auto ret = FunctionCast(wrapSafeMetaCast, callback->orgSafeMetaCast)(anObject, toMeta);
-    if (!ret) {
-        for (const auto &ent : callback->metaClassMap) {
-            if (ent[0] == toMeta) {
-                return FunctionCast(wrapSafeMetaCast, callback->orgSafeMetaCast)(anObject, ent[1]);
-            } else if (UNLIKELY(ent[1] == toMeta)) {
-                return FunctionCast(wrapSafeMetaCast, callback->orgSafeMetaCast)(anObject, ent[0]);
-            }
-        }
-    }
-    return ret;
+    if (LIKELY(ret) || LIKELY(!callback->metaClassAliases.size())) { return ret; }
+
+    auto *alias = callback->metaClassAliases.lookup(toMeta);
+    return alias ? FunctionCast(wrapSafeMetaCast, callback->orgSafeMetaCast)(anObject, alias) : nullptr;
 }
 
 void LRed::csValidatePage(vnode *vp, memory_object_t pager, memory_object_offset_t page_offset, const void *data,
     int *validated_p, int *tainted_p, int *nx_p) {
+    if (PagePatcher::callback->isComplete()) {
+        return FunctionCast(csValidatePage, callback->orgCsValidatePage)(vp, pager, page_offset, data, validated_p,
+            tainted_p, nx_p);
+    }
+
     FunctionCast(csValidatePage, callback->orgCsValidatePage)(vp, pager, page_offset, data, validated_p, tainted_p,
         nx_p);
+    PagePatcher::callback->processPage(vp, page_offset, const_cast<void *>(data));
+}
 
-    char path[PATH_MAX];
-    int pathlen = PATH_MAX;
-    if (!vn_getpath(vp, path, &pathlen)) {
-        if (UserPatcher::matchSharedCachePath(path)) {
-            if (UNLIKELY(
-                    KernelPatcher::findAndReplace(const_cast<void *>(data), PAGE_SIZE, kVideoToolboxDRMModelOriginal,
-                        arrsize(kVideoToolboxDRMModelOriginal), BaseDeviceInfo::get().modelIdentifier, 20)))
-                DBGLOG("lred", "Relaxed VideoToolbox DRM model check");
-
-            if (UNLIKELY(KernelPatcher::findAndReplace(const_cast<void *>(data), PAGE_SIZE, kBoardIdOriginal,
-                    arrsize(kBoardIdOriginal), kBoardIdPatched, arrsize(kBoardIdPatched))))
-                DBGLOG("lred", "Patched 'board-id' -> 'hwgva-id'");
-        } else if (UNLIKELY(!strncmp(path, kCoreLSKDMSEPath, arrsize(kCoreLSKDMSEPath))) ||
-                   UNLIKELY(!strncmp(path, kCoreLSKDPath, arrsize(kCoreLSKDPath)))) {
-            if (UNLIKELY(KernelPatcher::findAndReplace(const_cast<void *>(data), PAGE_SIZE, kCoreLSKDOriginal,
-                    arrsize(kCoreLSKDOriginal), kCoreLSKDPatched, arrsize(kCoreLSKDPatched))))
-                DBGLOG("lred", "Patched streaming CPUID to Haswell");
+void LRed::reportGoldenSettings() {
+    if (this->goldenDiff && this->golden.count()) {
+        auto differ = this->golden.report(this->regs, this->iGPU);
+        if (differ && checkKernelArgument("-lredgoldenapply")) {
+            this->golden.apply(this->regs);
+            differ = this->golden.report(this->regs, this->iGPU);
+            SYSLOG_COND(differ, "lred", "%zu golden registers still differ after applying them", differ);
         }
     }
+    // Last register programming done during boot
+    this->regs.recorder().publish(this->iGPU);
 }
 
 void LRed::setRMMIOIfNecessary() {
     if (UNLIKELY(!this->rmmio || !this->rmmio->getLength())) {
+        ProfileSpan span {"setRMMIOIfNecessary"};
         this->rmmio = this->iGPU->mapDeviceMemoryWithRegister(kIOPCIConfigBaseAddress5);
         PANIC_COND(!this->rmmio || !this->rmmio->getLength(), "lred", "Failed to map RMMIO");
-        this->rmmioPtr = reinterpret_cast<uint32_t *>(this->rmmio->getVirtualAddress());
-
-        this->fbOffset = static_cast<uint64_t>(this->readReg32(0x296B)) << 24;
-        this->revision = (this->readReg32(0xD2F) & 0xF000000) >> 0x18;
-        switch (this->deviceId) {
-                // Who thought it would be a good idea to use this many Device IDs and Revisions?
-            case 0x1309:
-                [[fallthrough]];
-            case 0x130A:
-                [[fallthrough]];
-            case 0x130B:
-                [[fallthrough]];
-            case 0x130C:
-                [[fallthrough]];
-            case 0x130D:
-                [[fallthrough]];
-            case 0x130E:
-                [[fallthrough]];
-            case 0x130F:
-                [[fallthrough]];
-            case 0x1313:
-                [[fallthrough]];
-            case 0x1315:
-                [[fallthrough]];
-            case 0x1316:
-                [[fallthrough]];
-            case 0x1318:
-                [[fallthrough]];
-            case 0x131B:
-                [[fallthrough]];
-            case 0x131C:
-                [[fallthrough]];
-            case 0x131D:
-                if (this->deviceId == 0x1312 || this->deviceId == 0x1316 || this->deviceId == 0x1317) {
-                    this->chipType = ChipType::Spooky;
-                    this->chipVariant = ChipVariant::Kaveri;
-                    DBGLOG("lred", "Chip type is Spooky, Chip variant is Kaveri");
-                    this->enumeratedRevision = 0x41;
-                    break;
-                }
-                this->chipType = ChipType::Spectre;
-                this->chipVariant = ChipVariant::Kaveri;
-                DBGLOG("lred", "Chip type is Spectre, Chip variant is Kaveri");
-                this->enumeratedRevision = 0x1;
-                break;
-            case 0x9830:
-                [[fallthrough]];
-            case 0x9831:
-                [[fallthrough]];
-            case 0x9832:
-                [[fallthrough]];
-            case 0x9833:
-                [[fallthrough]];
-            case 0x9834:
-                [[fallthrough]];
-            case 0x9835:
-                [[fallthrough]];
-            case 0x9836:
-                [[fallthrough]];
-            case 0x9837:
-                [[fallthrough]];
-            case 0x9838:
-                [[fallthrough]];
-            case 0x9839:
-                [[fallthrough]];
-            case 0x983D:
-                if (this->revision == 0x00) {
-                    this->chipType = ChipType::Kalindi;
-                    this->chipVariant = ChipVariant::Kabini;
-                    DBGLOG("lred", "Chip type is Kalindi, Chip variant is Kabini");
-                    this->enumeratedRevision = 0x81;
-                    break;
-                } else if (this->revision == 0x01) {
-                    this->chipType = ChipType::Kalindi;
-                    this->chipVariant = ChipVariant::Kabini;
-                    DBGLOG("lred", "Chip type is Kalindi, Chip variant is Kabini");
-                    this->enumeratedRevision = 0x82;
-                    break;
-                } else if (this->revision == 0x02) {
-                    this->chipType = ChipType::Kalindi;
-                    this->chipVariant = ChipVariant::Bhavani;
-                    DBGLOG("lred", "Chip type is Kabini, Chip variant is Bhavani");
-                    this->enumeratedRevision = 0x85;
-                    break;
-                }
-                break;
-            case 0x9850:
-                this->chipType = ChipType::Godavari;
-                this->chipVariant = ChipVariant::Mullins;
-                this->enumeratedRevision = 0xA1;
-                DBGLOG("lred", "Chip type is Godavari, Chip variant is Mullins");
-                break;
-            case 0x9851:
-                this->chipType = ChipType::Godavari;
-                this->chipVariant = ChipVariant::Mullins;
-                this->enumeratedRevision = 0xA1;
-                DBGLOG("lred", "Chip type is Godavari, Chip variant is Mullins");
-                break;
-            case 0x9852:
-                this->chipType = ChipType::Godavari;
-                this->chipVariant = ChipVariant::Mullins;
-                this->enumeratedRevision = 0xA1;
-                DBGLOG("lred", "Chip type is Godavari, Chip variant is Mullins");
-                break;
-            case 0x9853:
-                this->chipType = ChipType::Godavari;
-                this->chipVariant = ChipVariant::Mullins;
-                this->enumeratedRevision = 0xA1;
-                DBGLOG("lred", "Chip type is Godavari, Chip variant is Mullins");
-                break;
-            case 0x9854:
-                this->chipType = ChipType::Godavari;
-                this->chipVariant = ChipVariant::Mullins;
-                this->enumeratedRevision = 0xA1;
-                DBGLOG("lred", "Chip type is Godavari, Chip variant is Mullins");
-                break;
-            case 0x9855:
-                this->chipType = ChipType::Godavari;
-                this->chipVariant = ChipVariant::Mullins;
-                this->enumeratedRevision = 0xA1;
-                DBGLOG("lred", "Chip type is Godavari, Chip variant is Mullins");
-                break;
-            case 0x9856:
-                this->chipType = ChipType::Godavari;
-                this->chipVariant = ChipVariant::Mullins;
-                this->enumeratedRevision = 0xA1;
-                DBGLOG("lred", "Chip type is Godavari, Chip variant is Mullins");
-                break;
-            case 0x9874:
-                this->chipType = ChipType::Carrizo;
-                DBGLOG("lred", "Chip type is Carrizo");
-                this->isGCN3 = true;
-                this->enumeratedRevision = 0x1;
-                if ((this->revision >= 0xC8 && this->revision <= 0xCE) ||
-                    (this->revision >= 0xE1 && this->revision <= 0xE6)) {
-                    this->chipVariant = ChipVariant::Bristol;
-                    DBGLOG("lred", "Chip variant is Bristol");
-                }
-                break;
-            case 0x98E4:
-                this->chipType = ChipType::Stoney;
-                this->isGCN3 = true;
-                this->enumeratedRevision = 0x61;
-                DBGLOG("lred", "Chip type is Stoney");
-                /** R4 and up iGPUs have 3 compute units while the others have 2 CUs, hence the chip variations */
-                if (this->revision <= 0x81 || (this->revision >= 0xC0 && this->revision < 0xD0) ||
-                    (this->revision >= 0xD9 && this->revision < 0xDB) || this->revision >= 0xE9) {
-                    this->chipVariant = ChipVariant::s3CU;
-                    DBGLOG("lred", "Chip variant is Stoney 3CU");
-                    break;
-                } else {
-                    this->chipVariant = ChipVariant::s2CU;
-                    DBGLOG("lred", "Chip variant is Stoney 2CU");
-                    break;
-                }
-            default:
-                PANIC("lred", "Unknown device ID: %x", deviceId);
+        auto *mmio = reinterpret_cast<volatile uint32_t *>(this->rmmio->getVirtualAddress());
+        PANIC_COND(!this->regs.init(mmio, this->rmmio->getLength()), "lred", "Failed to set up register access");
+        this->regs.shadow(shadowedRegisters);
+        BootProfile::addCounter("RegReadsForwarded", this->regs.forwardedReads());
+
+        this->fbOffset = static_cast<uint64_t>(this->readReg32(mmFB_OFFSET)) << 24;
+        this->revision = (this->readReg32(mmREVISION) & 0xF000000) >> 0x18;
+        auto *device = findDevice(this->deviceId);
+        PANIC_COND(!device, "lred", "Unknown device ID: %x", this->deviceId);
+        auto *chip = device->chip(this->revision);
+        if (chip) {
+            this->chipType = chip->type;
+            this->chipVariant = chip->variant;
+            this->enumeratedRevision = chip->enumeratedRevision;
+            this->isGCN3 = chip->type >= ChipType::Carrizo;
+            DBGLOG("lred", "Chip type is %u, chip variant is %u, enumerated revision is 0x%X",
+                static_cast<uint32_t>(chip->type), static_cast<uint32_t>(chip->variant), chip->enumeratedRevision);
+        } else {
+            SYSLOG("lred", "Revision 0x%X of device %x is not supported", this->revision, this->deviceId);
         }
         DBGLOG_COND(this->isGCN3, "lred", "iGPU is GCN 3 derivative");
         int PGOff = 1;
@@ -342,37 +260,30 @@ void LRed::setRMMIOIfNecessary() {
             this->iGPU->setProperty("CAIL_DisableSAMUPowerGating", PGOff, 0);
             if (this->chipType > ChipType::Spectre) { this->iGPU->setProperty("CAIL_DisableVCEPowerGating", PGOff, 0); }
         };
+        this->regs.recorder().publish(this->iGPU);
     }
 }
 
-void LRed::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size) {
-    if (kextBacklight.loadIndex == index) {
-        KernelPatcher::RouteRequest request {"__ZN15AppleIntelPanel10setDisplayEP9IODisplay", wrapApplePanelSetDisplay,
-            orgApplePanelSetDisplay};
-        if (patcher.routeMultiple(kextBacklight.loadIndex, &request, 1, address, size)) {
-            const uint8_t find[] = {"F%uT%04x"};
-            const uint8_t replace[] = {"F%uTxxxx"};
-            KernelPatcher::LookupPatch patch = {&kextBacklight, find, replace, sizeof(find), 1};
-            DBGLOG("lred", "applying backlight patch");
-            patcher.applyLookupPatch(&patch);
-        }
-    } else if (kextMCCSControl.loadIndex == index) {
-        KernelPatcher::RouteRequest request[] = {
-            {"__ZN25AppleMCCSControlGibraltar5probeEP9IOServicePi", wrapFunctionReturnZero},
-            {"__ZN21AppleMCCSControlCello5probeEP9IOServicePi", wrapFunctionReturnZero},
-        };
-        patcher.routeMultiple(index, request, address, size);
-    } else if (support.processKext(patcher, index, address, size)) {
-        DBGLOG("lred", "Processed support");
-    } else if (hwlibs.processKext(patcher, index, address, size)) {
-        DBGLOG("lred", "Processed hwlibs");
-    } else if (gfxcon.processKext(patcher, index, address, size)) {
-        DBGLOG("lred", "Processed gfxcon");
-    } else if (x4000.processKext(patcher, index, address, size)) {
-        DBGLOG("lred", "Processed x4000");
+void LRed::processBacklight(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size) {
+    KernelPatcher::RouteRequest request {"__ZN15AppleIntelPanel10setDisplayEP9IODisplay", wrapApplePanelSetDisplay,
+        orgApplePanelSetDisplay};
+    if (patcher.routeMultiple(index, &request, 1, address, size)) {
+        const uint8_t find[] = {"F%uT%04x"};
+        const uint8_t replace[] = {"F%uTxxxx"};
+        KernelPatcher::LookupPatch patch = {&kextBacklight, find, replace, sizeof(find), 1};
+        DBGLOG("lred", "applying backlight patch");
+        patcher.applyLookupPatch(&patch);
     }
 }
 
+void LRed::processMCCSControl(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size) {
+    KernelPatcher::RouteRequest request[] = {
+        {"__ZN25AppleMCCSControlGibraltar5probeEP9IOServicePi", wrapFunctionReturnZero},
+        {"__ZN21AppleMCCSControlCello5probeEP9IOServicePi", wrapFunctionReturnZero},
+    };
+    patcher.routeMultiple(index, request, address, size);
+}
+
 struct ApplePanelData {
     const char *deviceName;
     uint8_t deviceData[36];
@@ -4,7 +4,12 @@
 #ifndef kern_lred_hpp
 #define kern_lred_hpp
 #include "kern_amd.hpp"
+#include "kern_bootprofile.hpp"
 #include "kern_fw.hpp"
+#include "kern_golden.hpp"
+#include "kern_kextdispatch.hpp"
+#include "kern_metaclass.hpp"
+#include "kern_regaccess.hpp"
 #include "kern_vbios.hpp"
 #include <Headers/kern_iokit.hpp>
 #include <IOKit/acpi/IOACPIPlatformExpert.h>
@@ -82,9 +87,28 @@ static bool checkAtomBios(const uint8_t *bios, size_t size) {
     return false;
 }
 
+/**
+ * Length of the ROM image, from its PCI data structure or else byte 2 of the header; both count 512-byte blocks.
+ * Only the first `readable` bytes are looked at. Returns 0 if the image would be longer than `limit`.
+ */
+static size_t getAtomBiosSize(const uint8_t *bios, size_t readable, size_t limit) {
+    if (readable < 0x1A) { return 0; }
+    size_t length = static_cast<size_t>(bios[2]) * 512;
+    size_t pcir = bios[0x18] | (bios[0x19] << 8);
+    if (pcir && pcir + 0x12 <= readable && !memcmp(bios + pcir, "PCIR", 4)) {
+        size_t blocks = bios[pcir + 0x10] | (bios[pcir + 0x11] << 8);
+        if (blocks) { length = blocks * 512; }
+    }
+    return length <= limit ? length : 0;
+}
+
+// Covers the ROM header and the PCI data structure, the rest is mapped once the size is known
+static constexpr size_t VBIOSHeaderWindow = 0x1000;
+
 class LRed {
     friend class GFXCon;
     friend class HWLibs;
+    friend class PagePatcher;
     friend class X4000;
     friend class Support;
 
@@ -93,8 +117,24 @@ class LRed {
 
     void init();
     void processPatcher(KernelPatcher &patcher);
-    void processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size);
+    void processBacklight(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size);
+    void processMCCSControl(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size);
     void setRMMIOIfNecessary();
+    void reportGoldenSettings();
+    /** `-lredfbonly`: only the framebuffer is brought up, the accelerator and its patches are left out */
+    bool isFramebufferOnly() const { return this->fbOnly; }
+
+    /** Make `OSDynamicCast` to either metaclass also accept objects of the other one */
+    bool addMetaClassAlias(const OSMetaClass *first, const OSMetaClass *second) {
+        if (!this->metaClassAliases.add(first, second)) {
+            SYSLOG("lred", "Failed to alias metaclasses %s and %s", first ? first->getClassName() : "(null)",
+                second ? second->getClassName() : "(null)");
+            return false;
+        }
+        BootProfile::addCounter(first->getClassName(), this->metaClassAliases.hitCounter(first));
+        BootProfile::addCounter(second->getClassName(), this->metaClassAliases.hitCounter(second));
+        return true;
+    }
 
     private:
     static const char *getChipName() {
@@ -104,6 +144,7 @@ class LRed {
     }
 
     bool getVBIOSFromVFCT(IOPCIDevice *obj) {
+        ProfileSpan span {"getVBIOSFromVFCT"};
         DBGLOG("lred", "Fetching VBIOS from VFCT table");
         auto *expert = reinterpret_cast<AppleACPIPlatformExpert *>(obj->getPlatform());
         PANIC_COND(!expert, "lred", "Failed to get AppleACPIPlatformExpert");
@@ -144,9 +185,15 @@ class LRed {
                     DBGLOG("lred", "VFCT VBIOS is not an ATOMBIOS");
                     return false;
                 }
-                this->vbiosData = OSData::withBytes(vContent, vHdr->imageLength);
-                PANIC_COND(!this->vbiosData, "lred", "VFCT OSData::withBytes failed");
-                obj->setProperty("ATY,bin_image", this->vbiosData);
+                // The image may be padded, don't publish more than the ROM
+                auto size = getAtomBiosSize(vContent, vHdr->imageLength, vHdr->imageLength);
+                if (!size) { size = vHdr->imageLength; }
+                // Keep the table around and point into it instead of copying the image out
+                vfctData->retain();
+                this->vfctData = vfctData;
+                auto *vbios = OSData::withBytesNoCopy(const_cast<uint8_t *>(vContent), static_cast<uint32_t>(size));
+                PANIC_COND(!vbios, "lred", "VFCT OSData::withBytesNoCopy failed");
+                this->setVBIOS(obj, vbios);
                 return true;
             }
         }
@@ -155,44 +202,94 @@ class LRed {
     }
 
     bool getVBIOSFromVRAM(IOPCIDevice *provider) {
-        auto *bar0 = provider->mapDeviceMemoryWithRegister(kIOPCIConfigBaseAddress0);
-        if (!bar0 || !bar0->getLength()) {
-            DBGLOG("lred", "FB BAR not enabled");
-            OSSafeReleaseNULL(bar0);
+        ProfileSpan span {"getVBIOSFromVRAM"};
+        if (this->getVBIOSFromBAR(provider, kIOPCIConfigBaseAddress0)) { return true; }
+        DBGLOG("lred", "Falling back to the expansion ROM BAR");
+        return this->getVBIOSFromROMBAR(provider);
+    }
+
+    /** Only maps as much of the BAR as the ROM takes; on UMA parts BAR 0 covers the whole carve-out */
+    bool getVBIOSFromBAR(IOPCIDevice *provider, uint8_t reg) {
+        auto *memory = provider->getDeviceMemoryWithRegister(reg);
+        if (!memory || !memory->getLength()) {
+            DBGLOG("lred", "BAR 0x%X not enabled", reg);
             return false;
         }
-        auto *fb = reinterpret_cast<const uint8_t *>(bar0->getVirtualAddress());
-        uint32_t size = 256 * 1024;    // ???
-        if (!checkAtomBios(fb, size)) {
-            DBGLOG("lred", "VRAM VBIOS is not an ATOMBIOS");
-            OSSafeReleaseNULL(bar0);
+        auto limit = static_cast<size_t>(memory->getLength());
+        auto *map = this->mapVBIOSWindow(memory, VBIOSHeaderWindow);
+        if (!map) { return false; }
+        auto *rom = reinterpret_cast<const uint8_t *>(map->getVirtualAddress());
+        auto size = getAtomBiosSize(rom, static_cast<size_t>(map->getLength()), limit);
+        if (size > map->getLength()) {
+            this->unmapVBIOSWindow(map);
+            map = this->mapVBIOSWindow(memory, size);
+            if (!map) { return false; }
+            rom = reinterpret_cast<const uint8_t *>(map->getVirtualAddress());
+        }
+        if (!size || !checkAtomBios(rom, size)) {
+            DBGLOG("lred", "BAR 0x%X VBIOS is not an ATOMBIOS", reg);
+            this->unmapVBIOSWindow(map);
             return false;
         }
-        this->vbiosData = OSData::withBytes(fb, size);
-        PANIC_COND(!this->vbiosData, "lred", "VRAM OSData::withBytes failed");
-        provider->setProperty("ATY,bin_image", this->vbiosData);
-        OSSafeReleaseNULL(bar0);
+        // The mapping goes away, this one has to be a copy
+        auto *vbios = OSData::withBytes(rom, static_cast<uint32_t>(size));
+        this->unmapVBIOSWindow(map);
+        PANIC_COND(!vbios, "lred", "VRAM OSData::withBytes failed");
+        this->setVBIOS(provider, vbios);
         return true;
     }
 
-    uint32_t readReg32(uint32_t reg) {
-        if (reg * 4 < this->rmmio->getLength()) {
-            return this->rmmioPtr[reg];
-        } else {
-            this->rmmioPtr[mmPCIE_INDEX2] = reg;
-            return this->rmmioPtr[mmPCIE_DATA2];
+    bool getVBIOSFromROMBAR(IOPCIDevice *provider) {
+        auto romBar = provider->configRead32(kIOPCIConfigExpansionROMBase);
+        if (!(romBar & ~0x7FFU)) {
+            DBGLOG("lred", "No expansion ROM BAR");
+            return false;
         }
+        // The ROM only decodes while enabled, put it back the way it was after
+        provider->configWrite32(kIOPCIConfigExpansionROMBase, romBar | 1);
+        auto ret = this->getVBIOSFromBAR(provider, kIOPCIConfigExpansionROMBase);
+        provider->configWrite32(kIOPCIConfigExpansionROMBase, romBar);
+        return ret;
     }
 
-    void writeReg32(uint32_t reg, uint32_t val) {
-        if (reg * 4 < this->rmmio->getLength()) {
-            this->rmmioPtr[reg] = val;
-        } else {
-            this->rmmioPtr[mmPCIE_INDEX2] = reg;
-            this->rmmioPtr[mmPCIE_DATA2] = val;
+    IOMemoryMap *mapVBIOSWindow(IOMemoryDescriptor *memory, size_t length) {
+        ProfileSpan span {"mapVBIOSWindow"};
+        if (length > memory->getLength()) { length = static_cast<size_t>(memory->getLength()); }
+        auto *map = memory->createMappingInTask(kernel_task, 0, kIOMapAnywhere | kIOMapReadOnly, 0, length);
+        if (!map || !map->getLength()) {
+            DBGLOG("lred", "Failed to map 0x%zX bytes of the VBIOS BAR", length);
+            OSSafeReleaseNULL(map);
+            return nullptr;
         }
+        this->vbiosMapped += map->getLength();
+        BootProfile::addCounter("VBIOSMappedBytes", &this->vbiosMapped);
+        return map;
+    }
+
+    void unmapVBIOSWindow(IOMemoryMap *&map) {
+        ProfileSpan span {"unmapVBIOSWindow"};
+        OSSafeReleaseNULL(map);
+    }
+
+    /** Overridden through the device properties, use it as is */
+    bool getVBIOSFromProperty(IOPCIDevice *obj) {
+        auto *vbios = OSDynamicCast(OSData, obj->getProperty("ATY,bin_image"));
+        if (!vbios) { return false; }
+        vbios->retain();
+        this->vbiosData = vbios;
+        return true;
     }
 
+    /** The only copy of the VBIOS, shared with `ATY,bin_image`; takes over the reference */
+    void setVBIOS(IOPCIDevice *obj, OSData *vbios) {
+        PANIC_COND(this->vbiosData, "lred", "VBIOS set twice");
+        this->vbiosData = vbios;
+        obj->setProperty("ATY,bin_image", vbios);
+    }
+
+    uint32_t readReg32(uint32_t reg) { return this->regs.read(reg); }
+    void writeReg32(uint32_t reg, uint32_t val) { this->regs.write(reg, val); }
+
     template<typename T>
     T *getVBIOSDataTable(uint32_t index) {
         auto *vbios = static_cast<const uint8_t *>(this->vbiosData->getBytesNoCopy());
@@ -210,18 +307,27 @@ class LRed {
     }
 
     OSData *vbiosData {nullptr};
+    /** Backs `vbiosData` when it came from the VFCT */
+    const OSData *vfctData {nullptr};
+    /** Bytes of VRAM BARs mapped to find the VBIOS */
+    uint64_t vbiosMapped {0};
     ChipType chipType = ChipType::Unknown;
     ChipVariant chipVariant = ChipVariant::Unknown;
     bool isGCN3 = false;
     uint64_t fbOffset {0};
     IOMemoryMap *rmmio {nullptr};
-    volatile uint32_t *rmmioPtr {nullptr};
+    RegisterAccess regs;
+    GoldenSettings golden;
     uint32_t deviceId {0};
     uint16_t enumeratedRevision {0};
     uint16_t revision {0};
     IOPCIDevice *iGPU {nullptr};
+    bool fbOnly {false};
+    /** `-lredgoldendiff`, compare the golden settings with the registers once the accelerator started */
+    bool goldenDiff {false};
 
-    OSMetaClass *metaClassMap[4][2] = {{nullptr}};
+    MetaClassAliasTable metaClassAliases;
+    KextDispatcher kexts;
 
     mach_vm_address_t orgSafeMetaCast {0};
     static OSMetaClassBase *wrapSafeMetaCast(const OSMetaClassBase *anObject, const OSMetaClass *toMeta);
@@ -0,0 +1,100 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+#include "kern_machimage.hpp"
+#include <mach-o/loader.h>
+
+static MachImage machImage;
+
+static const struct {
+    const char *segment;
+    size_t segmentLength;
+    const char *section;
+} sectionNames[] = {
+    {"__TEXT", 6, "__text"},    // Also matches `__TEXT_EXEC` in kernel collections
+    {"__TEXT", 7, "__const"},
+    {"__TEXT", 7, "__cstring"},
+    {"__DATA", 6, "__const"},    // `__DATA_CONST` or `__DATA`
+    {"__DATA", 7, "__data"},
+};
+static_assert(arrsize(sectionNames) == static_cast<size_t>(KextSection::Whole));
+
+MachImage *MachImage::forKext(mach_vm_address_t address, size_t size) {
+    if (machImage.address != address || machImage.size != size) {
+        machImage = {};
+        machImage.address = address;
+        machImage.size = size;
+        machImage.parse();
+    }
+    return &machImage;
+}
+
+void MachImage::parse() {
+    if (!this->contains(this->address, sizeof(mach_header_64))) { return; }
+    auto *header = reinterpret_cast<const mach_header_64 *>(this->address);
+    if (header->magic != MH_MAGIC_64 || !this->contains(this->address + sizeof(*header), header->sizeofcmds)) {
+        DBGLOG("machimage", "No Mach-O header at 0x%llX", this->address);
+        return;
+    }
+
+    const segment_command_64 *text = nullptr;
+    auto *cmd = reinterpret_cast<const load_command *>(header + 1);
+    auto *end = reinterpret_cast<const uint8_t *>(cmd) + header->sizeofcmds;
+    for (uint32_t i = 0; i < header->ncmds && reinterpret_cast<const uint8_t *>(cmd) + sizeof(*cmd) <= end; i++) {
+        if (cmd->cmd == LC_SYMTAB) {
+            this->symtab = reinterpret_cast<const symtab_command *>(cmd);
+        } else if (cmd->cmd == LC_UUID) {
+            this->uuid = reinterpret_cast<const uuid_command *>(cmd)->uuid;
+        } else if (cmd->cmd == LC_SEGMENT_64) {
+            auto *segment = reinterpret_cast<const segment_command_64 *>(cmd);
+            if (!strncmp(segment->segname, "__TEXT", sizeof(segment->segname))) {
+                text = segment;
+            } else if (!strncmp(segment->segname, "__LINKEDIT", sizeof(segment->segname))) {
+                this->linkedit = segment;
+            }
+        }
+        if (!cmd->cmdsize) { break; }
+        cmd = reinterpret_cast<const load_command *>(reinterpret_cast<const uint8_t *>(cmd) + cmd->cmdsize);
+    }
+    if (!text) {
+        DBGLOG("machimage", "No __TEXT segment at 0x%llX", this->address);
+        return;
+    }
+    this->slide = this->address - text->vmaddr;
+
+    // Sections are only looked at after the slide is known
+    cmd = reinterpret_cast<const load_command *>(header + 1);
+    for (uint32_t i = 0; i < header->ncmds && reinterpret_cast<const uint8_t *>(cmd) + sizeof(*cmd) <= end; i++) {
+        if (cmd->cmd == LC_SEGMENT_64) {
+            auto *segment = reinterpret_cast<const segment_command_64 *>(cmd);
+            auto *sections = reinterpret_cast<const section_64 *>(segment + 1);
+            for (uint32_t s = 0; s < segment->nsects; s++) {
+                auto &section = sections[s];
+                auto start = section.addr + this->slide;
+                if (!this->contains(start, section.size)) { continue; }
+                for (size_t n = 0; n < arrsize(sectionNames); n++) {
+                    auto &names = sectionNames[n];
+                    if (this->sections[n].size || strncmp(section.segname, names.segment, names.segmentLength) ||
+                        strncmp(section.sectname, names.section, sizeof(section.sectname))) {
+                        continue;
+                    }
+                    this->sections[n] = {start, static_cast<size_t>(section.size)};
+                }
+            }
+        }
+        if (!cmd->cmdsize) { break; }
+        cmd = reinterpret_cast<const load_command *>(reinterpret_cast<const uint8_t *>(cmd) + cmd->cmdsize);
+    }
+}
+
+void MachImage::range(KextSection section, mach_vm_address_t &start, size_t &length) const {
+    auto index = static_cast<size_t>(section);
+    if (section != KextSection::Whole && this->sections[index].size) {
+        start = this->sections[index].start;
+        length = this->sections[index].size;
+        return;
+    }
+    DBGLOG_COND(section != KextSection::Whole, "machimage", "Section %zu not found, using the whole image", index);
+    start = this->address;
+    length = this->size;
+}
@@ -0,0 +1,62 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+#ifndef kern_machimage_hpp
+#define kern_machimage_hpp
+#include <Headers/kern_util.hpp>
+
+struct mach_header_64;
+struct segment_command_64;
+struct symtab_command;
+
+/** Where a pattern can match, so that a scan doesn't walk the rest of the kext */
+enum struct KextSection : uint8_t {
+    Text = 0,
+    TextConst,
+    TextCstring,
+    DataConst,
+    Data,
+    Whole,
+};
+
+/**
+ * Load commands of the kext being processed, parsed once per kext.
+ * Only what lies within the image handed to the load callback is used, as that is known to be mapped.
+ */
+class MachImage {
+    struct Range {
+        mach_vm_address_t start;
+        size_t size;
+    };
+
+    mach_vm_address_t address {0};
+    size_t size {0};
+    uint64_t slide {0};
+    const symtab_command *symtab {nullptr};
+    const segment_command_64 *linkedit {nullptr};
+    const uint8_t *uuid {nullptr};
+    Range sections[static_cast<size_t>(KextSection::Whole)] {};
+
+    void parse();
+
+    public:
+    /** Image of the kext at `address`, parsed again whenever a different kext comes in */
+    static MachImage *forKext(mach_vm_address_t address, size_t size);
+
+    bool contains(uint64_t start, uint64_t length) const {
+        return start >= this->address && length <= this->size && start - this->address <= this->size - length;
+    }
+
+    /** Range of `section`, or the whole image when the section isn't known */
+    void range(KextSection section, mach_vm_address_t &start, size_t &length) const;
+
+    mach_vm_address_t getAddress() const { return this->address; }
+    size_t getSize() const { return this->size; }
+    uint64_t getSlide() const { return this->slide; }
+    const symtab_command *getSymtab() const { return this->symtab; }
+    const segment_command_64 *getLinkedit() const { return this->linkedit; }
+    /** The 16 bytes of `LC_UUID`, if there is one */
+    const uint8_t *getUUID() const { return this->uuid; }
+};
+
+#endif /* kern_machimage_hpp */
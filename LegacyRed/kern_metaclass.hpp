@@ -0,0 +1,104 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+#ifndef kern_metaclass_hpp
+#define kern_metaclass_hpp
+#include <Headers/kern_util.hpp>
+#include <libkern/c++/OSMetaClass.h>
+
+/**
+ * Metaclasses that `safeMetaCast` should treat as interchangeable.
+ * Open-addressed on the metaclass pointer, with a 64-bit filter in front of it so that unrelated casts,
+ * which are nearly all of them, return after testing a single bit.
+ * Registration happens from kext load callbacks, which Lilu serialises; lookups are lock-free.
+ */
+class MetaClassAliasTable {
+    static constexpr size_t SlotCount = 16;
+    static constexpr size_t MaxProbes = 4;
+
+    struct Slot {
+        const OSMetaClass *meta;
+        const OSMetaClass *alias;
+        uint64_t hits;
+    };
+
+    Slot slots[SlotCount] {};
+    uint64_t filter {0};
+    size_t count {0};
+
+    static size_t hash(const OSMetaClass *meta) {
+        auto addr = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(meta));
+        return static_cast<size_t>(((addr >> 4) * 0x9E3779B97F4A7C15ULL) >> 58);
+    }
+
+    /** `added` is only set when `meta` took a free slot, an existing identical entry is left as it is */
+    bool insert(const OSMetaClass *meta, const OSMetaClass *alias, Slot *&added) {
+        added = nullptr;
+        auto h = hash(meta);
+        auto index = h & (SlotCount - 1);
+        for (size_t i = 0; i < MaxProbes; i++, index = (index + 1) & (SlotCount - 1)) {
+            auto &slot = this->slots[index];
+            auto *key = __atomic_load_n(&slot.meta, __ATOMIC_RELAXED);
+            if (key == meta) { return slot.alias == alias; }
+            if (key) { continue; }
+            slot.alias = alias;
+            slot.hits = 0;
+            __atomic_store_n(&slot.meta, meta, __ATOMIC_RELEASE);
+            __atomic_fetch_or(&this->filter, 1ULL << h, __ATOMIC_RELEASE);
+            __atomic_fetch_add(&this->count, 1, __ATOMIC_RELAXED);
+            added = &slot;
+            return true;
+        }
+        return false;
+    }
+
+    public:
+    /** Make casts to either metaclass also try the other one; nothing is added unless both directions fit */
+    bool add(const OSMetaClass *first, const OSMetaClass *second) {
+        if (!first || !second || first == second) { return false; }
+        Slot *firstSlot, *secondSlot;
+        if (!this->insert(first, second, firstSlot)) { return false; }
+        if (this->insert(second, first, secondSlot)) { return true; }
+        // Nothing was inserted after it, so emptying the slot restores every probe sequence.
+        // The filter bit stays, which only costs a probe
+        if (firstSlot) {
+            __atomic_store_n(&firstSlot->meta, nullptr, __ATOMIC_RELEASE);
+            __atomic_fetch_sub(&this->count, 1, __ATOMIC_RELAXED);
+        }
+        return false;
+    }
+
+    const OSMetaClass *lookup(const OSMetaClass *meta) {
+        auto h = hash(meta);
+        if (LIKELY(!(__atomic_load_n(&this->filter, __ATOMIC_RELAXED) & (1ULL << h)))) { return nullptr; }
+
+        auto index = h & (SlotCount - 1);
+        for (size_t i = 0; i < MaxProbes; i++, index = (index + 1) & (SlotCount - 1)) {
+            auto &slot = this->slots[index];
+            auto *key = __atomic_load_n(&slot.meta, __ATOMIC_ACQUIRE);
+            if (!key) { return nullptr; }
+            if (key == meta) {
+                __atomic_fetch_add(&slot.hits, 1, __ATOMIC_RELAXED);
+                return slot.alias;
+            }
+        }
+        return nullptr;
+    }
+
+    size_t size() const { return __atomic_load_n(&this->count, __ATOMIC_RELAXED); }
+
+    /** How often casts to `meta` were retried with its alias, null when it has none */
+    const uint64_t *hitCounter(const OSMetaClass *meta) const {
+        for (auto &slot : this->slots) {
+            if (__atomic_load_n(&slot.meta, __ATOMIC_ACQUIRE) == meta) { return &slot.hits; }
+        }
+        return nullptr;
+    }
+
+    uint64_t hits(const OSMetaClass *meta) const {
+        auto *counter = this->hitCounter(meta);
+        return counter ? __atomic_load_n(counter, __ATOMIC_RELAXED) : 0;
+    }
+};
+
+#endif /* kern_metaclass_hpp */
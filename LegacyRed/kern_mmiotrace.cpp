@@ -0,0 +1,51 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+#include "kern_mmiotrace.hpp"
+#include <libkern/c++/OSData.h>
+#include <libkern/c++/OSDictionary.h>
+#include <libkern/c++/OSNumber.h>
+
+bool MMIORecorder::enable(size_t capacity) {
+    if (this->records) { return true; }
+    auto *records = Buffer::create<MMIORecord>(capacity);
+    if (!records) {
+        SYSLOG("mmiotrace", "Failed to allocate %zu records", capacity);
+        return false;
+    }
+    memset(records, 0, capacity * sizeof(MMIORecord));
+    this->capacity = capacity;
+    // Publish the buffer last, `record` only looks at the pointer
+    __atomic_store_n(&this->records, records, __ATOMIC_RELEASE);
+    return true;
+}
+
+static bool setNumber(OSDictionary *dict, const char *key, uint64_t value) {
+    auto *number = OSNumber::withNumber(value, 64);
+    if (!number) { return false; }
+    auto ret = dict->setObject(key, number);
+    number->release();
+    return ret;
+}
+
+void MMIORecorder::publish(IORegistryEntry *entry) const {
+    if (!this->records || !entry) { return; }
+
+    auto count = __atomic_load_n(&this->claimed, __ATOMIC_RELAXED);
+    if (count > this->capacity) { count = this->capacity; }
+    // Copy the records as they are; the decoder stops at the first one still pending
+    auto *trace = OSDictionary::withCapacity(3);
+    auto *data = OSData::withBytes(this->records, static_cast<unsigned int>(count * sizeof(MMIORecord)));
+    if (!trace || !data) {
+        SYSLOG("mmiotrace", "Failed to allocate the MMIO trace");
+        OSSafeReleaseNULL(trace);
+        OSSafeReleaseNULL(data);
+        return;
+    }
+    trace->setObject("Records", data);
+    data->release();
+    setNumber(trace, "Capacity", this->capacity);
+    setNumber(trace, "Dropped", __atomic_load_n(&this->dropped, __ATOMIC_RELAXED));
+    entry->setProperty("LRedMMIOTrace", trace);
+    trace->release();
+}
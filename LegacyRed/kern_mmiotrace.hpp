@@ -0,0 +1,76 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+#ifndef kern_mmiotrace_hpp
+#define kern_mmiotrace_hpp
+#include <Headers/kern_util.hpp>
+#include <IOKit/IORegistryEntry.h>
+
+enum struct MMIOAccess : uint8_t {
+    /** Slot claimed, record not written yet */
+    Pending = 0,
+    Read,
+    Write,
+};
+
+/** Who made the access */
+enum struct MMIOSource : uint8_t {
+    /** `RegisterAccess` */
+    LRed = 0,
+    /** The CAIL `hwReadReg`/`hwWriteReg` entry points of the AMD controller kexts */
+    Controller,
+};
+
+/** Published as is in `Records`, keep in sync with Scripts/MMIOTrace.py */
+struct MMIORecord {
+    uint32_t reg;
+    uint32_t value;
+    MMIOAccess access;
+    /** Went through `mmPCIE_INDEX2`/`mmPCIE_DATA2`; not known for the controller, which picks the path itself */
+    bool indirect;
+    /** In bits, narrower accesses only use the low bits of `value` */
+    uint8_t width;
+    MMIOSource source;
+};
+static_assert(sizeof(MMIORecord) == 12, "MMIORecord layout changed");
+
+/**
+ * Records every register access that reaches the hardware, in order, from the first one on; both ours and those of
+ * the controller kexts, which share the order.
+ * Once full, further accesses are only counted; a trace that got cut short can't be replayed past that point.
+ * Enabled with `-lredmmiorec`, published as `LRedMMIOTrace` on the iGPU.
+ */
+class MMIORecorder {
+    public:
+    static constexpr size_t DefaultCapacity = 8192;
+
+    bool enable(size_t capacity);
+    bool enabled() const { return this->records; }
+
+    void record(MMIOAccess access, uint32_t reg, uint32_t value, bool indirect, uint8_t width = 32,
+        MMIOSource source = MMIOSource::LRed) {
+        if (LIKELY(!this->records)) { return; }
+        auto index = __atomic_fetch_add(&this->claimed, 1, __ATOMIC_RELAXED);
+        if (index >= this->capacity) {
+            __atomic_fetch_add(&this->dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        auto &entry = this->records[index];
+        entry.reg = reg;
+        entry.value = value;
+        entry.indirect = indirect;
+        entry.width = width;
+        entry.source = source;
+        __atomic_store_n(&entry.access, access, __ATOMIC_RELEASE);
+    }
+
+    void publish(IORegistryEntry *entry) const;
+
+    private:
+    MMIORecord *records {nullptr};
+    size_t capacity {0};
+    size_t claimed {0};
+    uint64_t dropped {0};
+};
+
+#endif /* kern_mmiotrace_hpp */
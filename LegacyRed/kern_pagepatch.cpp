@@ -0,0 +1,182 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+#include "kern_pagepatch.hpp"
+#include "kern_lred.hpp"
+#include <Headers/kern_api.hpp>
+#include <Headers/kern_devinfo.hpp>
+#include <sys/vnode.h>
+
+PagePatcher *PagePatcher::callback = nullptr;
+
+void PagePatcher::init() {
+    callback = this;
+    // Pages validated again once all budgets are met stay unpatched, so stopping the scan is opt-in
+    this->scanner.setUseBudget(checkKernelArgument("-lredpagebudget"));
+    PANIC_COND(!this->scanner.init(), "pagepatch", "Failed to allocate split lock");
+    this->publishCall = thread_call_allocate(
+        [](thread_call_param_t param0, thread_call_param_t) { static_cast<PagePatcher *>(param0)->publishState(); },
+        this);
+
+    // Budgets: the model run is a cstring sequence only VideoToolbox carries, and the linker uniques it in the image.
+    // "board-id" followed by "hw.model" is just two common property names, nothing bounds how many images have
+    // it, so it has no budget and, with `-lredpagebudget`, is only patched until the others are met.
+    // `mov eax, 1` encoded as `C7 C0` isn't what compilers emit, it's the single hand-written CPUID site.
+    // Both only matter for hardware video decoding, which needs the accelerator
+    if (!LRed::callback->isFramebufferOnly()) {
+        this->scanner.addNeedle({"VideoToolboxDRM", "Relaxed VideoToolbox DRM model check", PageTarget::SharedCache,
+            reinterpret_cast<const uint8_t *>(kVideoToolboxDRMModelOriginal), arrsize(kVideoToolboxDRMModelOriginal),
+            reinterpret_cast<const uint8_t *>(BaseDeviceInfo::get().modelIdentifier), 20, 1});
+        this->scanner.addNeedle({"BoardId", "Patched 'board-id' -> 'hwgva-id'", PageTarget::SharedCache,
+            kBoardIdOriginal, arrsize(kBoardIdOriginal), kBoardIdPatched, arrsize(kBoardIdPatched), 0});
+    }
+    // Leaves the CoreLSKD images to `UserPatcher`, the page hook keeps them when it's not available
+    if (checkKernelArgument("-lreduserpatch")) { this->userPatcher = this->registerUserPatches(); }
+    if (!this->userPatcher) {
+        this->scanner.addNeedle({"CoreLSKD", "Patched streaming CPUID to Haswell", PageTarget::CoreLSKD,
+            kCoreLSKD.original.find, kCoreLSKD.size, kCoreLSKD.patched.find, kCoreLSKD.size, 1});
+        this->scanner.addNeedle({"CoreLSKDMSE", "Patched streaming CPUID to Haswell", PageTarget::CoreLSKDMSE,
+            kCoreLSKD.original.find, kCoreLSKD.size, kCoreLSKD.patched.find, kCoreLSKD.size, 1});
+    }
+}
+
+/**
+ * Only the CoreLSKD images are handed over: they're files of their own, found by the same paths the page hook
+ * classifies them with. The shared cache needles stay on the page hook, which searches the whole cache, so
+ * `cs_validate_page` stays routed unless they aren't needed either, as in framebuffer-only mode.
+ */
+bool PagePatcher::registerUserPatches() {
+    addUserPatch(kCoreLSKDPath, kCoreLSKD.original.find, kCoreLSKD.patched.find, kCoreLSKD.size,
+        UserPatcher::FileSegment::SegmentTextText);
+    addUserPatch(kCoreLSKDMSEPath, kCoreLSKD.original.find, kCoreLSKD.patched.find, kCoreLSKD.size,
+        UserPatcher::FileSegment::SegmentTextText);
+
+    // FairPlay streaming is only used by Apple's players and WebKit, which plays media out of its XPC services.
+    // The players moved to /System/Applications with Catalina, which also split iTunes into Music and TV
+    static UserPatcher::ProcInfo procInfo[] = {
+        {"/System/Applications/TV.app/Contents/MacOS/TV", 45, 1, UserPatcher::ProcInfo::ProcFlags::MatchExact},
+        {"/System/Applications/Music.app/Contents/MacOS/Music", 51, 1,
+            UserPatcher::ProcInfo::ProcFlags::MatchExact},
+        {"/System/Applications/QuickTime Player.app/Contents/MacOS/QuickTime Player", 73, 1,
+            UserPatcher::ProcInfo::ProcFlags::MatchExact},
+        {"com.apple.WebKit.GPU", 20, 1, UserPatcher::ProcInfo::ProcFlags::MatchSuffix},
+        {"com.apple.WebKit.WebContent", 27, 1, UserPatcher::ProcInfo::ProcFlags::MatchSuffix},
+    };
+    static UserPatcher::ProcInfo procInfoLegacy[] = {
+        {"/Applications/iTunes.app/Contents/MacOS/iTunes", 46, 1, UserPatcher::ProcInfo::ProcFlags::MatchExact},
+        {"/Applications/QuickTime Player.app/Contents/MacOS/QuickTime Player", 66, 1,
+            UserPatcher::ProcInfo::ProcFlags::MatchExact},
+        {"com.apple.WebKit.WebContent", 27, 1, UserPatcher::ProcInfo::ProcFlags::MatchSuffix},
+    };
+    auto catalina = getKernelVersion() >= KernelVersion::Catalina;
+    auto *procs = catalina ? procInfo : procInfoLegacy;
+    auto procCount = catalina ? arrsize(procInfo) : arrsize(procInfoLegacy);
+    auto err = lilu.onProcLoadForce(procs, procCount, nullptr, nullptr, this->userMods, this->userModCount);
+    if (err != LiluAPI::Error::NoError) {
+        SYSLOG("pagepatch", "Failed to register with UserPatcher (%d), keeping the page hook", static_cast<int>(err));
+        this->userModCount = 0;
+        return false;
+    }
+    DBGLOG("pagepatch", "Registered %zu images with UserPatcher", this->userModCount);
+    return true;
+}
+
+void PagePatcher::addUserPatch(const char *path, const uint8_t *find, const uint8_t *replace, size_t size,
+    UserPatcher::FileSegment segment) {
+    PANIC_COND(this->userModCount >= MaxNeedles, "pagepatch", "Too many user patches");
+    auto &patch = this->userPatches[this->userModCount];
+    patch = {CPU_TYPE_X86_64, 0, find, replace, size, 0, 1, segment, 1};
+    this->userMods[this->userModCount++] = {path, &patch, 1, 0, 0, 0, 0};
+}
+
+void PagePatcher::processPage(vnode *vp, uint64_t pageOffset, void *data) {
+    auto target = this->classify(vp);
+    if (LIKELY(target == PageTarget::Irrelevant)) { return; }
+
+    auto before = this->scanner.budgetsMet();
+    this->scanner.processPage(VnodeTargetCache::makeTag(vp, vnode_vid(vp)), pageOffset, data, target);
+    this->publishOnBudget(before);
+}
+
+PageTarget PagePatcher::classify(vnode *vp) {
+    auto vid = vnode_vid(vp);
+    auto target = PageTarget::Irrelevant;
+    if (LIKELY(this->targetCache.lookup(vp, vid, target))) { return target; }
+
+    char path[PATH_MAX];
+    int pathlen = PATH_MAX;
+    if (vn_getpath(vp, path, &pathlen)) { return PageTarget::Irrelevant; }    // Don't cache, might resolve later
+
+    if (UserPatcher::matchSharedCachePath(path)) {
+        target = PageTarget::SharedCache;
+    } else if (UNLIKELY(!strncmp(path, kCoreLSKDMSEPath, arrsize(kCoreLSKDMSEPath)))) {
+        target = PageTarget::CoreLSKDMSE;
+    } else if (UNLIKELY(!strncmp(path, kCoreLSKDPath, arrsize(kCoreLSKDPath)))) {
+        target = PageTarget::CoreLSKD;
+    }
+    this->targetCache.insert(vp, vid, target);
+    return target;
+}
+
+void PagePatcher::publishOnBudget(uint32_t before) {
+    // Can't allocate in the page validation path, publish from a thread call instead
+    if (this->scanner.budgetsMet() != before && this->publishCall) { thread_call_enter(this->publishCall); }
+}
+
+void PagePatcher::publishState() {
+    auto *iGPU = LRed::callback->iGPU;
+    if (!iGPU) { return; }
+
+    auto *state = OSDictionary::withCapacity(4);
+    auto *needleStates = OSDictionary::withCapacity(static_cast<uint32_t>(this->scanner.count()));
+    if (!state || !needleStates) {
+        SYSLOG("pagepatch", "Failed to allocate page patch state");
+        OSSafeReleaseNULL(state);
+        OSSafeReleaseNULL(needleStates);
+        return;
+    }
+
+    for (size_t i = 0; i < this->scanner.count(); i++) {
+        auto *needle = OSDictionary::withCapacity(2);
+        if (!needle) { continue; }
+        auto *applied = OSNumber::withNumber(this->scanner.applied(i), 32);
+        auto *budget = OSNumber::withNumber(this->scanner.needle(i).budget, 32);
+        if (applied) { needle->setObject("Applied", applied); }
+        if (budget) { needle->setObject("Budget", budget); }
+        OSSafeReleaseNULL(applied);
+        OSSafeReleaseNULL(budget);
+        needleStates->setObject(this->scanner.needle(i).name, needle);
+        needle->release();
+    }
+    state->setObject("Needles", needleStates);
+    needleStates->release();
+
+#ifdef DEBUG
+    auto *hits = OSNumber::withNumber(__atomic_load_n(&this->targetCache.hits, __ATOMIC_RELAXED), 64);
+    auto *misses = OSNumber::withNumber(__atomic_load_n(&this->targetCache.misses, __ATOMIC_RELAXED), 64);
+    if (hits) { state->setObject("CacheHits", hits); }
+    if (misses) { state->setObject("CacheMisses", misses); }
+    OSSafeReleaseNULL(hits);
+    OSSafeReleaseNULL(misses);
+#endif
+    auto *planHits = OSNumber::withNumber(this->scanner.planHits(), 64);
+    auto *planStale = OSNumber::withNumber(this->scanner.planStale(), 64);
+    if (planHits) { state->setObject("PlanHits", planHits); }
+    if (planStale) { state->setObject("PlanStale", planStale); }
+    OSSafeReleaseNULL(planHits);
+    OSSafeReleaseNULL(planStale);
+    auto *splitsPatched = OSNumber::withNumber(this->scanner.splitsPatched(), 32);
+    auto *splitsMissed = OSNumber::withNumber(this->scanner.splitsMissed(), 32);
+    if (splitsPatched) { state->setObject("SplitsPatched", splitsPatched); }
+    if (splitsMissed) { state->setObject("SplitsMissed", splitsMissed); }
+    OSSafeReleaseNULL(splitsPatched);
+    OSSafeReleaseNULL(splitsMissed);
+    state->setObject("Complete", this->isComplete() ? kOSBooleanTrue : kOSBooleanFalse);
+    state->setObject("Unplanned", this->scanner.hasUnplanned() ? kOSBooleanTrue : kOSBooleanFalse);
+    auto *engine = OSString::withCString(this->userPatcher ? "UserPatcher" : "PageHook");
+    if (engine) { state->setObject("Engine", engine); }
+    OSSafeReleaseNULL(engine);
+
+    iGPU->setProperty("LRedPagePatchState", state);
+    state->release();
+}
@@ -0,0 +1,43 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+#ifndef kern_pagepatch_hpp
+#define kern_pagepatch_hpp
+#include "kern_pagescan.hpp"
+#include "kern_patches.hpp"
+#include <Headers/kern_user.hpp>
+#include <Headers/kern_util.hpp>
+#include <kern/thread_call.h>
+
+class PagePatcher {
+    public:
+    static PagePatcher *callback;
+    void init();
+    void processPage(vnode *vp, uint64_t pageOffset, void *data);
+    PageTarget classify(vnode *vp);
+    void publishState();
+
+    /** Every budgeted needle has used up its budget; the hook calls straight through */
+    bool isComplete() const { return this->scanner.isComplete(); }
+    /** Some needle is left for our `cs_validate_page` hook, the rest went to Lilu's `UserPatcher` */
+    bool needsPageHook() const { return this->scanner.count() != 0; }
+
+    private:
+    static constexpr size_t MaxNeedles = MaxPageNeedles;
+
+    PageScanner scanner;
+    VnodeTargetCache targetCache;
+    thread_call_t publishCall {nullptr};
+    bool userPatcher {false};
+    UserPatcher::BinaryModPatch userPatches[MaxNeedles] {};
+    UserPatcher::BinaryModInfo userMods[MaxNeedles] {};
+    size_t userModCount {0};
+
+    bool registerUserPatches();
+    void addUserPatch(const char *path, const uint8_t *find, const uint8_t *replace, size_t size,
+        UserPatcher::FileSegment segment);
+    /** Publishes from a thread call when a needle reached its budget while handling the page */
+    void publishOnBudget(uint32_t before);
+};
+
+#endif /* kern_pagepatch_hpp */
@@ -0,0 +1,227 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+#include "kern_pagescan.hpp"
+
+bool PageScanner::init() {
+    if (this->splitLock) { return true; }
+    this->splitLock = IOSimpleLockAlloc();
+    return this->splitLock != nullptr;
+}
+
+void PageScanner::addNeedle(const PageNeedle &needle) {
+    PANIC_COND(this->needleCount >= MaxNeedles, "pagescan", "Too many page needles");
+    PANIC_COND(needle.target == PageTarget::Irrelevant, "pagescan", "Needle has no target");
+    PANIC_COND(!needle.findSize || needle.replaceSize > needle.findSize, "pagescan", "Invalid needle %s",
+        needle.name);
+
+    auto target = static_cast<size_t>(needle.target);
+    auto bit = static_cast<uint8_t>(1U << this->needleCount);
+    this->needles[this->needleCount++] = needle;
+    // Unbounded needles are patched for as long as the hook runs, they don't hold back completion
+    if (needle.budget) { this->needlesLeft++; }
+    this->firstByteMap[target][needle.find[0]] |= bit;
+    this->targetNeedles[target] |= bit;
+    if (!this->minNeedleSize[target] || needle.findSize < this->minNeedleSize[target]) {
+        this->minNeedleSize[target] = needle.findSize;
+    }
+}
+
+void PageScanner::processPage(uint64_t vnodeTag, uint64_t pageOffset, void *data, PageTarget target) {
+    if (target == PageTarget::Irrelevant) { return; }
+
+    uint16_t offsets[MaxPageNeedles];
+    if (!this->applyPlanned(vnodeTag, pageOffset, data) && this->patchPage(data, PAGE_SIZE, target, offsets) &&
+        !this->plan.record(vnodeTag, pageOffset, offsets)) {
+        DBGLOG("pagescan", "No plan slot left for page 0x%llX", pageOffset);
+        this->markUnplanned();
+    }
+    this->matchSplits(vnodeTag, pageOffset, static_cast<uint8_t *>(data), target);
+}
+
+/**
+ * Patch a page from the plan with a single lookup.
+ * The needles are checked before writing, a page that no longer matches drops its entry and gets scanned again.
+ * Replaying a site counted when it was scanned, so it doesn't count towards the budget again.
+ */
+bool PageScanner::applyPlanned(uint64_t vnodeTag, uint64_t pageOffset, void *data) {
+    auto *entry = this->plan.find(vnodeTag, pageOffset);
+    if (LIKELY(!entry)) { return false; }
+
+    auto *bytes = static_cast<uint8_t *>(data);
+    for (size_t n = 0; n < this->needleCount; n++) {
+        auto offset = entry->offsets[n];
+        if (offset == NoPageNeedle) { continue; }
+        auto &needle = this->needles[n];
+        if (offset + needle.findSize > PAGE_SIZE || memcmp(bytes + offset, needle.find, needle.findSize)) {
+            DBGLOG("pagescan", "Plan for page 0x%llX is stale", pageOffset);
+            this->plan.invalidate(entry);
+            return false;
+        }
+    }
+
+    for (size_t n = 0; n < this->needleCount; n++) {
+        auto offset = entry->offsets[n];
+        if (offset == NoPageNeedle) { continue; }
+        memcpy(bytes + offset, this->needles[n].replace, this->needles[n].replaceSize);
+    }
+    __atomic_fetch_add(&this->plan.hits, 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+/**
+ * Single walk over the page for all needles of the target.
+ * Mirrors `KernelPatcher::findAndReplace`, so every needle is replaced at most once per page.
+ */
+bool PageScanner::patchPage(void *data, size_t size, PageTarget target, uint16_t (&offsets)[MaxPageNeedles]) {
+    for (auto &offset : offsets) { offset = NoPageNeedle; }
+    if (target == PageTarget::Irrelevant) { return false; }
+    auto t = static_cast<size_t>(target);
+    auto pending = this->targetNeedles[t];
+    if (!pending || size < this->minNeedleSize[t]) { return false; }
+
+    auto *bytes = static_cast<uint8_t *>(data);
+    auto *map = this->firstByteMap[t];
+    auto end = size - this->minNeedleSize[t];
+    for (size_t i = 0; i <= end; i++) {
+        auto candidates = static_cast<uint8_t>(map[bytes[i]] & pending);
+        if (LIKELY(!candidates)) { continue; }
+
+        for (size_t n = 0; candidates; n++, candidates >>= 1) {
+            if (!(candidates & 1)) { continue; }
+            auto &needle = this->needles[n];
+            if (needle.findSize > size - i || memcmp(bytes + i, needle.find, needle.findSize)) { continue; }
+            memcpy(bytes + i, needle.replace, needle.replaceSize);
+            DBGLOG("pagescan", "%s", needle.message);
+            pending &= ~(1U << n);
+            offsets[n] = static_cast<uint16_t>(i);
+            this->recordApplied(n);
+        }
+
+        if (!pending) { break; }
+    }
+
+    return pending != this->targetNeedles[t];
+}
+
+/**
+ * Look for needles cut by either edge of the page.
+ * Neither side is patched before the other one matched too, a needle prefix at the end of a page is often just
+ * the start of an unrelated string.
+ */
+void PageScanner::matchSplits(uint64_t vnodeTag, uint64_t pageOffset, uint8_t *bytes, PageTarget target) {
+    auto pending = this->targetNeedles[static_cast<size_t>(target)];
+    for (size_t n = 0; pending; n++, pending >>= 1) {
+        if (!(pending & 1)) { continue; }
+        auto &needle = this->needles[n];
+
+        if (needle.findSize < MinSplitShare * 2) { continue; }
+        // Both sides must hold at least `MinSplitShare` bytes, a shorter side can't be told apart from noise
+        for (size_t share = needle.findSize - MinSplitShare; share >= MinSplitShare; share--) {
+            if (!memcmp(bytes + PAGE_SIZE - share, needle.find, share)) {
+                this->joinSplit(vnodeTag, pageOffset + PAGE_SIZE, n, share, true, bytes);
+                break;
+            }
+        }
+
+        if (!pageOffset) { continue; }
+        for (size_t share = needle.findSize - MinSplitShare; share >= MinSplitShare; share--) {
+            if (!memcmp(bytes, needle.find + needle.findSize - share, share)) {
+                this->joinSplit(vnodeTag, pageOffset, n, needle.findSize - share, false, bytes);
+                break;
+            }
+        }
+    }
+}
+
+void PageScanner::joinSplit(uint64_t vnodeTag, uint64_t boundary, size_t index, size_t lowerShare, bool lower,
+    uint8_t *bytes) {
+    auto &needle = this->needles[index];
+    // Replacement bytes on the lower and upper side of the boundary
+    auto lowerReplace = needle.replaceSize < lowerShare ? needle.replaceSize : lowerShare;
+    auto upperReplace = needle.replaceSize > lowerShare ? needle.replaceSize - lowerShare : 0;
+
+    IOSimpleLockLock(this->splitLock);
+    SplitMatch *match = nullptr, *freeSlot = nullptr, *unjoined = nullptr;
+    for (auto &ent : this->splits) {
+        if (!ent.used) {
+            if (!freeSlot) { freeSlot = &ent; }
+        } else if (ent.vnodeTag == vnodeTag && ent.boundary == boundary && ent.needle == index &&
+                   ent.lowerShare == lowerShare) {
+            match = &ent;
+            break;
+        } else if (!unjoined && !(ent.lowerSeen && ent.upperSeen)) {
+            unjoined = &ent;
+        }
+    }
+
+    if (!match) {
+        // A side that never found its other half is most likely noise, joined matches are never evicted
+        match = freeSlot ? freeSlot : unjoined;
+        if (!match) {
+            IOSimpleLockUnlock(this->splitLock);
+            DBGLOG("pagescan", "Out of split slots for %s", needle.name);
+            return;
+        }
+        *match = {vnodeTag, boundary, static_cast<uint8_t>(index), static_cast<uint8_t>(lowerShare), true, false,
+            false, false, false};
+    }
+
+    auto &seen = lower ? match->lowerSeen : match->upperSeen;
+    auto &patched = lower ? match->lowerPatched : match->upperPatched;
+    auto otherSeen = lower ? match->upperSeen : match->lowerSeen;
+    auto otherPatched = lower ? match->upperPatched : match->lowerPatched;
+    auto joining = otherSeen && !seen;
+    seen = true;
+    // Only one side is mapped at a time, so a side is patched only when the other one already is or has nothing to
+    // replace. Otherwise the needle would be half rewritten, be it an instruction or a string like "boava-id"
+    auto patch = otherSeen && (otherPatched || !(lower ? upperReplace : lowerReplace));
+    auto first = patch && !patched && !otherPatched;
+    // With nothing to replace on this side, the other one is patched when it's paged in again
+    auto missed = joining && !patch && (lower ? lowerReplace : upperReplace);
+    if (patch) { patched = true; }
+    IOSimpleLockUnlock(this->splitLock);
+
+    if (patch) {
+        // The plan only holds offsets within a page, the halves of this needle are matched again on every validation
+        this->markUnplanned();
+        if (lower) {
+            memcpy(bytes + PAGE_SIZE - lowerShare, needle.replace, lowerReplace);
+        } else if (upperReplace) {
+            memcpy(bytes, needle.replace + lowerShare, upperReplace);
+        }
+        DBGLOG("pagescan", "%s (%s side of split at 0x%llX)", needle.message, lower ? "lower" : "upper", boundary);
+    }
+    if (first) {
+        __atomic_add_fetch(&this->splitsJoined, 1, __ATOMIC_RELAXED);
+        this->recordApplied(index);
+    }
+    if (missed) {
+        __atomic_add_fetch(&this->splitsLost, 1, __ATOMIC_RELAXED);
+        SYSLOG("pagescan", "%s split at 0x%llX could not be patched", needle.name, boundary);
+    }
+}
+
+void PageScanner::recordApplied(size_t index) {
+    if (__atomic_add_fetch(&this->appliedCount[index], 1, __ATOMIC_RELAXED) != this->needles[index].budget) {
+        return;
+    }
+    DBGLOG("pagescan", "%s reached its budget", this->needles[index].name);
+    __atomic_add_fetch(&this->budgetsReached, 1, __ATOMIC_RELAXED);
+    if (__atomic_sub_fetch(&this->needlesLeft, 1, __ATOMIC_RELAXED) || !this->useBudget || this->hasUnplanned()) {
+        return;
+    }
+    __atomic_store_n(&this->complete, true, __ATOMIC_SEQ_CST);
+    // Lost a race with `markUnplanned`, which might have cleared the flag before it was set
+    if (this->hasUnplanned()) {
+        __atomic_store_n(&this->complete, false, __ATOMIC_SEQ_CST);
+        return;
+    }
+    DBGLOG("pagescan", "All page patches applied, passing pages straight through from now on");
+}
+
+void PageScanner::markUnplanned() {
+    if (__atomic_exchange_n(&this->unplanned, true, __ATOMIC_SEQ_CST)) { return; }
+    __atomic_store_n(&this->complete, false, __ATOMIC_SEQ_CST);
+    DBGLOG("pagescan", "Patched a page outside the plan, pages are scanned until the next boot");
+}
@@ -0,0 +1,246 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+#ifndef kern_pagescan_hpp
+#define kern_pagescan_hpp
+#include <Headers/kern_util.hpp>
+#include <IOKit/IOLocks.h>
+
+// Matching of the page needles, without anything of the page validation path, so that it can be exercised outside
+// of the kernel. kern_pagepatch.cpp classifies the pages and hands them over.
+
+// Which of our userspace images a code-signed page belongs to
+enum struct PageTarget : uint8_t {
+    SharedCache = 0,
+    CoreLSKD,
+    CoreLSKDMSE,
+    Irrelevant,
+};
+
+struct PageNeedle {
+    const char *name;
+    const char *message;
+    PageTarget target;
+    const uint8_t *find;
+    size_t findSize;
+    const uint8_t *replace;
+    size_t replaceSize;
+    /** How many sites we expect to patch per boot, 0 when that isn't known and the needle is never done */
+    uint32_t budget;
+};
+
+struct vnode;
+
+constexpr size_t MaxPageNeedles = 8;
+constexpr uint16_t NoPageNeedle = 0xFFFF;
+
+/**
+ * Lock-free, direct-mapped cache of the target of a vnode.
+ * Each slot is a single 64-bit word: vnode address bits 4-43, low 21 bits of the vnode ID and the target + 1.
+ * The vnode ID makes a recycled vnode miss even when it reuses the same address.
+ */
+class VnodeTargetCache {
+    static constexpr size_t SlotCount = 256;
+    uint64_t slots[SlotCount] {};
+
+    public:
+    static uint64_t makeTag(const vnode *vp, uint32_t vid) {
+        auto addr = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(vp));
+        return (((addr >> 4) & 0xFFFFFFFFFFULL) << 24) | ((static_cast<uint64_t>(vid) & 0x1FFFFF) << 3);
+    }
+
+    private:
+    static size_t slotIndex(const vnode *vp) {
+        auto addr = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(vp));
+        return static_cast<size_t>(((addr >> 4) * 0x9E3779B97F4A7C15ULL) >> 56) & (SlotCount - 1);
+    }
+
+#ifdef DEBUG
+    /** Plain increments, so concurrent lookups may lose a few; this is on every page validation */
+    static void count(uint64_t &counter) {
+        __atomic_store_n(&counter, __atomic_load_n(&counter, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+    }
+#endif
+
+    public:
+#ifdef DEBUG
+    uint64_t hits {0};
+    uint64_t misses {0};
+#endif
+
+    bool lookup(const vnode *vp, uint32_t vid, PageTarget &target) {
+        auto tag = makeTag(vp, vid);
+        auto slot = __atomic_load_n(&this->slots[slotIndex(vp)], __ATOMIC_RELAXED);
+        if (slot && (slot & ~7ULL) == tag) {
+#ifdef DEBUG
+            count(this->hits);
+#endif
+            target = static_cast<PageTarget>((slot & 7) - 1);
+            return true;
+        }
+#ifdef DEBUG
+        count(this->misses);
+#endif
+        return false;
+    }
+
+    void insert(const vnode *vp, uint32_t vid, PageTarget target) {
+        auto slot = makeTag(vp, vid) | (static_cast<uint64_t>(target) + 1);
+        __atomic_store_n(&this->slots[slotIndex(vp)], slot, __ATOMIC_RELAXED);
+    }
+};
+
+/**
+ * Where the needles sit inside the pages we patched, learned while scanning.
+ * The shared cache doesn't change while it's mapped, so a page validated again is patched from here without a scan.
+ * Open-addressed and lock-free: writers claim a slot with a CAS on its state, readers only trust `Ready` slots.
+ */
+class PatchPlan {
+    public:
+    enum State : uint32_t {
+        Empty = 0,
+        Writing,
+        Ready,
+        Stale,
+    };
+
+    struct Entry {
+        uint64_t vnodeTag;
+        uint64_t pageOffset;
+        uint32_t state;
+        uint16_t offsets[MaxPageNeedles];
+    };
+
+    static constexpr size_t SlotCount = 64;
+    static constexpr size_t MaxProbes = 8;
+
+    uint64_t hits {0};
+    uint64_t stale {0};
+
+    const Entry *find(uint64_t vnodeTag, uint64_t pageOffset) const {
+        auto index = slotIndex(vnodeTag, pageOffset);
+        for (size_t i = 0; i < MaxProbes; i++, index = (index + 1) & (SlotCount - 1)) {
+            auto &entry = this->entries[index];
+            auto state = __atomic_load_n(&entry.state, __ATOMIC_ACQUIRE);
+            if (state == Empty) { return nullptr; }
+            if (state == Ready && entry.vnodeTag == vnodeTag && entry.pageOffset == pageOffset) { return &entry; }
+        }
+        return nullptr;
+    }
+
+    /** False when every probed slot is taken, the page then has to be scanned each time it's validated */
+    bool record(uint64_t vnodeTag, uint64_t pageOffset, const uint16_t (&offsets)[MaxPageNeedles]) {
+        auto index = slotIndex(vnodeTag, pageOffset);
+        for (size_t i = 0; i < MaxProbes; i++, index = (index + 1) & (SlotCount - 1)) {
+            auto &entry = this->entries[index];
+            auto state = __atomic_load_n(&entry.state, __ATOMIC_ACQUIRE);
+            if (state == Ready && entry.vnodeTag == vnodeTag && entry.pageOffset == pageOffset) { return true; }
+            if ((state != Empty && state != Stale) ||
+                !__atomic_compare_exchange_n(&entry.state, &state, Writing, false, __ATOMIC_ACQUIRE,
+                    __ATOMIC_RELAXED)) {
+                continue;
+            }
+            entry.vnodeTag = vnodeTag;
+            entry.pageOffset = pageOffset;
+            memcpy(entry.offsets, offsets, sizeof(entry.offsets));
+            __atomic_store_n(&entry.state, Ready, __ATOMIC_RELEASE);
+            return true;
+        }
+        return false;
+    }
+
+    void invalidate(const Entry *entry) {
+        auto expected = static_cast<uint32_t>(Ready);
+        if (__atomic_compare_exchange_n(&const_cast<Entry *>(entry)->state, &expected, Stale, false,
+                __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            __atomic_fetch_add(&this->stale, 1, __ATOMIC_RELAXED);
+        }
+    }
+
+    private:
+    Entry entries[SlotCount] {};
+
+    static size_t slotIndex(uint64_t vnodeTag, uint64_t pageOffset) {
+        return static_cast<size_t>(((vnodeTag ^ (pageOffset >> 12)) * 0x9E3779B97F4A7C15ULL) >> 58) & (SlotCount - 1);
+    }
+};
+
+/**
+ * A needle straddling the boundary between two pages of a file.
+ * Only one page is mapped per validation, so each side is matched on its own and the halves are joined here.
+ * A joined match is kept for the rest of the boot, the side validated first is patched when it's paged in again.
+ */
+struct SplitMatch {
+    uint64_t vnodeTag;
+    uint64_t boundary;
+    uint8_t needle;
+    uint8_t lowerShare;
+    bool used;
+    bool lowerSeen, upperSeen;
+    bool lowerPatched, upperPatched;
+};
+
+/**
+ * The needles of every target, matched against one `PAGE_SIZE` page at a time.
+ * Pages are identified by the tag of their vnode and their offset in the file.
+ */
+class PageScanner {
+    public:
+    bool init();
+    void addNeedle(const PageNeedle &needle);
+    size_t count() const { return this->needleCount; }
+    const PageNeedle &needle(size_t index) const { return this->needles[index]; }
+    uint32_t applied(size_t index) const { return __atomic_load_n(&this->appliedCount[index], __ATOMIC_RELAXED); }
+
+    /** Patches the page from the plan or scans it, then looks for needles cut by its edges */
+    void processPage(uint64_t vnodeTag, uint64_t pageOffset, void *data, PageTarget target);
+    bool applyPlanned(uint64_t vnodeTag, uint64_t pageOffset, void *data);
+    bool patchPage(void *data, size_t size, PageTarget target, uint16_t (&offsets)[MaxPageNeedles]);
+    void matchSplits(uint64_t vnodeTag, uint64_t pageOffset, uint8_t *bytes, PageTarget target);
+
+    /**
+     * Every needle with a budget has used it up and every patched page is in the plan; the hook passes pages straight
+     * through. Off unless enabled with `setUseBudget`, since pages validated again afterwards stay unpatched.
+     */
+    bool isComplete() const { return __atomic_load_n(&this->complete, __ATOMIC_SEQ_CST); }
+    void setUseBudget(bool useBudget) { this->useBudget = useBudget; }
+    /** A page was patched that the plan can't replay, either split across a boundary or past the probe limit */
+    bool hasUnplanned() const { return __atomic_load_n(&this->unplanned, __ATOMIC_SEQ_CST); }
+    /** Needles that have reached their budget so far */
+    uint32_t budgetsMet() const { return __atomic_load_n(&this->budgetsReached, __ATOMIC_RELAXED); }
+
+    uint64_t planHits() const { return __atomic_load_n(&this->plan.hits, __ATOMIC_RELAXED); }
+    uint64_t planStale() const { return __atomic_load_n(&this->plan.stale, __ATOMIC_RELAXED); }
+    uint32_t splitsPatched() const { return __atomic_load_n(&this->splitsJoined, __ATOMIC_RELAXED); }
+    uint32_t splitsMissed() const { return __atomic_load_n(&this->splitsLost, __ATOMIC_RELAXED); }
+
+    private:
+    static constexpr size_t MaxNeedles = MaxPageNeedles;
+    static constexpr size_t TargetCount = static_cast<size_t>(PageTarget::Irrelevant);
+    static constexpr size_t MaxSplits = 16;
+    static constexpr size_t MinSplitShare = 4;
+
+    PageNeedle needles[MaxNeedles] {};
+    size_t needleCount {0};
+    /** Per target, bitmask of the needles starting with a given byte */
+    uint8_t firstByteMap[TargetCount][256] {};
+    uint8_t targetNeedles[TargetCount] {};
+    size_t minNeedleSize[TargetCount] {};
+    PatchPlan plan;
+    uint32_t appliedCount[MaxNeedles] {};
+    size_t needlesLeft {0};
+    uint32_t budgetsReached {0};
+    bool complete {false};
+    bool useBudget {false};
+    bool unplanned {false};
+    SplitMatch splits[MaxSplits] {};
+    IOSimpleLock *splitLock {nullptr};
+    uint32_t splitsJoined {0};
+    uint32_t splitsLost {0};
+
+    void recordApplied(size_t index);
+    void markUnplanned();
+    void joinSplit(uint64_t vnodeTag, uint64_t boundary, size_t index, size_t lowerShare, bool lower, uint8_t *bytes);
+};
+
+#endif /* kern_pagescan_hpp */
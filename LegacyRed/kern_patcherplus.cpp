@@ -2,10 +2,83 @@
 //  details.
 
 #include "kern_patcherplus.hpp"
+#include "kern_bootprofile.hpp"
+#include "kern_patternscan.hpp"
 
-bool SolveRequestPlus::solve(KernelPatcher *patcher, size_t index, mach_vm_address_t address, size_t size) {
+static constexpr size_t MaxPending = 64;
+
+/** The first match the plan has for a pattern, if that is within the range */
+static mach_vm_address_t plannedIn(const SymbolIndex *symbols, const uint8_t *pattern, const uint8_t *mask,
+    size_t patternSize, mach_vm_address_t start, size_t length) {
+    auto planned = symbols ? symbols->findPattern(pattern, mask, patternSize) : 0;
+    // The plan has the first match in the whole kext, within the section it's also the first one there
+    return planned >= start && planned - start < length ? planned : 0;
+}
+
+/**
+ * Scan each section of the kext once for the patterns of all pending requests the plan of the kext doesn't know.
+ * `resolve` is handed each request and the address of its first match, zero if there was none.
+ */
+template<typename T, typename F>
+static bool scanImage(mach_vm_address_t address, size_t size, const SymbolIndex *symbols, T *const *pending,
+    size_t count, F resolve) {
+    if (!count) { return true; }
+    auto *image = MachImage::forKext(address, size);
+    for (size_t s = 0; s <= static_cast<size_t>(KextSection::Whole); s++) {
+        auto section = static_cast<KextSection>(s);
+        mach_vm_address_t start;
+        size_t length;
+        image->range(section, start, length);
+        PatternScanner scanner;
+        size_t slots[PatternScanner::MaxPatterns];
+        for (size_t i = 0; i < count; i++) {
+            auto &request = *pending[i];
+            if (request.section != section) { continue; }
+            auto planned = plannedIn(symbols, request.pattern, request.mask, request.patternSize, start, length);
+            if (planned) {
+                if (!resolve(request, planned)) { return false; }
+                continue;
+            }
+            auto slot = scanner.add(request.pattern, request.mask, request.patternSize);
+            PANIC_COND(slot == PatternScanner::NotFound, "patcher+", "Too many pattern requests");
+            slots[slot] = i;
+        }
+        if (!scanner.count()) { continue; }
+
+        scanner.scan(reinterpret_cast<const void *>(start), length);
+        for (size_t slot = 0; slot < scanner.count(); slot++) {
+            auto offset = scanner.offset(slot);
+            if (!resolve(*pending[slots[slot]], offset == PatternScanner::NotFound ? 0 : start + offset)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/** First match of a pattern in a section of the kext, from the plan when it has one; zero if there is none */
+static mach_vm_address_t findInImage(mach_vm_address_t address, size_t size, const SymbolIndex *symbols,
+    const uint8_t *pattern, const uint8_t *mask, size_t patternSize, KextSection section) {
+    mach_vm_address_t start;
+    size_t length;
+    MachImage::forKext(address, size)->range(section, start, length);
+    auto planned = plannedIn(symbols, pattern, mask, patternSize, start, length);
+    if (planned) { return planned; }
+    size_t offset = 0;
+    if (!KernelPatcher::findPattern(pattern, mask, patternSize, reinterpret_cast<const void *>(start), length,
+            &offset)) {
+        return 0;
+    }
+    return start + offset;
+}
+
+bool SolveRequestPlus::solveSymbol(KernelPatcher *patcher, size_t index, const SymbolIndex *symbols) {
     PANIC_COND(!this->address, "patcher+", "this->address is null");
-    if (!this->guard) { return true; }
+
+    if (symbols) {
+        *this->address = symbols->solve(this->symbol);
+        if (*this->address) { return true; }
+    }
 
     if (patcher) {
         *this->address = patcher->solveSymbol(index, this->symbol);
@@ -13,73 +86,158 @@ bool SolveRequestPlus::solve(KernelPatcher *patcher, size_t index, mach_vm_addre
         patcher->clearError();
     }
 
-    if (!this->pattern || !this->patternSize) {
-        DBGLOG("patcher+", "Failed to solve %s using symbol", safeString(this->symbol));
-        return false;
-    }
+    return false;
+}
 
-    size_t offset = 0;
-    if (!KernelPatcher::findPattern(this->pattern, this->mask, this->patternSize,
-            reinterpret_cast<const void *>(address), size, &offset) ||
-        !offset) {
+bool SolveRequestPlus::solvePattern(mach_vm_address_t match) {
+    if (!match) {
         DBGLOG("patcher+", "Failed to solve %s using pattern", safeString(this->symbol));
         return false;
     }
 
-    *this->address = address + offset;
+    *this->address = match;
     return true;
 }
 
+bool SolveRequestPlus::solve(KernelPatcher *patcher, size_t index, mach_vm_address_t address, size_t size,
+    const SymbolIndex *symbols) {
+    if (!this->guard || this->solveSymbol(patcher, index, symbols)) { return true; }
+
+    if (!this->pattern || !this->patternSize) {
+        DBGLOG("patcher+", "Failed to solve %s using symbol", safeString(this->symbol));
+        return false;
+    }
+
+    return this->solvePattern(
+        findInImage(address, size, symbols, this->pattern, this->mask, this->patternSize, this->section));
+}
+
 bool SolveRequestPlus::solveAll(KernelPatcher *patcher, size_t index, SolveRequestPlus *requests, size_t count,
     mach_vm_address_t address, size_t size) {
+    ProfileSpan span {"solveAll"};
+    auto start = mach_absolute_time();
+    // A null patcher means the symbols aren't to be trusted, so the index isn't either
+    auto *symbols = patcher ? SymbolIndex::forKext(address, size) : nullptr;
+    SolveRequestPlus *pending[MaxPending];
+    size_t pendingCount = 0;
     for (size_t i = 0; i < count; i++) {
-        if (!requests[i].solve(patcher, index, address, size)) { return false; }
-    }
-    return true;
-}
+        auto &request = requests[i];
+        if (!request.guard || request.solveSymbol(patcher, index, symbols)) { continue; }
 
-bool RouteRequestPlus::route(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size) {
-    if (!this->guard) { return true; }
+        if (!request.pattern || !request.patternSize) {
+            DBGLOG("patcher+", "Failed to solve %s using symbol", safeString(request.symbol));
+            return false;
+        }
 
-    if (patcher.routeMultiple(index, this, 1, address, size)) { return true; }
-    patcher.clearError();
+        PANIC_COND(pendingCount >= MaxPending, "patcher+", "Too many pattern requests");
+        pending[pendingCount++] = &request;
+    }
 
-    if (!this->pattern || !this->patternSize) {
-        DBGLOG("patcher+", "Failed to route %s using symbol", safeString(this->symbol));
+    if (!scanImage(address, size, symbols, pending, pendingCount,
+            [](SolveRequestPlus &request, mach_vm_address_t match) { return request.solvePattern(match); })) {
         return false;
     }
 
-    size_t offset = 0;
-    if (!KernelPatcher::findPattern(this->pattern, this->mask, this->patternSize,
-            reinterpret_cast<const void *>(address), size, &offset) ||
-        !offset) {
+    uint64_t ns;
+    absolutetime_to_nanoseconds(mach_absolute_time() - start, &ns);
+    DBGLOG("patcher+", "Solved %zu requests for kext %zu in %llu ns", count, index, ns);
+    return true;
+}
+
+bool RouteRequestPlus::routePattern(KernelPatcher &patcher, mach_vm_address_t match) {
+    if (!match) {
         DBGLOG("patcher+", "Failed to route %s using pattern", safeString(this->symbol));
         return false;
     }
 
-    auto org = patcher.routeFunction(address + offset, this->to, true);
+    auto org = patcher.routeFunction(match, this->to, true);
     if (!org) {
         DBGLOG("patcher+", "Failed to route %s using pattern: %d", safeString(this->symbol), patcher.getError());
+        patcher.clearError();
         return false;
     }
     if (this->org) { *this->org = org; }
-
     return true;
 }
 
-bool RouteRequestPlus::routeAll(KernelPatcher &patcher, size_t index, RouteRequestPlus *requests, size_t count,
+/** Same layout as `KernelPatcher::RouteRequest`, but it can be default constructed to fill in a batch */
+struct BatchedRoute : KernelPatcher::RouteRequest {
+    BatchedRoute() : KernelPatcher::RouteRequest(nullptr, static_cast<mach_vm_address_t>(0)) {}
+};
+
+static_assert(sizeof(BatchedRoute) == sizeof(KernelPatcher::RouteRequest), "Batch must be a RouteRequest array");
+
+/**
+ * Route requests of one kext.
+ * Everything with a symbol goes to Lilu in a single `routeMultiple` call, so the routes share one trampoline
+ * allocation and one kernel writing window. Lilu solves them by name; the index only tells which requests
+ * are missing their symbol and have to be routed at the first match of their pattern, one at a time.
+ */
+static bool routeRequests(KernelPatcher &patcher, size_t index, RouteRequestPlus *const *requests, size_t count,
     mach_vm_address_t address, size_t size) {
+    auto *symbols = SymbolIndex::forKext(address, size);
+    BatchedRoute batch[MaxPending];
+    size_t batchCount = 0;
+    RouteRequestPlus *pending[MaxPending];
+    size_t pendingCount = 0;
     for (size_t i = 0; i < count; i++) {
-        if (!requests[i].route(patcher, index, address, size)) { return false; }
+        auto &request = *requests[i];
+        if (!request.guard) { continue; }
+
+        if (request.pattern && request.patternSize && !symbols->solve(request.symbol)) {
+            // The index may have nothing to go by, Lilu has the final say on a symbol
+            auto found = request.symbol && patcher.solveSymbol(index, request.symbol);
+            patcher.clearError();
+            if (!found) {
+                PANIC_COND(pendingCount >= MaxPending, "patcher+", "Too many pattern requests");
+                pending[pendingCount++] = &request;
+                continue;
+            }
+        }
+
+        PANIC_COND(batchCount >= MaxPending, "patcher+", "Too many route requests");
+        auto &route = batch[batchCount++];
+        route.symbol = request.symbol;
+        route.to = request.to;
+        route.org = request.org;
+    }
+
+    if (batchCount && !patcher.routeMultiple(index, batch, batchCount, address, size)) {
+        DBGLOG("patcher+", "Failed to route %zu symbols for kext %zu: %d", batchCount, index, patcher.getError());
+        patcher.clearError();
+        return false;
     }
+
+    return scanImage(address, size, symbols, pending, pendingCount,
+        [&patcher](RouteRequestPlus &request, mach_vm_address_t match) {
+            return request.routePattern(patcher, match);
+        });
+}
+
+bool RouteRequestPlus::routeAll(KernelPatcher &patcher, size_t index, RouteRequestPlus *requests, size_t count,
+    mach_vm_address_t address, size_t size) {
+    ProfileSpan span {"routeAll"};
+    auto start = mach_absolute_time();
+    PANIC_COND(count > MaxPending, "patcher+", "Too many route requests");
+    RouteRequestPlus *list[MaxPending];
+    for (size_t i = 0; i < count; i++) { list[i] = &requests[i]; }
+    if (!routeRequests(patcher, index, list, count, address, size)) { return false; }
+
+    uint64_t ns;
+    absolutetime_to_nanoseconds(mach_absolute_time() - start, &ns);
+    DBGLOG("patcher+", "Routed %zu requests for kext %zu in %llu ns", count, index, ns);
     return true;
 }
 
+bool LookupPatchPlus::usesLookupPatch(KernelPatcher *patcher) const {
+    return patcher && this->kext && !this->findMask && !this->replaceMask && this->size == this->replaceSize &&
+           !this->skip;
+}
+
 bool LookupPatchPlus::apply(KernelPatcher *patcher, mach_vm_address_t address, size_t size) const {
     if (!this->guard) { return true; }
 
-    if (patcher && this->kext && !this->findMask && !this->replaceMask && this->size == this->replaceSize &&
-        !this->skip) {
+    if (this->usesLookupPatch(patcher)) {
         patcher->applyLookupPatch(this, reinterpret_cast<uint8_t *>(address), size);
         return patcher->getError() == KernelPatcher::Error::NoError;
     }
@@ -90,11 +248,138 @@ bool LookupPatchPlus::apply(KernelPatcher *patcher, mach_vm_address_t address, s
 
 bool LookupPatchPlus::applyAll(KernelPatcher *patcher, LookupPatchPlus const *patches, size_t count,
     mach_vm_address_t address, size_t size) {
+    ProfileSpan span {"applyAll"};
+    // Find where each masked patch first matches in one walk per section, so that each replacement starts there.
+    // The patches in this tree don't create matches for one another, otherwise this would have to rescan.
+    auto *image = MachImage::forKext(address, size);
+    auto *symbols = SymbolIndex::forKext(address, size);
+    PANIC_COND(count > MaxPending, "patcher+", "Too many lookup patches");
+    mach_vm_address_t firstMatch[MaxPending] {};
+    for (size_t i = 0; i < count; i++) {
+        auto &patch = patches[i];
+        if (!patch.guard) { continue; }
+        mach_vm_address_t start;
+        size_t length;
+        image->range(patch.section, start, length);
+        firstMatch[i] = plannedIn(symbols, patch.find, patch.findMask, patch.size, start, length);
+    }
+    for (size_t s = 0; s <= static_cast<size_t>(KextSection::Whole); s++) {
+        auto section = static_cast<KextSection>(s);
+        PatternScanner scanner;
+        size_t slots[PatternScanner::MaxPatterns];
+        for (size_t i = 0; i < count; i++) {
+            auto &patch = patches[i];
+            if (!patch.guard || firstMatch[i] || patch.usesLookupPatch(patcher) || patch.section != section) {
+                continue;
+            }
+            auto slot = scanner.add(patch.find, patch.findMask, patch.size);
+            PANIC_COND(slot == PatternScanner::NotFound, "patcher+", "Too many patches in one section");
+            slots[slot] = i;
+        }
+        if (!scanner.count()) { continue; }
+
+        mach_vm_address_t start;
+        size_t length;
+        image->range(section, start, length);
+        scanner.scan(reinterpret_cast<const void *>(start), length);
+        for (size_t slot = 0; slot < scanner.count(); slot++) {
+            auto offset = scanner.offset(slot);
+            if (offset == PatternScanner::NotFound) {
+                DBGLOG("patcher+", "Failed to apply patches[%zu]", slots[slot]);
+                return false;
+            }
+            firstMatch[slots[slot]] = start + offset;
+        }
+    }
+
     for (size_t i = 0; i < count; i++) {
-        if (!patches[i].apply(patcher, address, size)) {
+        auto &patch = patches[i];
+        mach_vm_address_t start;
+        size_t length;
+        image->range(patch.section, start, length);
+        if (firstMatch[i]) {
+            length -= firstMatch[i] - start;
+            start = firstMatch[i];
+        }
+        if (!patch.apply(patcher, start, length)) {
+            DBGLOG("patcher+", "Failed to apply patches[%zu]", i);
+            return false;
+        }
+    }
+    return true;
+}
+
+void PatchTransaction::route(RouteRequestPlus *requests, size_t count) {
+    PANIC_COND(this->routeBatchCount >= MaxRouteBatches, "patcher+", "Too many route batches");
+    this->routes[this->routeBatchCount++] = {requests, count};
+}
+
+void PatchTransaction::apply(const LookupPatchPlus &patch, mach_vm_address_t address, size_t size) {
+    PANIC_COND(this->patchCount >= MaxPatches, "patcher+", "Too many lookup patches");
+    this->patches[this->patchCount++] = {&patch, address, size};
+}
+
+void PatchTransaction::addWrite(void *dest, const void *value, size_t size) {
+    PANIC_COND(!dest, "patcher+", "Write destination is null");
+    PANIC_COND(this->writeCount >= MaxWrites || size > WritePoolSize - this->writePoolUsed, "patcher+",
+        "Too many writes");
+    memcpy(this->writePool + this->writePoolUsed, value, size);
+    this->writes[this->writeCount++] = {dest, this->writePoolUsed, size};
+    this->writePoolUsed += size;
+}
+
+bool PatchTransaction::commit() {
+    ProfileSpan span {"commit"};
+    auto start = mach_absolute_time();
+    RouteRequestPlus *routes[MaxPending];
+    size_t routeCount = 0;
+    for (size_t i = 0; i < this->routeBatchCount; i++) {
+        auto &batch = this->routes[i];
+        PANIC_COND(batch.count > MaxPending - routeCount, "patcher+", "Too many route requests");
+        for (size_t n = 0; n < batch.count; n++) { routes[routeCount++] = &batch.requests[n]; }
+    }
+    if (routeCount && !routeRequests(this->patcher, this->index, routes, routeCount, this->address, this->size)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < this->patchCount; i++) {
+        auto &patch = this->patches[i];
+        if (!patch.patch->usesLookupPatch(&this->patcher)) { continue; }
+        if (!patch.patch->apply(&this->patcher, patch.address, patch.size)) {
             DBGLOG("patcher+", "Failed to apply patches[%zu]", i);
             return false;
         }
     }
+
+    // Nothing is logged while writing is enabled, interrupts are off in there
+    size_t failed = this->patchCount;
+    if (this->writeCount || this->patchCount) {
+        if (MachInfo::setKernelWriting(true, KernelPatcher::kernelWriteLock) != KERN_SUCCESS) {
+            SYSLOG("patcher+", "Failed to enable kernel writing");
+            return false;
+        }
+        for (size_t i = 0; i < this->writeCount; i++) {
+            auto &write = this->writes[i];
+            memcpy(write.dest, this->writePool + write.offset, write.size);
+        }
+        for (size_t i = 0; i < this->patchCount; i++) {
+            auto &patch = this->patches[i];
+            if (patch.patch->usesLookupPatch(&this->patcher)) { continue; }
+            if (!patch.patch->apply(&this->patcher, patch.address, patch.size)) {
+                failed = i;
+                break;
+            }
+        }
+        MachInfo::setKernelWriting(false, KernelPatcher::kernelWriteLock);
+    }
+    if (failed != this->patchCount) {
+        DBGLOG("patcher+", "Failed to apply patches[%zu]", failed);
+        return false;
+    }
+
+    uint64_t ns;
+    absolutetime_to_nanoseconds(mach_absolute_time() - start, &ns);
+    DBGLOG("patcher+", "Committed %zu routes, %zu patches and %zu writes for kext %zu in %llu ns", routeCount,
+        this->patchCount, this->writeCount, this->index, ns);
     return true;
 }
@@ -2,6 +2,9 @@
 //  details.
 
 #pragma once
+#include "kern_machimage.hpp"
+#include "kern_pattern.hpp"
+#include "kern_symindex.hpp"
 #include <Headers/kern_patcher.hpp>
 
 struct SolveRequestPlus : KernelPatcher::SolveRequest {
@@ -9,6 +12,7 @@ struct SolveRequestPlus : KernelPatcher::SolveRequest {
     const uint8_t *mask {nullptr};
     size_t patternSize {0};
     bool guard {true};
+    KextSection section {KextSection::Whole};
 
     template<typename T>
     SolveRequestPlus(const char *s, T &addr, bool guard = true) : KernelPatcher::SolveRequest(s, addr), guard {guard} {}
@@ -21,7 +25,16 @@ struct SolveRequestPlus : KernelPatcher::SolveRequest {
     SolveRequestPlus(const char *s, T &addr, const P (&pattern)[N], const uint8_t (&mask)[N], bool guard = true)
         : KernelPatcher::SolveRequest(s, addr), pattern {pattern}, mask {mask}, patternSize {N}, guard {guard} {}
 
-    bool solve(KernelPatcher *patcher, size_t index, mach_vm_address_t address, size_t size);
+    bool solve(KernelPatcher *patcher, size_t index, mach_vm_address_t address, size_t size,
+        const SymbolIndex *symbols = nullptr);
+    bool solveSymbol(KernelPatcher *patcher, size_t index, const SymbolIndex *symbols);
+    bool solvePattern(mach_vm_address_t match);
+
+    /** Limits the pattern search to one section, the whole image by default */
+    SolveRequestPlus &&inSection(KextSection section) && {
+        this->section = section;
+        return static_cast<SolveRequestPlus &&>(*this);
+    }
 
     static bool solveAll(KernelPatcher *patcher, size_t index, SolveRequestPlus *requests, size_t count,
         mach_vm_address_t address, size_t size);
@@ -38,6 +51,7 @@ struct RouteRequestPlus : KernelPatcher::RouteRequest {
     const uint8_t *mask {nullptr};
     size_t patternSize {0};
     bool guard {true};
+    KextSection section {KextSection::Whole};
 
     template<typename T>
     RouteRequestPlus(const char *s, T t, mach_vm_address_t &o, bool guard = true)
@@ -75,7 +89,13 @@ struct RouteRequestPlus : KernelPatcher::RouteRequest {
     RouteRequestPlus(const char *s, T t, const P (&pattern)[N], const uint8_t (&mask)[N], bool guard = true)
         : KernelPatcher::RouteRequest(s, t), pattern {pattern}, mask {mask}, patternSize {N}, guard {guard} {}
 
-    bool route(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size);
+    bool routePattern(KernelPatcher &patcher, mach_vm_address_t match);
+
+    /** Limits the pattern search to one section, the whole image by default */
+    RouteRequestPlus &&inSection(KextSection section) && {
+        this->section = section;
+        return static_cast<RouteRequestPlus &&>(*this);
+    }
 
     static bool routeAll(KernelPatcher &patcher, size_t index, RouteRequestPlus *requests, size_t count,
         mach_vm_address_t address, size_t size);
@@ -93,6 +113,7 @@ struct LookupPatchPlus : KernelPatcher::LookupPatch {
     const size_t replaceSize {0};
     const bool guard {true};
     const size_t skip {0};
+    KextSection section {KextSection::Whole};
 
     LookupPatchPlus(KernelPatcher::KextInfo *kext, const uint8_t *find, const uint8_t *replace, size_t size,
         size_t count, bool guard = true, size_t skip = 0)
@@ -122,7 +143,22 @@ struct LookupPatchPlus : KernelPatcher::LookupPatch {
         : KernelPatcher::LookupPatch {kext, find, replace, N, count}, findMask {findMask}, replaceMask {replaceMask},
           replaceSize {M}, guard {guard}, skip {skip} {}
 
+    /** Masks of the patch are only passed on where it has masked bytes */
+    template<size_t N>
+    LookupPatchPlus(KernelPatcher::KextInfo *kext, const BytePatch<N> &patch, size_t count, bool guard = true,
+        size_t skip = 0)
+        : KernelPatcher::LookupPatch {kext, patch.original.find, patch.patched.find, N, count},
+          findMask {patch.original.findMask()}, replaceMask {patch.patched.findMask()}, replaceSize {N},
+          guard {guard}, skip {skip} {}
+
+    /** Limits the search to one section, the whole image by default */
+    LookupPatchPlus &&inSection(KextSection section) && {
+        this->section = section;
+        return static_cast<LookupPatchPlus &&>(*this);
+    }
+
     bool apply(KernelPatcher *patcher, mach_vm_address_t address, size_t size) const;
+    bool usesLookupPatch(KernelPatcher *patcher) const;
 
     static bool applyAll(KernelPatcher *patcher, LookupPatchPlus const *patches, size_t count,
         mach_vm_address_t address, size_t size);
@@ -133,3 +169,70 @@ struct LookupPatchPlus : KernelPatcher::LookupPatch {
         return applyAll(patcher, patches, N, address, size);
     }
 };
+
+/**
+ * Everything a kext load callback changes in the kext, committed together.
+ * All routes go to Lilu in one batch, which toggles kernel writing on its own, so they go first; lookup patches
+ * that Lilu applies do the same.
+ * The remaining patches and the data writes then share a single kernel writing window.
+ */
+class PatchTransaction {
+    static constexpr size_t MaxRouteBatches = 4;
+    static constexpr size_t MaxPatches = 4;
+    static constexpr size_t MaxWrites = 16;
+    static constexpr size_t WritePoolSize = 256;
+
+    struct RouteBatch {
+        RouteRequestPlus *requests;
+        size_t count;
+    };
+
+    struct Patch {
+        const LookupPatchPlus *patch;
+        mach_vm_address_t address;
+        size_t size;
+    };
+
+    struct Write {
+        void *dest;
+        size_t offset;
+        size_t size;
+    };
+
+    KernelPatcher &patcher;
+    size_t index;
+    mach_vm_address_t address;
+    size_t size;
+    RouteBatch routes[MaxRouteBatches] {};
+    size_t routeBatchCount {0};
+    Patch patches[MaxPatches] {};
+    size_t patchCount {0};
+    Write writes[MaxWrites] {};
+    size_t writeCount {0};
+    /** The values to write, copied in so that callers don't need to keep them around */
+    uint8_t writePool[WritePoolSize] {};
+    size_t writePoolUsed {0};
+
+    void addWrite(void *dest, const void *value, size_t size);
+
+    public:
+    PatchTransaction(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size)
+        : patcher {patcher}, index {index}, address {address}, size {size} {}
+
+    void route(RouteRequestPlus *requests, size_t count);
+
+    template<size_t N>
+    void route(RouteRequestPlus (&requests)[N]) {
+        this->route(requests, N);
+    }
+
+    /** The patch must outlive the transaction */
+    void apply(const LookupPatchPlus &patch, mach_vm_address_t address, size_t size);
+
+    template<typename T>
+    void write(T *dest, const T &value) {
+        this->addWrite(dest, &value, sizeof(T));
+    }
+
+    bool commit();
+};
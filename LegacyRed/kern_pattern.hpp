@@ -0,0 +1,145 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+#ifndef kern_pattern_hpp
+#define kern_pattern_hpp
+#include <Headers/kern_util.hpp>
+
+/** Which bytes of a pattern are masked, picks the matcher */
+enum struct PatternKind : uint8_t {
+    /** No mask, or every mask byte is `0xFF` */
+    Exact = 0,
+    /** Mask bytes are either `0x00` or `0xFF` */
+    Wildcard,
+    /** At least one byte is partially masked */
+    Masked,
+};
+
+constexpr PatternKind patternKindOf(const uint8_t *mask, size_t size) {
+    auto kind = PatternKind::Exact;
+    for (size_t i = 0; mask && i < size; i++) {
+        if (mask[i] == 0xFF) { continue; }
+        if (mask[i]) { return PatternKind::Masked; }
+        kind = PatternKind::Wildcard;
+    }
+    return kind;
+}
+
+template<PatternKind K>
+struct PatternMatcher;
+
+template<>
+struct PatternMatcher<PatternKind::Exact> {
+    static bool matches(const uint8_t *data, const uint8_t *bytes, const uint8_t *, size_t size) {
+        return !memcmp(data, bytes, size);
+    }
+};
+
+template<>
+struct PatternMatcher<PatternKind::Wildcard> {
+    static bool matches(const uint8_t *data, const uint8_t *bytes, const uint8_t *mask, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            if (mask[i] && data[i] != bytes[i]) { return false; }
+        }
+        return true;
+    }
+};
+
+/** Compares eight bytes at a time, the x86 loads don't need to be aligned */
+template<>
+struct PatternMatcher<PatternKind::Masked> {
+    static bool matches(const uint8_t *data, const uint8_t *bytes, const uint8_t *mask, size_t size) {
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+            uint64_t d, b, m;
+            memcpy(&d, data + i, sizeof(d));
+            memcpy(&b, bytes + i, sizeof(b));
+            memcpy(&m, mask + i, sizeof(m));
+            if ((d ^ b) & m) { return false; }
+        }
+        for (; i < size; i++) {
+            if ((data[i] ^ bytes[i]) & mask[i]) { return false; }
+        }
+        return true;
+    }
+};
+
+inline bool patternMatches(PatternKind kind, const uint8_t *data, const uint8_t *bytes, const uint8_t *mask,
+    size_t size) {
+    switch (kind) {
+        case PatternKind::Exact:
+            return PatternMatcher<PatternKind::Exact>::matches(data, bytes, mask, size);
+        case PatternKind::Wildcard:
+            return PatternMatcher<PatternKind::Wildcard>::matches(data, bytes, mask, size);
+        case PatternKind::Masked:
+            return PatternMatcher<PatternKind::Masked>::matches(data, bytes, mask, size);
+    }
+    return false;
+}
+
+template<size_t N>
+struct BytePattern {
+    uint8_t find[N] {};
+    uint8_t mask[N] {};
+    PatternKind kind {PatternKind::Exact};
+
+    /** What `KernelPatcher` expects, no mask for exact patterns */
+    constexpr const uint8_t *findMask() const { return this->kind == PatternKind::Exact ? nullptr : this->mask; }
+};
+
+template<size_t N>
+struct BytePatch {
+    BytePattern<N> original;
+    BytePattern<N> patched;
+
+    static constexpr size_t size = N;
+};
+
+// Deliberately not constexpr, reaching it while parsing fails the build
+void invalidPatternCharacter();
+
+namespace PatternParser {
+    constexpr uint8_t nibble(char c) {
+        if (c >= '0' && c <= '9') { return static_cast<uint8_t>(c - '0'); }
+        if (c >= 'A' && c <= 'F') { return static_cast<uint8_t>(c - 'A' + 10); }
+        if (c >= 'a' && c <= 'f') { return static_cast<uint8_t>(c - 'a' + 10); }
+        invalidPatternCharacter();
+        return 0;
+    }
+
+    template<size_t N, size_t L>
+    constexpr BytePattern<N> parse(const char (&str)[L]) {
+        BytePattern<N> pattern {};
+        for (size_t i = 0; i < N; i++) {
+            auto *hex = str + i * 3;
+            if (hex[2] != (i + 1 == N ? '\0' : ' ')) { invalidPatternCharacter(); }
+            for (size_t j = 0; j < 2; j++) {
+                auto shift = j ? 0 : 4;
+                if (hex[j] == '?') { continue; }
+                pattern.find[i] |= static_cast<uint8_t>(nibble(hex[j]) << shift);
+                pattern.mask[i] |= static_cast<uint8_t>(0xF << shift);
+            }
+        }
+        pattern.kind = patternKindOf(pattern.mask, N);
+        return pattern;
+    }
+}    // namespace PatternParser
+
+/**
+ * Parses an IDA-style pattern at compile time, e.g. `"40 83 F? 02"`.
+ * Bytes are two hex digits separated by single spaces, `?` masks a nibble.
+ */
+template<size_t L>
+constexpr BytePattern<L / 3> makePattern(const char (&str)[L]) {
+    static_assert(L >= 3 && L % 3 == 0, "Malformed pattern");
+    return PatternParser::parse<L / 3>(str);
+}
+
+/** A find and replace pair; both have to be of the same length */
+template<size_t L, size_t M>
+constexpr BytePatch<L / 3> makePatch(const char (&original)[L], const char (&patched)[M]) {
+    static_assert(L == M, "Original and patched sizes differ");
+    return {makePattern(original), makePattern(patched)};
+}
+
+#endif /* kern_pattern_hpp */
@@ -0,0 +1,58 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+#include "kern_patternscan.hpp"
+
+size_t PatternScanner::add(const uint8_t *pattern, const uint8_t *mask, size_t size) {
+    if (this->patternCount >= MaxPatterns || !pattern || !size) { return NotFound; }
+
+    // The byte with the most unmasked bits lets the fewest positions through
+    size_t anchor = 0;
+    if (mask) {
+        int bestBits = -1;
+        for (size_t i = 0; i < size && bestBits < 8; i++) {
+            auto bits = __builtin_popcount(mask[i]);
+            if (bits > bestBits) {
+                bestBits = bits;
+                anchor = i;
+            }
+        }
+    }
+
+    auto slot = this->patternCount++;
+    this->patterns[slot] = {pattern, mask, size, anchor, patternKindOf(mask, size)};
+    this->offsets[slot] = NotFound;
+    auto anchorMask = mask ? mask[anchor] : 0xFF;
+    for (size_t b = 0; b < 256; b++) {
+        if ((b & anchorMask) == (pattern[anchor] & anchorMask)) { this->anchorMap[b] |= 1U << slot; }
+    }
+    return slot;
+}
+
+void PatternScanner::scan(const void *data, size_t dataSize) {
+    auto *bytes = static_cast<const uint8_t *>(data);
+    uint32_t pending = 0;
+    for (size_t slot = 0; slot < this->patternCount; slot++) {
+        this->offsets[slot] = NotFound;
+        if (this->patterns[slot].size <= dataSize) { pending |= 1U << slot; }
+    }
+
+    for (size_t i = 0; pending && i < dataSize; i++) {
+        auto candidates = this->anchorMap[bytes[i]] & pending;
+        if (LIKELY(!candidates)) { continue; }
+
+        while (candidates) {
+            auto slot = static_cast<size_t>(__builtin_ctz(candidates));
+            candidates &= candidates - 1;
+            auto &pattern = this->patterns[slot];
+            if (i < pattern.anchor) { continue; }
+            auto start = i - pattern.anchor;
+            if (start > dataSize - pattern.size ||
+                !patternMatches(pattern.kind, bytes + start, pattern.bytes, pattern.mask, pattern.size)) {
+                continue;
+            }
+            this->offsets[slot] = start;
+            pending &= ~(1U << slot);
+        }
+    }
+}
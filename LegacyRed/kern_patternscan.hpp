@@ -0,0 +1,43 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+#ifndef kern_patternscan_hpp
+#define kern_patternscan_hpp
+#include "kern_pattern.hpp"
+#include <Headers/kern_util.hpp>
+
+/**
+ * Finds the first match of several masked patterns in a single walk over the image.
+ * Every pattern is keyed on its most selective byte, so most positions cost one table lookup.
+ * Semantics match `KernelPatcher::findPattern`: a data byte matches when it equals the pattern byte under the mask.
+ * Candidates are then checked with the matcher for the kind of mask the pattern has.
+ */
+class PatternScanner {
+    public:
+    static constexpr size_t MaxPatterns = 32;
+    static constexpr size_t NotFound = ~static_cast<size_t>(0);
+
+    /** Returns the slot of the pattern, or `NotFound` when the scanner is full */
+    size_t add(const uint8_t *pattern, const uint8_t *mask, size_t size);
+    void scan(const void *data, size_t dataSize);
+    size_t count() const { return this->patternCount; }
+    /** Offset of the first match of the pattern in `slot` by the last `scan`, or `NotFound` */
+    size_t offset(size_t slot) const { return this->offsets[slot]; }
+
+    private:
+    struct Pattern {
+        const uint8_t *bytes;
+        const uint8_t *mask;
+        size_t size;
+        size_t anchor;
+        PatternKind kind;
+    };
+
+    Pattern patterns[MaxPatterns] {};
+    size_t offsets[MaxPatterns] {};
+    size_t patternCount {0};
+    /** Per byte value, bitmask of the patterns whose anchor accepts it */
+    uint32_t anchorMap[256] {};
+};
+
+#endif /* kern_patternscan_hpp */
@@ -0,0 +1,159 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+#include "kern_regaccess.hpp"
+#include "kern_amd.hpp"
+
+bool RegisterAccess::init(volatile uint32_t *mmio, size_t length) {
+    if (!mmio || length <= mmPCIE_DATA2 * sizeof(uint32_t)) {
+        SYSLOG("regaccess", "RMMIO mapping is too small");
+        return false;
+    }
+    if (!this->indexLock) {
+        this->indexLock = IOSimpleLockAlloc();
+        if (!this->indexLock) {
+            SYSLOG("regaccess", "Failed to allocate index lock");
+            return false;
+        }
+    }
+    this->directCount = static_cast<uint32_t>(length / sizeof(uint32_t));
+    this->mmio = mmio;
+    this->invalidate();
+    return true;
+}
+
+bool RegisterAccess::shadow(const RegShadow *regs, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (regs[i].policy == RegPolicy::Volatile || this->findShadow(regs[i].reg)) { continue; }
+        if (this->shadowCount >= MaxShadowed) {
+            SYSLOG("regaccess", "Too many shadowed registers");
+            return false;
+        }
+        this->shadowed[this->shadowCount++] = {regs[i].reg, regs[i].policy, false, 0};
+        this->shadowFilter |= 1ULL << (regs[i].reg % 64);
+    }
+    return true;
+}
+
+void RegisterAccess::invalidate() {
+    if (this->indexLock) { IOSimpleLockLock(this->indexLock); }
+    for (size_t i = 0; i < this->shadowCount; i++) {
+        __atomic_store_n(&this->shadowed[i].valid, false, __ATOMIC_RELEASE);
+    }
+    if (this->indexLock) { IOSimpleLockUnlock(this->indexLock); }
+}
+
+RegisterAccess::ShadowEntry *RegisterAccess::findShadow(uint32_t reg) {
+    if (LIKELY(!(this->shadowFilter & (1ULL << (reg % 64))))) { return nullptr; }
+    for (size_t i = 0; i < this->shadowCount; i++) {
+        if (this->shadowed[i].reg == reg) { return &this->shadowed[i]; }
+    }
+    return nullptr;
+}
+
+void RegisterAccess::updateShadow(ShadowEntry *entry, uint32_t value) {
+    if (!entry) { return; }
+    __atomic_store_n(&entry->value, value, __ATOMIC_RELAXED);
+    __atomic_store_n(&entry->valid, true, __ATOMIC_RELEASE);
+}
+
+void RegisterAccess::recordWrite(uint32_t reg, uint32_t value) {
+    auto *entry = this->findShadow(reg);
+    if (!entry) { return; }
+    // An immutable register got written after all, the next read has to see what the hardware made of it
+    if (entry->policy == RegPolicy::Immutable) {
+        __atomic_store_n(&entry->valid, false, __ATOMIC_RELEASE);
+    } else {
+        this->updateShadow(entry, value);
+    }
+}
+
+volatile uint32_t &RegisterAccess::selectIndirect(uint32_t reg) {
+    this->mmio[mmPCIE_INDEX2] = reg;
+    // Read back so that the index write has landed before the data access
+    (void)this->mmio[mmPCIE_INDEX2];
+    return this->mmio[mmPCIE_DATA2];
+}
+
+uint32_t RegisterAccess::readLocked(uint32_t reg) {
+    __atomic_fetch_add(&this->forwarded, 1, __ATOMIC_RELAXED);
+    auto direct = this->isDirect(reg);
+    uint32_t value = direct ? this->mmio[reg] : this->selectIndirect(reg);
+    this->trace.record(MMIOAccess::Read, reg, value, !direct);
+    return value;
+}
+
+void RegisterAccess::writeLocked(uint32_t reg, uint32_t value) {
+    auto direct = this->isDirect(reg);
+    (direct ? this->mmio[reg] : this->selectIndirect(reg)) = value;
+    this->trace.record(MMIOAccess::Write, reg, value, !direct);
+    this->recordWrite(reg, value);
+}
+
+uint32_t RegisterAccess::read(uint32_t reg) {
+    auto *entry = this->findShadow(reg);
+    if (LIKELY(!entry) && this->isDirect(reg)) {
+        __atomic_fetch_add(&this->forwarded, 1, __ATOMIC_RELAXED);
+        uint32_t value = this->mmio[reg];
+        this->trace.record(MMIOAccess::Read, reg, value, false);
+        return value;
+    }
+    if (entry && __atomic_load_n(&entry->valid, __ATOMIC_ACQUIRE)) {
+        __atomic_fetch_add(&this->served, 1, __ATOMIC_RELAXED);
+        return __atomic_load_n(&entry->value, __ATOMIC_RELAXED);
+    }
+    // A write can't slip in between reading the hardware and keeping the value
+    IOSimpleLockLock(this->indexLock);
+    uint32_t value;
+    if (entry && __atomic_load_n(&entry->valid, __ATOMIC_ACQUIRE)) {
+        __atomic_fetch_add(&this->served, 1, __ATOMIC_RELAXED);
+        value = __atomic_load_n(&entry->value, __ATOMIC_RELAXED);
+    } else {
+        value = this->readLocked(reg);
+        this->updateShadow(entry, value);
+    }
+    IOSimpleLockUnlock(this->indexLock);
+    return value;
+}
+
+void RegisterAccess::write(uint32_t reg, uint32_t value) {
+    if (LIKELY(!this->findShadow(reg)) && this->isDirect(reg)) {
+        this->mmio[reg] = value;
+        this->trace.record(MMIOAccess::Write, reg, value, false);
+        return;
+    }
+    IOSimpleLockLock(this->indexLock);
+    this->writeLocked(reg, value);
+    IOSimpleLockUnlock(this->indexLock);
+}
+
+void RegisterAccess::apply(const RegOp *ops, size_t count) {
+    IOSimpleLockLock(this->indexLock);
+    volatile uint32_t *data = nullptr;
+    uint32_t selected = 0;
+    for (size_t i = 0; i < count; i++) {
+        auto &op = ops[i];
+        volatile uint32_t *target;
+        if (this->isDirect(op.reg)) {
+            target = &this->mmio[op.reg];
+        } else {
+            if (!data || selected != op.reg) {
+                data = &this->selectIndirect(op.reg);
+                selected = op.reg;
+            }
+            target = data;
+        }
+        auto indirect = target == data;
+        uint32_t value = op.value;
+        if (op.mask != ~0U) {
+            __atomic_fetch_add(&this->forwarded, 1, __ATOMIC_RELAXED);
+            value = *target;
+            this->trace.record(MMIOAccess::Read, op.reg, value, indirect);
+            value = (value & ~op.mask) | (op.value & op.mask);
+        }
+        *target = value;
+        this->trace.record(MMIOAccess::Write, op.reg, value, indirect);
+        this->recordWrite(op.reg, value);
+    }
+    IOSimpleLockUnlock(this->indexLock);
+}
@@ -0,0 +1,105 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+#ifndef kern_regaccess_hpp
+#define kern_regaccess_hpp
+#include "kern_mmiotrace.hpp"
+#include <Headers/kern_util.hpp>
+#include <IOKit/IOLocks.h>
+
+/** Replaces the bits of `mask` in `reg` with those of `value`; a full mask writes without reading */
+struct RegOp {
+    uint32_t reg;
+    uint32_t mask;
+    uint32_t value;
+};
+
+/** How reads of a register may be served from memory */
+enum struct RegPolicy : uint8_t {
+    /** Always read from the hardware */
+    Volatile = 0,
+    /** Doesn't change after the ASIC is initialised, read once */
+    Immutable,
+    /** Only changed by us, so the last value written or read is current */
+    WriteThrough,
+};
+
+struct RegShadow {
+    uint32_t reg;
+    RegPolicy policy;
+};
+
+/**
+ * MMIO register access through the RMMIO BAR.
+ * Registers past the mapping go through the `mmPCIE_INDEX2`/`mmPCIE_DATA2` pair, which is shared by everyone, so
+ * those accesses hold a spinlock from the index write until the data access is done.
+ * Registers declared with `shadow` are kept in memory according to their policy; their accesses also take the
+ * lock whenever they reach the hardware, so that the shadow is only ever changed together with the register.
+ * Accesses that reach the hardware go to `recorder` once it is enabled.
+ */
+class RegisterAccess {
+    public:
+    bool init(volatile uint32_t *mmio, size_t length);
+    bool isMapped() const { return this->mmio; }
+
+    bool shadow(const RegShadow *regs, size_t count);
+
+    template<size_t N>
+    bool shadow(const RegShadow (&regs)[N]) {
+        return this->shadow(regs, N);
+    }
+
+    /** Forget all shadowed values, for after the ASIC has been reset or resumed */
+    void invalidate();
+    /** Counters of reads served from the shadow and reads that went to the hardware */
+    const uint64_t *servedReads() const { return &this->served; }
+    const uint64_t *forwardedReads() const { return &this->forwarded; }
+
+    MMIORecorder &recorder() { return this->trace; }
+
+    uint32_t read(uint32_t reg);
+    void write(uint32_t reg, uint32_t value);
+
+    /**
+     * Applies the operations in order under a single hold of the lock.
+     * The index is written once for each run of operations on the same indirect register.
+     */
+    void apply(const RegOp *ops, size_t count);
+
+    template<size_t N>
+    void apply(const RegOp (&ops)[N]) {
+        this->apply(ops, N);
+    }
+
+    private:
+    struct ShadowEntry {
+        uint32_t reg;
+        RegPolicy policy;
+        bool valid;
+        uint32_t value;
+    };
+
+    static constexpr size_t MaxShadowed = 16;
+
+    volatile uint32_t *mmio {nullptr};
+    /** Registers below this are reachable through the mapping */
+    uint32_t directCount {0};
+    IOSimpleLock *indexLock {nullptr};
+    ShadowEntry shadowed[MaxShadowed] {};
+    size_t shadowCount {0};
+    /** Bit `reg % 64` is set for every shadowed register, lets most reads skip the table */
+    uint64_t shadowFilter {0};
+    uint64_t served {0};
+    uint64_t forwarded {0};
+    MMIORecorder trace;
+
+    bool isDirect(uint32_t reg) const { return reg < this->directCount; }
+    volatile uint32_t &selectIndirect(uint32_t reg);
+    ShadowEntry *findShadow(uint32_t reg);
+    void updateShadow(ShadowEntry *entry, uint32_t value);
+    void recordWrite(uint32_t reg, uint32_t value);
+    uint32_t readLocked(uint32_t reg);
+    void writeLocked(uint32_t reg, uint32_t value);
+};
+
+#endif /* kern_regaccess_hpp */
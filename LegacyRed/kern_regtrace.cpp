@@ -0,0 +1,58 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+#include "kern_regtrace.hpp"
+#include <Headers/kern_util.hpp>
+#include <IOKit/IORegistryEntry.h>
+#include <libkern/c++/OSData.h>
+#include <libkern/c++/OSDictionary.h>
+#include <libkern/c++/OSNumber.h>
+
+static bool setNumber(OSDictionary *dict, const char *key, uint64_t value) {
+    auto *number = OSNumber::withNumber(value, 64);
+    if (!number) { return false; }
+    auto ret = dict->setObject(key, number);
+    number->release();
+    return ret;
+}
+
+void RegTracer::publish(IORegistryEntry *entry) const {
+    if (!entry) { return; }
+
+    static constexpr size_t MaxRecords = MaxCPUs * RegTraceRing::Size;
+    auto *records = Buffer::create<RegTraceRecord>(MaxRecords);
+    auto *regCounts = Buffer::create<RegTraceCount>(RegTraceHistogram::Size);
+    auto *trace = OSDictionary::withCapacity(4);
+    auto *histogram = OSDictionary::withCapacity(64);
+    if (!records || !regCounts || !trace || !histogram) {
+        SYSLOG("regtrace", "Failed to allocate the register trace");
+        if (records) { Buffer::deleter(records); }
+        if (regCounts) { Buffer::deleter(regCounts); }
+        OSSafeReleaseNULL(trace);
+        OSSafeReleaseNULL(histogram);
+        return;
+    }
+
+    auto regCount = this->counts(regCounts, RegTraceHistogram::Size);
+    for (size_t i = 0; i < regCount; i++) {
+        char name[16];
+        snprintf(name, arrsize(name), "0x%X", regCounts[i].reg);
+        setNumber(histogram, name, regCounts[i].count);
+    }
+    trace->setObject("Histogram", histogram);
+    histogram->release();
+
+    auto recordCount = this->snapshot(records, MaxRecords);
+    auto *recent = OSData::withBytes(records, static_cast<unsigned int>(recordCount * sizeof(RegTraceRecord)));
+    if (recent) {
+        trace->setObject("Recent", recent);
+        recent->release();
+    }
+    setNumber(trace, "Total", this->total());
+    setNumber(trace, "Overflowed", this->overflowed());
+    entry->setProperty("LRedRegTrace", trace);
+    trace->release();
+
+    Buffer::deleter(records);
+    Buffer::deleter(regCounts);
+}
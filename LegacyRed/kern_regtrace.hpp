@@ -0,0 +1,174 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+#ifndef kern_regtrace_hpp
+#define kern_regtrace_hpp
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// The rings and the histogram only need the compiler builtins, so they can be exercised outside of the kernel.
+// Publishing lives in kern_regtrace.cpp.
+
+class IORegistryEntry;
+
+/** Published as is in `Recent`, keep in sync with Scripts/RegTrace.py */
+struct RegTraceRecord {
+    /** Slot number + 1, 0 while the record is being written */
+    uint64_t sequence;
+    uint64_t timestamp;
+    /** Offset of the caller in the controller kext, 0 if it was called from elsewhere */
+    uint64_t caller;
+    uint32_t reg;
+    uint32_t value;
+    uint8_t width;
+    uint8_t cpu;
+    uint8_t reserved[6];
+};
+static_assert(sizeof(RegTraceRecord) == 40, "RegTraceRecord layout changed");
+
+/**
+ * Overwriting ring of the latest accesses.
+ * Writers claim a slot with an atomic increment, so a thread preempted onto another CPU can't corrupt it;
+ * readers skip slots whose sequence changes while they are copied.
+ */
+class RegTraceRing {
+    public:
+    static constexpr size_t Size = 128;
+    static_assert((Size & (Size - 1)) == 0, "Ring size must be a power of two");
+
+    void push(RegTraceRecord record) {
+        auto slot = __atomic_fetch_add(&this->head, 1, __ATOMIC_RELAXED);
+        auto &entry = this->records[slot & (Size - 1)];
+        __atomic_store_n(&entry.sequence, 0, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        record.sequence = 0;
+        memcpy(&entry, &record, sizeof(entry));
+        __atomic_store_n(&entry.sequence, slot + 1, __ATOMIC_RELEASE);
+    }
+
+    /** Copies out the consistent records, oldest first */
+    size_t snapshot(RegTraceRecord *out, size_t max) const {
+        auto end = __atomic_load_n(&this->head, __ATOMIC_ACQUIRE);
+        auto start = end > Size ? end - Size : 0;
+        size_t count = 0;
+        for (auto slot = start; slot < end && count < max; slot++) {
+            auto &entry = this->records[slot & (Size - 1)];
+            auto sequence = __atomic_load_n(&entry.sequence, __ATOMIC_ACQUIRE);
+            if (sequence != slot + 1) { continue; }
+            memcpy(&out[count], &entry, sizeof(entry));
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&entry.sequence, __ATOMIC_RELAXED) != sequence) { continue; }
+            out[count++].sequence = sequence;
+        }
+        return count;
+    }
+
+    uint64_t written() const { return __atomic_load_n(&this->head, __ATOMIC_RELAXED); }
+
+    private:
+    uint64_t head {0};
+    RegTraceRecord records[Size] {};
+};
+
+struct RegTraceCount {
+    uint32_t reg;
+    uint32_t count;
+};
+
+/**
+ * Access count per register, open addressed with a short linear probe.
+ * Slots are claimed with a compare and swap of the key and never freed.
+ */
+class RegTraceHistogram {
+    public:
+    static constexpr size_t Bits = 9;
+    static constexpr size_t Size = 1 << Bits;
+    static constexpr size_t MaxProbe = 8;
+
+    void add(uint32_t reg) {
+        // Register 0 is valid, keep 0 for empty slots
+        auto key = reg + 1;
+        auto index = (reg * 0x9E3779B1U) >> (32 - Bits);
+        for (size_t i = 0; i < MaxProbe; i++) {
+            auto &bucket = this->buckets[(index + i) & (Size - 1)];
+            auto current = __atomic_load_n(&bucket.reg, __ATOMIC_RELAXED);
+            // On failure `current` holds whichever register won the slot
+            if (!current &&
+                __atomic_compare_exchange_n(&bucket.reg, &current, key, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                current = key;
+            }
+            if (current != key) { continue; }
+            __atomic_fetch_add(&bucket.count, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        __atomic_fetch_add(&this->overflow, 1, __ATOMIC_RELAXED);
+    }
+
+    size_t snapshot(RegTraceCount *out, size_t max) const {
+        size_t count = 0;
+        for (size_t i = 0; i < Size && count < max; i++) {
+            auto key = __atomic_load_n(&this->buckets[i].reg, __ATOMIC_RELAXED);
+            if (!key) { continue; }
+            out[count++] = {key - 1, __atomic_load_n(&this->buckets[i].count, __ATOMIC_RELAXED)};
+        }
+        return count;
+    }
+
+    /** Accesses to registers that found no free slot */
+    uint64_t overflowed() const { return __atomic_load_n(&this->overflow, __ATOMIC_RELAXED); }
+
+    private:
+    struct Bucket {
+        uint32_t reg;
+        uint32_t count;
+    };
+
+    Bucket buckets[Size] {};
+    uint64_t overflow {0};
+};
+
+/**
+ * Register read tracer, replaces logging every read with `-lredregdbg`.
+ * One ring per CPU so concurrent readers rarely share a cache line; the CPU number only picks the ring.
+ */
+class RegTracer {
+    public:
+    static constexpr size_t MaxCPUs = 8;
+
+    void record(uint32_t cpu, uint8_t width, uint32_t reg, uint32_t value, uint64_t caller, uint64_t timestamp) {
+        auto &ring = this->rings[cpu & (MaxCPUs - 1)];
+        ring.push({0, timestamp, caller, reg, value, width, static_cast<uint8_t>(cpu), {}});
+        this->histogram.add(reg);
+    }
+
+    /** Records of every CPU, oldest first per CPU; returns how many were copied */
+    size_t snapshot(RegTraceRecord *out, size_t max) const {
+        size_t count = 0;
+        for (size_t i = 0; i < MaxCPUs && count < max; i++) {
+            count += this->rings[i].snapshot(out + count, max - count);
+        }
+        return count;
+    }
+
+    size_t counts(RegTraceCount *out, size_t max) const { return this->histogram.snapshot(out, max); }
+
+    uint64_t total() const {
+        uint64_t total = 0;
+        for (size_t i = 0; i < MaxCPUs; i++) { total += this->rings[i].written(); }
+        return total;
+    }
+
+    uint64_t overflowed() const { return this->histogram.overflowed(); }
+
+    /** Publishes `LRedRegTrace`; allocates, so never call it from the traced path */
+    void publish(IORegistryEntry *entry) const;
+
+    private:
+    static_assert((MaxCPUs & (MaxCPUs - 1)) == 0, "CPU count must be a power of two");
+
+    RegTraceRing rings[MaxCPUs] {};
+    RegTraceHistogram histogram;
+};
+
+#endif /* kern_regtrace_hpp */
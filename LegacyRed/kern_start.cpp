@@ -51,7 +51,7 @@ bool PRODUCT_NAME::start(IOService *provider) {
     }
 
     if (!(lilu.getRunMode() & LiluAPI::RunningInstallerRecovery) && ADDPR(startSuccess) &&
-        !checkKernelArgument("-lredfbonly")) {
+        !lred.isFramebufferOnly()) {
         auto *prop = OSDynamicCast(OSArray, this->getProperty("Drivers"));
         if (!prop) {
             SYSLOG("init", "Failed to get Drivers property");
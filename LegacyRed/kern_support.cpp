@@ -2,8 +2,8 @@
 //  details.
 
 #include "kern_support.hpp"
+#include "kern_devicedb.hpp"
 #include "kern_lred.hpp"
-#include "kern_model.hpp"
 #include "kern_patches.hpp"
 #include <Headers/kern_api.hpp>
 
@@ -16,39 +16,32 @@ Support *Support::callback = nullptr;
 
 void Support::init() {
     callback = this;
-    lilu.onKextLoadForce(&kextRadeonSupport);
+    LRed::callback->kexts.add<Support, &Support::processKext>(&kextRadeonSupport, "support", this);
 }
 
-bool Support::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size) {
-    if (kextRadeonSupport.loadIndex == index) {
-        LRed::callback->setRMMIOIfNecessary();
-        auto highsierra = getKernelVersion() == KernelVersion::HighSierra;
-
-        RouteRequestPlus requests[] = {
-            {"__ZN13ATIController20populateDeviceMemoryE13PCI_REG_INDEX", wrapPopulateDeviceMemory,
-                orgPopulateDeviceMemory},
-            {"__ZN16AtiDeviceControl16notifyLinkChangeE31kAGDCRegisterLinkControlEvent_tmj", wrapNotifyLinkChange,
-                orgNotifyLinkChange},
-            {"__ZN13ATIController8TestVRAME13PCI_REG_INDEXb", doNotTestVram},
-            {"__ZN30AtiObjectInfoTableInterface_V120getAtomConnectorInfoEjRNS_17AtomConnectorInfoE",
-                wrapGetAtomConnectorInfo, orgGetAtomConnectorInfo},
-            {"__ZN30AtiObjectInfoTableInterface_V121getNumberOfConnectorsEv", wrapGetNumberOfConnectors,
-                orgGetNumberOfConnectors},
-        };
-        PANIC_COND(!RouteRequestPlus::routeAll(patcher, index, requests, address, size), "support",
-            "Failed to route symbols");
-
-        LookupPatchPlus const patches[] = {
-            {&kextRadeonSupport, kVRAMInfoNullCheckOriginal, kVRAMInfoNullCheckPatched,
-                arrsize(kVRAMInfoNullCheckOriginal), 1, !highsierra},
-        };
-        PANIC_COND(!LookupPatchPlus::applyAll(&patcher, patches, address, size), "support",
-            "Failed to apply patches: %d", patcher.getError());
-
-        return true;
-    }
-
-    return false;
+void Support::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size) {
+    LRed::callback->setRMMIOIfNecessary();
+    auto highsierra = getKernelVersion() == KernelVersion::HighSierra;
+
+    RouteRequestPlus requests[] = {
+        {"__ZN13ATIController20populateDeviceMemoryE13PCI_REG_INDEX", wrapPopulateDeviceMemory,
+            orgPopulateDeviceMemory},
+        {"__ZN16AtiDeviceControl16notifyLinkChangeE31kAGDCRegisterLinkControlEvent_tmj", wrapNotifyLinkChange,
+            orgNotifyLinkChange},
+        {"__ZN13ATIController8TestVRAME13PCI_REG_INDEXb", doNotTestVram},
+        {"__ZN30AtiObjectInfoTableInterface_V120getAtomConnectorInfoEjRNS_17AtomConnectorInfoE",
+            wrapGetAtomConnectorInfo, orgGetAtomConnectorInfo},
+        {"__ZN30AtiObjectInfoTableInterface_V121getNumberOfConnectorsEv", wrapGetNumberOfConnectors,
+            orgGetNumberOfConnectors},
+    };
+    PANIC_COND(!RouteRequestPlus::routeAll(patcher, index, requests, address, size), "support",
+        "Failed to route symbols");
+
+    LookupPatchPlus const patches[] = {
+        LookupPatchPlus {&kextRadeonSupport, kVRAMInfoNullCheck, 1, !highsierra}.inSection(KextSection::Text),
+    };
+    PANIC_COND(!LookupPatchPlus::applyAll(&patcher, patches, address, size), "support",
+        "Failed to apply patches: %d", patcher.getError());
 }
 
 IOReturn Support::wrapPopulateDeviceMemory(void *that, uint32_t reg) {
@@ -82,7 +82,6 @@ class Support {
     public:
     static Support *callback;
     void init();
-    bool processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size);
 
     private:
     mach_vm_address_t orgPopulateDeviceMemory {0};
@@ -90,6 +89,8 @@ class Support {
     mach_vm_address_t orgGetAtomConnectorInfo {0};
     mach_vm_address_t orgGetNumberOfConnectors {0};
 
+    void processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size);
+
     static bool wrapNotifyLinkChange(void *atiDeviceControl, kAGDCRegisterLinkControlEvent_t event, void *eventData,
         uint32_t eventFlags);
     static bool doNotTestVram(IOService *ctrl, uint32_t reg, bool retryOnFail);
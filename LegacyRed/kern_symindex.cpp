@@ -0,0 +1,151 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+#include "kern_symindex.hpp"
+#include "kern_kextplans.hpp"
+#include "kern_machimage.hpp"
+#include <mach-o/loader.h>
+#include <mach-o/nlist.h>
+
+static SymbolIndex symbolIndex;
+
+static uint32_t hashSymbol(const char *symbol) {
+    uint32_t hash = 0x811C9DC5;
+    while (*symbol) { hash = (hash ^ static_cast<uint8_t>(*symbol++)) * 0x01000193; }
+    return hash;
+}
+
+SymbolIndex *SymbolIndex::forKext(mach_vm_address_t address, size_t size) {
+    if (symbolIndex.address != address || symbolIndex.size != size) {
+        symbolIndex.reset();
+        symbolIndex.address = address;
+        symbolIndex.size = size;
+        uint64_t start = mach_absolute_time();
+        if (symbolIndex.build()) {
+            uint64_t ns;
+            absolutetime_to_nanoseconds(mach_absolute_time() - start, &ns);
+            DBGLOG("symindex", "Indexed kext at 0x%llX in %llu ns", address, ns);
+        }
+    }
+    return &symbolIndex;
+}
+
+void SymbolIndex::release() {
+    symbolIndex.reset();
+    symbolIndex.address = 0;
+    symbolIndex.size = 0;
+}
+
+void SymbolIndex::reset() {
+    if (this->slots) {
+        Buffer::deleter(this->slots);
+        this->slots = nullptr;
+    }
+    this->slotCount = 0;
+    this->plan = nullptr;
+    this->symbols = nullptr;
+    this->strings = nullptr;
+}
+
+bool SymbolIndex::build() {
+    auto *image = MachImage::forKext(this->address, this->size);
+    auto *uuid = image->getUUID();
+    for (size_t i = 0; uuid && i < arrsize(kextPlans); i++) {
+        auto &plan = kextPlans[i];
+        if ((plan.count || plan.patternCount) && !memcmp(plan.uuid, uuid, sizeof(plan.uuid))) {
+            DBGLOG("symindex", "Using the plan for kext at 0x%llX", this->address);
+            this->plan = &plan;
+            return true;
+        }
+    }
+
+    auto *symtab = image->getSymtab();
+    auto *linkedit = image->getLinkedit();
+    if (!symtab || !linkedit || !symtab->nsyms || symtab->symoff < linkedit->fileoff ||
+        symtab->stroff < linkedit->fileoff) {
+        DBGLOG("symindex", "No usable symbol table at 0x%llX", this->address);
+        return false;
+    }
+
+    this->slide = image->getSlide();
+    auto linkeditBase = linkedit->vmaddr + this->slide - linkedit->fileoff;
+    auto symbolsAddr = linkeditBase + symtab->symoff;
+    auto stringsAddr = linkeditBase + symtab->stroff;
+    if (!image->contains(symbolsAddr, static_cast<uint64_t>(symtab->nsyms) * sizeof(nlist_64)) ||
+        !image->contains(stringsAddr, symtab->strsize)) {
+        DBGLOG("symindex", "Symbol table of 0x%llX is outside of the image", this->address);
+        return false;
+    }
+    this->symbols = reinterpret_cast<const nlist_64 *>(symbolsAddr);
+    this->strings = reinterpret_cast<const char *>(stringsAddr);
+    this->stringsSize = symtab->strsize;
+
+    this->slotCount = 16;
+    while (this->slotCount < static_cast<size_t>(symtab->nsyms) * 2) { this->slotCount <<= 1; }
+    this->slots = Buffer::create<uint32_t>(this->slotCount);
+    if (!this->slots) {
+        SYSLOG("symindex", "Failed to allocate %zu slots", this->slotCount);
+        this->reset();
+        return false;
+    }
+    memset(this->slots, 0, this->slotCount * sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < symtab->nsyms; i++) {
+        auto &symbol = this->symbols[i];
+        if ((symbol.n_type & N_STAB) || (symbol.n_type & N_TYPE) != N_SECT || symbol.n_un.n_strx >= this->stringsSize) {
+            continue;
+        }
+        auto *name = this->strings + symbol.n_un.n_strx;
+        if (!name[0] || !memchr(name, 0, this->stringsSize - symbol.n_un.n_strx)) { continue; }
+        // Slots hold the symbol number plus one, zero is free
+        auto slot = hashSymbol(name) & (this->slotCount - 1);
+        while (this->slots[slot]) { slot = (slot + 1) & (this->slotCount - 1); }
+        this->slots[slot] = i + 1;
+    }
+    return true;
+}
+
+mach_vm_address_t SymbolIndex::solveFromPlan(const char *symbol) const {
+    size_t low = 0, high = this->plan->count;
+    while (low < high) {
+        auto mid = low + (high - low) / 2;
+        auto &entry = this->plan->symbols[mid];
+        auto cmp = strcmp(entry.symbol, symbol);
+        if (!cmp) { return entry.offset < this->size ? this->address + entry.offset : 0; }
+        if (cmp < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return 0;
+}
+
+mach_vm_address_t SymbolIndex::solve(const char *symbol) const {
+    if (!symbol) { return 0; }
+    if (this->plan) { return this->solveFromPlan(symbol); }
+    if (!this->slots) { return 0; }
+
+    auto slot = hashSymbol(symbol) & (this->slotCount - 1);
+    for (; this->slots[slot]; slot = (slot + 1) & (this->slotCount - 1)) {
+        auto &entry = this->symbols[this->slots[slot] - 1];
+        if (strcmp(this->strings + entry.n_un.n_strx, symbol)) { continue; }
+        auto value = entry.n_value + this->slide;
+        return (value >= this->address && value - this->address < this->size) ? value : 0;
+    }
+    return 0;
+}
+
+mach_vm_address_t SymbolIndex::findPattern(const uint8_t *pattern, const uint8_t *mask, size_t size) const {
+    if (!this->plan || !pattern || !size) { return 0; }
+    auto offset = this->plan->patternOffset(pattern, mask, size);
+    if (offset == KextPlan::NoOffset || offset > this->size || size > this->size - offset) { return 0; }
+    auto *data = reinterpret_cast<const uint8_t *>(this->address + offset);
+    for (size_t i = 0; i < size; i++) {
+        if ((data[i] ^ pattern[i]) & (mask ? mask[i] : 0xFF)) {
+            DBGLOG("symindex", "Planned match at 0x%X doesn't hold", offset);
+            return 0;
+        }
+    }
+    return this->address + offset;
+}
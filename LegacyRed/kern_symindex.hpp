@@ -0,0 +1,87 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+#ifndef kern_symindex_hpp
+#define kern_symindex_hpp
+#include <Headers/kern_util.hpp>
+
+struct nlist_64;
+
+struct KextPlanSymbol {
+    const char *symbol;
+    uint32_t offset;
+};
+
+/** First match of a pattern, keyed by `KextPlan::hashPattern` */
+struct KextPlanPattern {
+    uint32_t hash;
+    uint32_t size;
+    uint32_t offset;
+};
+
+/** Symbols and pattern matches of a known kext binary, resolved ahead of time by `Scripts/PatchPlanGen.py` */
+struct KextPlan {
+    uint8_t uuid[16];
+    const KextPlanSymbol *symbols;
+    size_t count;
+    const KextPlanPattern *patterns;
+    size_t patternCount;
+
+    static constexpr uint32_t NoOffset = ~0U;
+
+    /** FNV-1a over the bytes under their mask, then the mask; must match `pattern_hash` in the script */
+    static uint32_t hashPattern(const uint8_t *pattern, const uint8_t *mask, size_t size) {
+        uint32_t hash = 0x811C9DC5;
+        for (size_t i = 0; i < size; i++) {
+            auto m = mask ? mask[i] : 0xFF;
+            hash = (hash ^ static_cast<uint8_t>(pattern[i] & m)) * 0x01000193;
+            hash = (hash ^ m) * 0x01000193;
+        }
+        return hash;
+    }
+
+    /** Offset of the first match of the pattern in the kext, `NoOffset` when the plan doesn't know it */
+    uint32_t patternOffset(const uint8_t *pattern, const uint8_t *mask, size_t size) const {
+        auto hash = hashPattern(pattern, mask, size);
+        for (size_t i = 0; i < this->patternCount; i++) {
+            if (this->patterns[i].hash == hash && this->patterns[i].size == size) { return this->patterns[i].offset; }
+        }
+        return NoOffset;
+    }
+};
+
+/**
+ * Hash index over the symbol table of the kext being processed.
+ * `KernelPatcher::solveSymbol` walks the whole table for every symbol, which adds up on the AMD kexts.
+ * The table is only indexed when it lies within the kext image we were handed, otherwise lookups fail and
+ * the callers fall back to `KernelPatcher`.
+ * Kexts with a plan of the same UUID skip the table and are looked up in the plan, which also knows where
+ * the patterns of kern_patches.hpp first match.
+ */
+class SymbolIndex {
+    mach_vm_address_t address {0};
+    size_t size {0};
+    const nlist_64 *symbols {nullptr};
+    const char *strings {nullptr};
+    uint32_t stringsSize {0};
+    uint64_t slide {0};
+    uint32_t *slots {nullptr};
+    size_t slotCount {0};
+    const KextPlan *plan {nullptr};
+
+    bool build();
+    mach_vm_address_t solveFromPlan(const char *symbol) const;
+    void reset();
+
+    public:
+    /** Index of the kext at `address`, rebuilt whenever a different kext comes in */
+    static SymbolIndex *forKext(mach_vm_address_t address, size_t size);
+    /** Frees the index once the load callback of its kext returned, nothing else is solved in that kext */
+    static void release();
+
+    mach_vm_address_t solve(const char *symbol) const;
+    /** First match of the pattern from the plan, checked against the image; zero if it has to be searched for */
+    mach_vm_address_t findPattern(const uint8_t *pattern, const uint8_t *mask, size_t size) const;
+};
+
+#endif /* kern_symindex_hpp */
@@ -21,90 +21,88 @@ X4000 *X4000::callback = nullptr;
 
 void X4000::init() {
     callback = this;
-    lilu.onKextLoadForce(&kextRadeonX4000);
-    lilu.onKextLoadForce(&kextRadeonX4000HWServices);
+    auto &kexts = LRed::callback->kexts;
+    kexts.add<X4000, &X4000::processX4000>(&kextRadeonX4000, "x4000", this);
+    kexts.add<X4000, &X4000::processHWServices>(&kextRadeonX4000HWServices, "hwservices", this);
 }
 
-bool X4000::processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size) {
-    if (kextRadeonX4000HWServices.loadIndex == index) {
-        bool useGcn3Logic = LRed::callback->isGCN3;
-        RouteRequestPlus requests[] = {
-            {"__ZN36AMDRadeonX4000_AMDRadeonHWServicesCI16getMatchPropertyEv", forceX4000HWLibs, !useGcn3Logic},
-        };
-        PANIC_COND(!RouteRequestPlus::routeAll(patcher, index, requests, address, size), "hwservices",
-            "Failed to route symbols");
-    } else if (kextRadeonX4000.loadIndex == index) {
-        LRed::callback->setRMMIOIfNecessary();
-        /** this is already really complicated, so to keep things breif:
-         *  Carizzo uses UVD 6.0 and VCE 3.1, Stoney uses UVD 6.2 and VCE 3.4, both can only encode to H264 for whatever
-         * reason, but Stoney can decode HEVC and so can Carrizo
-         */
-        bool useGcn3Logic = LRed::callback->isGCN3;
-        bool useGcn4AndPatchLogic = (LRed::callback->chipType == ChipType::Stoney);
-
-        uint32_t *orgChannelTypes = nullptr;
-        mach_vm_address_t startHWEngines = 0;
-
-        SolveRequestPlus solveRequests[] = {
-            {"__ZN31AMDRadeonX4000_AMDBaffinPM4EngineC1Ev", this->orgBaffinPM4EngineConstructor, useGcn4AndPatchLogic},
-            {"__ZN30AMDRadeonX4000_AMDVIsDMAEngineC1Ev", this->orgGFX8SDMAEngineConstructor, useGcn4AndPatchLogic},
-            {"__ZN32AMDRadeonX4000_AMDUVD6v3HWEngineC1Ev", this->orgPolarisUVDEngineConstructor, useGcn4AndPatchLogic},
-            {"__ZN30AMDRadeonX4000_AMDVISAMUEngineC1Ev", this->orgGFX8SAMUEngineConstructor, useGcn4AndPatchLogic},
-            {"__ZN32AMDRadeonX4000_AMDVCE3v4HWEngineC1Ev", this->orgPolarisVCEEngineConstructor, useGcn4AndPatchLogic},
-            {"__ZN28AMDRadeonX4000_AMDCIHardware32setupAndInitializeHWCapabilitiesEv",
-                this->orgSetupAndInitializeHWCapabilities, !useGcn3Logic},
-            {"__ZN28AMDRadeonX4000_AMDVIHardware32setupAndInitializeHWCapabilitiesEv",
-                this->orgSetupAndInitializeHWCapabilities, useGcn3Logic},
-            {"__ZZN37AMDRadeonX4000_AMDGraphicsAccelerator19createAccelChannelsEbE12channelTypes", orgChannelTypes,
-                useGcn4AndPatchLogic},
-            {"__ZN26AMDRadeonX4000_AMDHardware14startHWEnginesEv", startHWEngines},
-        };
-        PANIC_COND(!SolveRequestPlus::solveAll(&patcher, index, solveRequests, address, size), "x4000",
-            "Failed to resolve symbols");
-
-        RouteRequestPlus requests[] = {
-            {"__ZN37AMDRadeonX4000_AMDGraphicsAccelerator5startEP9IOService", wrapAccelStart, orgAccelStart},
-            {"__ZN35AMDRadeonX4000_AMDEllesmereHardware17allocateHWEnginesEv", wrapAllocateHWEngines,
-                useGcn4AndPatchLogic},
-            {"__ZN33AMDRadeonX4000_AMDBonaireHardware32setupAndInitializeHWCapabilitiesEv",
-                wrapSetupAndInitializeHWCapabilities, !useGcn3Logic},
-            {"__ZN31AMDRadeonX4000_AMDFijiHardware32setupAndInitializeHWCapabilitiesEv",
-                wrapSetupAndInitializeHWCapabilities, (useGcn3Logic && !useGcn4AndPatchLogic)},
-            {"__ZN35AMDRadeonX4000_AMDEllesmereHardware32setupAndInitializeHWCapabilitiesEv",
-                wrapSetupAndInitializeHWCapabilities, useGcn4AndPatchLogic},
-            {"__ZN28AMDRadeonX4000_AMDCIHardware20initializeFamilyTypeEv", wrapInitializeFamilyType, !useGcn3Logic},
-            {"__ZN28AMDRadeonX4000_AMDVIHardware20initializeFamilyTypeEv", wrapInitializeFamilyType, useGcn3Logic},
-            {"__ZN26AMDRadeonX4000_AMDHardware12getHWChannelE20_eAMD_HW_ENGINE_TYPE18_eAMD_HW_RING_TYPE",
-                wrapGetHWChannel, this->orgGetHWChannel, useGcn4AndPatchLogic},
-            {"__ZN37AMDRadeonX4000_AMDGraphicsAccelerator15configureDeviceEP11IOPCIDevice", wrapConfigureDevice,
-                this->orgConfigureDevice},
-            {"__ZN37AMDRadeonX4000_AMDGraphicsAccelerator14initLinkToPeerEPKc", wrapInitLinkToPeer,
-                this->orgInitLinkToPeer},
-            {"__ZN37AMDRadeonX4000_AMDGraphicsAccelerator15createHWHandlerEv", wrapCreateHWHandler,
-                this->orgCreateHWHandler},
-            {"__ZN37AMDRadeonX4000_AMDGraphicsAccelerator17createHWInterfaceEP11IOPCIDevice", wrapCreateHWInterface,
-                this->orgCreateHWInterface},
-        };
-        PANIC_COND(!RouteRequestPlus::routeAll(patcher, index, requests, address, size), "x4000",
-            "Failed to route symbols");
-
-        if (useGcn4AndPatchLogic) {
-            PANIC_COND(MachInfo::setKernelWriting(true, KernelPatcher::kernelWriteLock) != KERN_SUCCESS, "x4000",
-                "Failed to enable kernel writing");
-            /** TODO: Test this */
-            orgChannelTypes[5] = 1;     // Fix createAccelChannels so that it only starts SDMA0
-            orgChannelTypes[11] = 0;    // Fix getPagingChannel so that it gets SDMA0
-            MachInfo::setKernelWriting(false, KernelPatcher::kernelWriteLock);
-
-            LookupPatchPlus const patch {&kextRadeonX4000, kStartHWEnginesOriginal, kStartHWEnginesMask,
-                kStartHWEnginesPatched, kStartHWEnginesMask, 1};
-            PANIC_COND(!patch.apply(&patcher, startHWEngines, PAGE_SIZE), "x4000", "Failed to patch startHWEngines");
-            DBGLOG("x4000", "Applied Singular SDMA lookup patch");
-        }
-        return true;
-    }
+void X4000::processHWServices(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size) {
+    bool useGcn3Logic = LRed::callback->isGCN3;
+    RouteRequestPlus requests[] = {
+        {"__ZN36AMDRadeonX4000_AMDRadeonHWServicesCI16getMatchPropertyEv", forceX4000HWLibs, !useGcn3Logic},
+    };
+    PANIC_COND(!RouteRequestPlus::routeAll(patcher, index, requests, address, size), "hwservices",
+        "Failed to route symbols");
+}
 
-    return false;
+void X4000::processX4000(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size) {
+    LRed::callback->setRMMIOIfNecessary();
+    /** this is already really complicated, so to keep things breif:
+     *  Carizzo uses UVD 6.0 and VCE 3.1, Stoney uses UVD 6.2 and VCE 3.4, both can only encode to H264 for whatever
+     * reason, but Stoney can decode HEVC and so can Carrizo
+     */
+    bool useGcn3Logic = LRed::callback->isGCN3;
+    bool useGcn4AndPatchLogic = (LRed::callback->chipType == ChipType::Stoney);
+
+    uint32_t *orgChannelTypes = nullptr;
+    mach_vm_address_t startHWEngines = 0;
+    const OSMetaClass *baffinPM4Meta = nullptr, *viPM4Meta = nullptr;
+
+    SolveRequestPlus solveRequests[] = {
+        {"__ZN31AMDRadeonX4000_AMDBaffinPM4EngineC1Ev", this->orgBaffinPM4EngineConstructor, useGcn4AndPatchLogic},
+        {"__ZN30AMDRadeonX4000_AMDVIsDMAEngineC1Ev", this->orgGFX8SDMAEngineConstructor, useGcn4AndPatchLogic},
+        {"__ZN32AMDRadeonX4000_AMDUVD6v3HWEngineC1Ev", this->orgPolarisUVDEngineConstructor, useGcn4AndPatchLogic},
+        {"__ZN30AMDRadeonX4000_AMDVISAMUEngineC1Ev", this->orgGFX8SAMUEngineConstructor, useGcn4AndPatchLogic},
+        {"__ZN32AMDRadeonX4000_AMDVCE3v4HWEngineC1Ev", this->orgPolarisVCEEngineConstructor, useGcn4AndPatchLogic},
+        {"__ZN28AMDRadeonX4000_AMDCIHardware32setupAndInitializeHWCapabilitiesEv",
+            this->orgSetupAndInitializeHWCapabilities, !useGcn3Logic},
+        {"__ZN28AMDRadeonX4000_AMDVIHardware32setupAndInitializeHWCapabilitiesEv",
+            this->orgSetupAndInitializeHWCapabilities, useGcn3Logic},
+        {"__ZZN37AMDRadeonX4000_AMDGraphicsAccelerator19createAccelChannelsEbE12channelTypes", orgChannelTypes,
+            useGcn4AndPatchLogic},
+        {"__ZN26AMDRadeonX4000_AMDHardware14startHWEnginesEv", startHWEngines},
+        {"__ZN33AMDRadeonX4000_AMDBaffinPM4Engine10gMetaClassE", baffinPM4Meta, useGcn4AndPatchLogic},
+        {"__ZN29AMDRadeonX4000_AMDVIPM4Engine10gMetaClassE", viPM4Meta, useGcn4AndPatchLogic},
+    };
+    PANIC_COND(!SolveRequestPlus::solveAll(&patcher, index, solveRequests, address, size), "x4000",
+        "Failed to resolve symbols");
+    // `wrapAllocateHWEngines` hands the Ellesmere hardware a Baffin PM4 engine in place of the VI one it builds
+    if (useGcn4AndPatchLogic) { LRed::callback->addMetaClassAlias(baffinPM4Meta, viPM4Meta); }
+
+    RouteRequestPlus requests[] = {
+        {"__ZN37AMDRadeonX4000_AMDGraphicsAccelerator5startEP9IOService", wrapAccelStart, orgAccelStart},
+        {"__ZN35AMDRadeonX4000_AMDEllesmereHardware17allocateHWEnginesEv", wrapAllocateHWEngines, useGcn4AndPatchLogic},
+        {"__ZN33AMDRadeonX4000_AMDBonaireHardware32setupAndInitializeHWCapabilitiesEv",
+            wrapSetupAndInitializeHWCapabilities, !useGcn3Logic},
+        {"__ZN31AMDRadeonX4000_AMDFijiHardware32setupAndInitializeHWCapabilitiesEv",
+            wrapSetupAndInitializeHWCapabilities, (useGcn3Logic && !useGcn4AndPatchLogic)},
+        {"__ZN35AMDRadeonX4000_AMDEllesmereHardware32setupAndInitializeHWCapabilitiesEv",
+            wrapSetupAndInitializeHWCapabilities, useGcn4AndPatchLogic},
+        {"__ZN28AMDRadeonX4000_AMDCIHardware20initializeFamilyTypeEv", wrapInitializeFamilyType, !useGcn3Logic},
+        {"__ZN28AMDRadeonX4000_AMDVIHardware20initializeFamilyTypeEv", wrapInitializeFamilyType, useGcn3Logic},
+        {"__ZN26AMDRadeonX4000_AMDHardware12getHWChannelE20_eAMD_HW_ENGINE_TYPE18_eAMD_HW_RING_TYPE",
+            wrapGetHWChannel, this->orgGetHWChannel, useGcn4AndPatchLogic},
+        {"__ZN37AMDRadeonX4000_AMDGraphicsAccelerator15configureDeviceEP11IOPCIDevice", wrapConfigureDevice,
+            this->orgConfigureDevice},
+        {"__ZN37AMDRadeonX4000_AMDGraphicsAccelerator14initLinkToPeerEPKc", wrapInitLinkToPeer,
+            this->orgInitLinkToPeer},
+        {"__ZN37AMDRadeonX4000_AMDGraphicsAccelerator15createHWHandlerEv", wrapCreateHWHandler,
+            this->orgCreateHWHandler},
+        {"__ZN37AMDRadeonX4000_AMDGraphicsAccelerator17createHWInterfaceEP11IOPCIDevice", wrapCreateHWInterface,
+            this->orgCreateHWInterface},
+    };
+    PatchTransaction transaction {patcher, index, address, size};
+    transaction.route(requests);
+
+    auto const patch = LookupPatchPlus {&kextRadeonX4000, kStartHWEngines, 1};
+    if (useGcn4AndPatchLogic) {
+        /** TODO: Test this */
+        transaction.write(&orgChannelTypes[5], 1U);     // Fix createAccelChannels so that it only starts SDMA0
+        transaction.write(&orgChannelTypes[11], 0U);    // Fix getPagingChannel so that it gets SDMA0
+        transaction.apply(patch, startHWEngines, PAGE_SIZE);
+    }
+    PANIC_COND(!transaction.commit(), "x4000", "Failed to apply patches");
+    DBGLOG_COND(useGcn4AndPatchLogic, "x4000", "Applied Singular SDMA lookup patch");
 }
 
 bool X4000::wrapAccelStart(void *that, IOService *provider) {
@@ -112,6 +110,8 @@ bool X4000::wrapAccelStart(void *that, IOService *provider) {
     callback->callbackAccelerator = that;
     auto ret = FunctionCast(wrapAccelStart, callback->orgAccelStart)(that, provider);
     DBGLOG("x4000", "accelStart returned %d", ret);
+    // CAIL has applied the golden settings by now
+    if (ret) { LRed::callback->reportGoldenSettings(); }
     return ret;
 }
 
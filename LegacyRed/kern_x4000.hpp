@@ -13,7 +13,6 @@ class X4000 {
     public:
     static X4000 *callback;
     void init();
-    bool processKext(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size);
 
     private:
     t_GenericConstructor orgBaffinPM4EngineConstructor {nullptr};
@@ -31,6 +30,9 @@ class X4000 {
 
     void *callbackAccelerator = nullptr;
 
+    void processHWServices(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size);
+    void processX4000(KernelPatcher &patcher, size_t index, mach_vm_address_t address, size_t size);
+
     static bool wrapAccelStart(void *that, IOService *provider);
     static bool wrapAllocateHWEngines(void *that);
     static uint64_t wrapConfigureDevice(void *that, IOPCIDevice *device);
@@ -0,0 +1,76 @@
+#!/usr/bin/python3
+# Prints the boot timeline LegacyRed publishes as `LRedBootProfile` on the iGPU.
+# Usage: ioreg -a -r -n IGPU -k LRedBootProfile > profile.plist; BootProfile.py profile.plist
+
+import plistlib
+import sys
+
+
+def find_profile(node):
+    if isinstance(node, dict):
+        if "LRedBootProfile" in node:
+            return node["LRedBootProfile"]
+        if "Spans" in node:
+            return node
+        children = node.values()
+    elif isinstance(node, list):
+        children = node
+    else:
+        return None
+    for child in children:
+        found = find_profile(child)
+        if found is not None:
+            return found
+    return None
+
+
+def ms(ns: int) -> str:
+    return "%10.3f" % (ns / 1e6)
+
+
+def main():
+    if len(sys.argv) != 2:
+        print(f"Usage: {sys.argv[0]} <ioreg -a output or plist>")
+        sys.exit(1)
+
+    with open(sys.argv[1], "rb") as f:
+        profile = find_profile(plistlib.load(f))
+    if profile is None:
+        print("No LRedBootProfile in the input")
+        sys.exit(1)
+
+    if "Mode" in profile:
+        print(f"Mode: {profile['Mode']}")
+    spans = sorted(profile.get("Spans", []), key=lambda s: (s["Start"], -s["Duration"]))
+    print(f"{'start ms':>10} {'took ms':>10}  phase")
+    stack = []
+    totals = {}
+    for span in spans:
+        end = span["Start"] + span["Duration"]
+        while stack and span["Start"] >= stack[-1]:
+            stack.pop()
+        print(f"{ms(span['Start'])} {ms(span['Duration'])}  {'  ' * len(stack)}{span['Name']}")
+        stack.append(end)
+        total = totals.setdefault(span["Name"], [0, 0])
+        total[0] += 1
+        total[1] += span["Duration"]
+
+    print()
+    print(f"{'calls':>10} {'total ms':>10}  phase")
+    for name, (calls, duration) in sorted(totals.items(), key=lambda t: -t[1][1]):
+        print(f"{calls:>10} {ms(duration)}  {name}")
+
+    counters = profile.get("Counters", {})
+    if counters:
+        print()
+        for name, value in sorted(counters.items()):
+            print(f"{value:>10}  {name}")
+
+    if profile.get("Dropped"):
+        print(f"\n{profile['Dropped']} spans did not fit in the buffer")
+    if "Published" in profile:
+        print(f"Published {ms(profile['Published']).strip()} ms after LegacyRed started")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,115 @@
+#!/usr/bin/python3
+# Decodes and compares the register access traces LegacyRed publishes as `LRedMMIOTrace` on the iGPU when booted
+# with -lredmmiorec.
+# Usage: ioreg -a -r -n IGPU -k LRedMMIOTrace > trace.plist
+#        MMIOTrace.py dump trace.plist
+#        MMIOTrace.py diff [--writes] expected.plist actual.plist
+#        MMIOTrace.py export trace.plist trace.bin
+# `diff` exits with 1 at the first divergence; `--writes` ignores reads, for changes that only drop redundant ones.
+# `export` writes the raw records for Tests/MMIOReplay.cpp.
+
+import plistlib
+import struct
+import sys
+
+# Keep in sync with MMIORecord in kern_mmiotrace.hpp
+RECORD = struct.Struct("<IIB?BB")
+ACCESS = {1: "R", 2: "W"}
+SOURCE = {0: "LRed", 1: "controller"}
+
+
+def find_trace(node):
+    if isinstance(node, dict):
+        if "LRedMMIOTrace" in node:
+            return node["LRedMMIOTrace"]
+        if "Records" in node:
+            return node
+        children = node.values()
+    elif isinstance(node, list):
+        children = node
+    else:
+        return None
+    for child in children:
+        found = find_trace(child)
+        if found is not None:
+            return found
+    return None
+
+
+def load_raw(path):
+    with open(path, "rb") as f:
+        trace = find_trace(plistlib.load(f))
+    if trace is None:
+        print(f"No LRedMMIOTrace in {path}")
+        sys.exit(2)
+    data = trace.get("Records", b"")
+    end = 0
+    # Claimed but not written when the trace was published, nothing after it is reliable
+    while end + RECORD.size <= len(data) and RECORD.unpack_from(data, end)[2] in ACCESS:
+        end += RECORD.size
+    if trace.get("Dropped"):
+        print(f"{path}: {trace['Dropped']} accesses past the end of the trace were not recorded")
+    return data[:end]
+
+
+def load(path):
+    records = []
+    for reg, value, access, indirect, width, source in RECORD.iter_unpack(load_raw(path)):
+        records.append((ACCESS[access], reg, value, indirect, width, SOURCE.get(source, str(source))))
+    return records
+
+
+def describe(record):
+    access, reg, value, indirect, width, source = record
+    size = f"/{width}" if width != 32 else ""
+    return f"{access}{size} 0x{reg:05X} = 0x{value:08X} {source}{' (indirect)' if indirect else ''}"
+
+
+def dump(path):
+    records = load(path)
+    for i, record in enumerate(records):
+        print(f"{i:>6}  {describe(record)}")
+    reads = sum(1 for r in records if r[0] == "R")
+    print(f"{len(records)} accesses, {reads} reads, {len(records) - reads} writes")
+
+
+def diff(expected_path, actual_path, writes_only):
+    expected = load(expected_path)
+    actual = load(actual_path)
+    if writes_only:
+        expected = [r for r in expected if r[0] == "W"]
+        actual = [r for r in actual if r[0] == "W"]
+    for i, (want, got) in enumerate(zip(expected, actual)):
+        # Values read back from the hardware may legitimately differ between boots, the register may not
+        if want[0] != got[0] or want[1] != got[1] or want[4:] != got[4:] or (want[0] == "W" and want[2] != got[2]):
+            print(f"Diverged at access {i}:")
+            print(f"  expected {describe(want)}")
+            print(f"  actual   {describe(got)}")
+            return 1
+    if len(expected) != len(actual):
+        print(f"Same for {min(len(expected), len(actual))} accesses, then expected {len(expected)}, got {len(actual)}")
+        return 1
+    print(f"{len(actual)} accesses match")
+    return 0
+
+
+def main():
+    args = sys.argv[1:]
+    if len(args) == 2 and args[0] == "dump":
+        dump(args[1])
+        return 0
+    if len(args) == 3 and args[0] == "export":
+        with open(args[2], "wb") as f:
+            f.write(load_raw(args[1]))
+        return 0
+    if args and args[0] == "diff":
+        writes_only = "--writes" in args
+        paths = [a for a in args[1:] if a != "--writes"]
+        if len(paths) == 2:
+            return diff(paths[0], paths[1], writes_only)
+    print(f"Usage: {sys.argv[0]} dump <trace> | diff [--writes] <expected> <actual> | export <trace> <output>")
+    return 2
+
+
+if __name__ == "__main__":
+    sys.exit(main())
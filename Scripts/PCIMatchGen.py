@@ -0,0 +1,79 @@
+#!/usr/bin/python3
+# Regenerates the IOPCIMatch lists in Info.plist from the device table in kern_devicedb.hpp.
+# Lists with more than one ID are rewritten to every device of the generations they match, GCN 2 or GCN 3; lists of
+# a single ID are left as they are.
+# Usage: PCIMatchGen.py [--check] [kern_devicedb.hpp] [Info.plist]
+
+import os
+import re
+import sys
+
+AMD_VENDOR_ID = 0x1002
+GCN3_CHIPS = ("ChipType::Carrizo", "ChipType::Stoney")
+
+
+def load_devices(path):
+    with open(path) as f:
+        source = f.read()
+    gcn3 = {}
+    for name, body in re.findall(r"static constexpr ChipRevision (\w+)\[\] = \{(.*?)\};", source, re.S):
+        gcn3[name] = any(chip in body for chip in GCN3_CHIPS)
+    devices = []
+    for device_id, revisions in re.findall(r"makeDevice\((0x[0-9A-Fa-f]+), (\w+)", source):
+        if revisions not in gcn3:
+            sys.exit(f"Unknown revision table {revisions} for {device_id}")
+        devices.append((int(device_id, 16), gcn3[revisions]))
+    if not devices:
+        sys.exit(f"No devices in {path}")
+    return devices
+
+
+def match_string(devices, generations):
+    return " ".join(f"0x{device:04X}{AMD_VENDOR_ID:04X}" for device, gcn3 in devices if gcn3 in generations)
+
+
+def regenerate(plist, devices):
+    known = dict(devices)
+
+    def replace(match):
+        ids = match.group(2).split()
+        if len(ids) < 2:
+            return match.group(0)
+        generations = set()
+        for value in ids:
+            value = int(value, 16)
+            # Typos don't count, they are dropped by regenerating the list
+            if value >> 32 == 0 and value & 0xFFFF == AMD_VENDOR_ID and value >> 16 in known:
+                generations.add(known[value >> 16])
+        if not generations:
+            return match.group(0)
+        return match.group(1) + match_string(devices, generations) + match.group(3)
+
+    return re.sub(r"(<key>IOPCIMatch</key>\s*<string>)([^<]*)(</string>)", replace, plist)
+
+
+def main():
+    args = [arg for arg in sys.argv[1:] if arg != "--check"]
+    check = len(args) != len(sys.argv) - 1
+    root = os.path.normpath(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "LegacyRed"))
+    header = args[0] if len(args) > 0 else os.path.join(root, "kern_devicedb.hpp")
+    info = args[1] if len(args) > 1 else os.path.join(root, "Info.plist")
+
+    devices = load_devices(header)
+    with open(info) as f:
+        plist = f.read()
+    updated = regenerate(plist, devices)
+    if updated == plist:
+        print(f"{info} is up to date")
+        return 0
+    if check:
+        print(f"{info} is out of date, run {sys.argv[0]}")
+        return 1
+    with open(info, "w") as f:
+        f.write(updated)
+    print(f"Updated {info}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,200 @@
+#!/usr/bin/python3
+# Resolves the symbols of LegacyRed's request tables and the first matches of the patterns in kern_patches.hpp
+# against extracted kext binaries ahead of time.
+# Usage: PatchPlanGen.py <output header> <kext binary>...
+
+import os
+import re
+import struct
+import sys
+
+LC_SEGMENT_64 = 0x19
+LC_SYMTAB = 0x2
+LC_UUID = 0x1B
+MH_MAGIC_64 = 0xFEEDFACF
+FAT_MAGIC = 0xCAFEBABE
+CPU_TYPE_X86_64 = 0x01000007
+N_STAB = 0xE0
+N_TYPE = 0x0E
+N_SECT = 0x0E
+
+REQUEST_SOURCES = ["kern_x4000.cpp", "kern_hwlibs.cpp", "kern_support.cpp", "kern_gfxcon.cpp"]
+PATTERN_SOURCE = "kern_patches.hpp"
+
+header = '''//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+// Generated by Scripts/PatchPlanGen.py, do not edit.
+
+#ifndef kern_kextplans_hpp
+#define kern_kextplans_hpp
+#include "kern_symindex.hpp"
+'''
+
+footer = '''
+#endif /* kern_kextplans_hpp */
+'''
+
+
+def thin_slice(data: bytes) -> bytes:
+    magic = struct.unpack_from(">I", data)[0]
+    if magic != FAT_MAGIC:
+        return data
+
+    count = struct.unpack_from(">I", data, 4)[0]
+    for i in range(count):
+        cpu, _, offset, size, _ = struct.unpack_from(">iiIII", data, 8 + i * 20)
+        if cpu == CPU_TYPE_X86_64:
+            return data[offset:offset + size]
+    raise ValueError("no x86_64 slice")
+
+
+def parse_macho(data: bytes) -> tuple[bytes, dict[str, int], bytes]:
+    magic, _, _, _, ncmds, _, _, _ = struct.unpack_from("<IiiIIIII", data)
+    if magic != MH_MAGIC_64:
+        raise ValueError("not a 64-bit Mach-O")
+
+    uuid = None
+    text_vmaddr = None
+    symtab = None
+    segments = []
+    offset = 32
+    for _ in range(ncmds):
+        cmd, cmdsize = struct.unpack_from("<II", data, offset)
+        if cmd == LC_UUID:
+            uuid = data[offset + 8:offset + 24]
+        elif cmd == LC_SEGMENT_64:
+            segname = data[offset + 8:offset + 24].rstrip(b"\0")
+            vmaddr, vmsize, fileoff, filesize = struct.unpack_from("<QQQQ", data, offset + 24)
+            if segname == b"__TEXT":
+                text_vmaddr = vmaddr
+            if vmsize:
+                segments.append((vmaddr, vmsize, fileoff, filesize))
+        elif cmd == LC_SYMTAB:
+            symtab = struct.unpack_from("<IIII", data, offset + 8)
+        offset += cmdsize
+
+    if uuid is None or text_vmaddr is None or symtab is None:
+        raise ValueError("missing LC_UUID, __TEXT or LC_SYMTAB")
+
+    symoff, nsyms, stroff, strsize = symtab
+    symbols = {}
+    for i in range(nsyms):
+        strx, n_type, _, _, n_value = struct.unpack_from("<IBBHQ", data, symoff + i * 16)
+        if n_type & N_STAB or n_type & N_TYPE != N_SECT or strx >= strsize:
+            continue
+        end = data.index(b"\0", stroff + strx)
+        name = data[stroff + strx:end].decode("ascii", "replace")
+        symbols.setdefault(name, n_value - text_vmaddr)
+
+    # The kext as it's laid out in memory, from the start of `__TEXT`, which is what the patterns are matched on
+    image = bytearray(max(vmaddr + vmsize for vmaddr, vmsize, _, _ in segments) - text_vmaddr)
+    for vmaddr, _, fileoff, filesize in segments:
+        if vmaddr >= text_vmaddr:
+            image[vmaddr - text_vmaddr:vmaddr - text_vmaddr + filesize] = data[fileoff:fileoff + filesize]
+    return uuid, symbols, bytes(image)
+
+
+def requested_symbols(source_dir: str) -> set[str]:
+    ret = set()
+    for file in REQUEST_SOURCES:
+        with open(os.path.join(source_dir, file)) as f:
+            ret.update(re.findall(r'\{\s*"(_[A-Za-z0-9_]+)"', f.read()))
+    return ret
+
+
+def parse_pattern(text: str) -> tuple[bytes, bytes]:
+    """The IDA-style patterns of `makePattern`, `?` masks a nibble"""
+    find, mask = bytearray(), bytearray()
+    for byte in text.split(" "):
+        find.append(int(byte.replace("?", "0"), 16))
+        mask.append((0xF0 if byte[0] != "?" else 0) | (0x0F if byte[1] != "?" else 0))
+    return bytes(find), bytes(mask)
+
+
+def requested_patterns(source_dir: str) -> list[tuple[str, bytes, bytes]]:
+    with open(os.path.join(source_dir, PATTERN_SOURCE)) as f:
+        source = f.read()
+    expr = r'static constexpr auto (k\w+) = make(?:Patch|Pattern)\(\s*"([0-9A-Fa-f? ]+)"'
+    return [(name, *parse_pattern(text)) for name, text in re.findall(expr, source)]
+
+
+def pattern_hash(find: bytes, mask: bytes) -> int:
+    """Same as `KextPlan::hashPattern`, an exact pattern is hashed with a mask of 0xFF bytes"""
+    ret = 0x811C9DC5
+    for byte, m in zip(find, mask):
+        ret = ((ret ^ (byte & m)) * 0x01000193) & 0xFFFFFFFF
+        ret = ((ret ^ m) * 0x01000193) & 0xFFFFFFFF
+    return ret
+
+
+def find_pattern(image: bytes, find: bytes, mask: bytes) -> int:
+    expr = bytearray()
+    for byte, m in zip(find, mask):
+        if m == 0xFF:
+            expr += re.escape(bytes([byte]))
+        else:
+            expr += b"[" + b"".join(re.escape(bytes([b])) for b in range(256) if b & m == byte & m) + b"]"
+    match = re.search(bytes(expr), image, re.DOTALL)
+    return match.start() if match else -1
+
+
+def format_uuid(uuid: bytes) -> str:
+    return ", ".join("0x%02X" % b for b in uuid)
+
+
+def main():
+    if len(sys.argv) < 2:
+        print("Usage: %s <output header> [<kext binary>...]" % sys.argv[0])
+        sys.exit(1)
+
+    source_dir = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "LegacyRed")
+    wanted = requested_symbols(source_dir)
+    patterns = requested_patterns(source_dir)
+
+    plans = []
+    for path in sys.argv[2:]:
+        with open(path, "rb") as f:
+            uuid, symbols, image = parse_macho(thin_slice(f.read()))
+        name = os.path.basename(path)
+        found = sorted((symbol, symbols[symbol]) for symbol in wanted if symbol in symbols)
+        matched = []
+        for pattern, find, mask in patterns:
+            offset = find_pattern(image, find, mask)
+            if offset >= 0:
+                matched.append((pattern, pattern_hash(find, mask), len(find), offset))
+        print("%s: %d of %d symbols, %d of %d patterns" % (name, len(found), len(wanted), len(matched),
+            len(patterns)))
+        if not found and not matched:
+            print("%s: nothing to plan, skipped" % name)
+            continue
+        plans.append((name, uuid, found, matched))
+
+    with open(sys.argv[1], "w") as out:
+        out.write(header)
+        for index, (name, uuid, found, matched) in enumerate(plans):
+            out.write("\n// %s\n" % name)
+            # An empty initialiser list isn't valid for an array of unknown size, leave those out
+            if found:
+                out.write("static const KextPlanSymbol kextPlan%dSymbols[] = {\n" % index)
+                for symbol, offset in found:
+                    out.write('    {"%s", 0x%X},\n' % (symbol, offset))
+                out.write("};\n")
+            if matched:
+                out.write("static const KextPlanPattern kextPlan%dPatterns[] = {\n" % index)
+                for pattern, hash, size, offset in matched:
+                    out.write("    {0x%08X, %d, 0x%X},    // %s\n" % (hash, size, offset, pattern))
+                out.write("};\n")
+
+        out.write("\n// Symbols are sorted within each plan, the last entry keeps the array from being empty\n")
+        out.write("static const KextPlan kextPlans[] = {\n")
+        for index, (name, uuid, found, matched) in enumerate(plans):
+            out.write("    {{%s},\n        %s, %d, %s, %d},\n" % (format_uuid(uuid),
+                "kextPlan%dSymbols" % index if found else "nullptr", len(found),
+                "kextPlan%dPatterns" % index if matched else "nullptr", len(matched)))
+        out.write("    {{0}, nullptr, 0, nullptr, 0},\n};\n")
+        out.write(footer)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,65 @@
+#!/usr/bin/python3
+# Prints the register read trace LegacyRed publishes as `LRedRegTrace` on the iGPU when booted with -lredregdbg.
+# Usage: ioreg -a -r -n IGPU -k LRedRegTrace > trace.plist; RegTrace.py trace.plist [top registers]
+
+import plistlib
+import struct
+import sys
+
+# Keep in sync with RegTraceRecord in kern_regtrace.hpp
+RECORD = struct.Struct("<QQQIIBB6x")
+
+
+def find_trace(node):
+    if isinstance(node, dict):
+        if "LRedRegTrace" in node:
+            return node["LRedRegTrace"]
+        if "Histogram" in node:
+            return node
+        children = node.values()
+    elif isinstance(node, list):
+        children = node
+    else:
+        return None
+    for child in children:
+        found = find_trace(child)
+        if found is not None:
+            return found
+    return None
+
+
+def main():
+    if len(sys.argv) not in (2, 3):
+        print(f"Usage: {sys.argv[0]} <ioreg -a output or plist> [top registers]")
+        sys.exit(1)
+    top = int(sys.argv[2]) if len(sys.argv) == 3 else 32
+
+    with open(sys.argv[1], "rb") as f:
+        trace = find_trace(plistlib.load(f))
+    if trace is None:
+        print("No LRedRegTrace in the input")
+        sys.exit(1)
+
+    histogram = sorted(trace.get("Histogram", {}).items(), key=lambda r: -r[1])
+    print(f"{trace.get('Total', 0)} reads, {len(histogram)} registers")
+    print(f"{'reads':>10}  register")
+    for reg, count in histogram[:top]:
+        print(f"{count:>10}  {reg}")
+    if trace.get("Overflowed"):
+        print(f"{trace['Overflowed']} reads of registers that did not fit in the histogram")
+
+    data = trace.get("Recent", b"")
+    records = [RECORD.unpack_from(data, i) for i in range(0, len(data) - RECORD.size + 1, RECORD.size)]
+    if not records:
+        return
+    records.sort(key=lambda r: r[1])
+    base = records[0][1]
+    print()
+    print(f"{'ticks':>12} cpu width {'register':>10} {'value':>10}  caller")
+    for _, timestamp, caller, reg, value, width, cpu in records:
+        where = f"+0x{caller:X}" if caller else "?"
+        print(f"{timestamp - base:>12} {cpu:>3} {width:>5} {reg:>#10x} {value:>#10x}  {where}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,184 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+#include "HostTest.hpp"
+#include "kern_golden.hpp"
+#include <libkern/c++/OSArray.h>
+#include <libkern/c++/OSData.h>
+#include <libkern/c++/OSNumber.h>
+#include <vector>
+
+static constexpr uint32_t GRBM_GFX_INDEX = 0xC200;
+static constexpr uint32_t SRBM_GFX_CNTL = 0x391;
+static constexpr uint32_t Broadcast = 0xE0000000;
+
+// Shaped like the HWLibs tables: unsorted, a register set twice, and full masks that write without reading
+static const uint32_t plainTable[] = {
+    0x2684, 0x00000040, 0x00000040,    //
+    0x260D, 0xF00FFFFF, 0x00000400,    //
+    0x2540, 0x0000000F, 0x00000000,    //
+    0x2684, 0x00000003, 0x00000001,    //
+    0x22C1, 0xFFFFFFFF, 0x00000001,    //
+    0xFFFFFFFF, 0, 0,
+};
+
+// Per-SE settings between bank selects, which have to stay where the table puts them
+static const uint32_t bankedTable[] = {
+    0x2684, 0x00000040, 0x00000040,                //
+    GRBM_GFX_INDEX, 0xFFFFFFFF, 0x00000000,        //
+    0x2540, 0x0000000F, 0x00000002,                //
+    GRBM_GFX_INDEX, 0xFFFFFFFF, 0x00010000,        //
+    0x2540, 0x0000000F, 0x00000003,                //
+    GRBM_GFX_INDEX, 0xFFFFFFFF, Broadcast,         //
+    0x22C1, 0xFFFFFFFF, 0x00000001,                //
+    0xFFFFFFFF, 0, 0,
+};
+
+/** Plain memory for the registers, large enough that all of them are direct */
+struct FakeMMIO {
+    std::vector<uint32_t> memory = std::vector<uint32_t>(0x10000);
+    RegisterAccess regs;
+
+    FakeMMIO() {
+        CHECK(this->regs.init(this->memory.data(), this->memory.size() * sizeof(uint32_t)));
+        CHECK(this->regs.recorder().enable(256));
+    }
+
+    uint32_t &operator[](uint32_t reg) { return this->memory[reg]; }
+
+    std::vector<MMIORecord> trace() {
+        IORegistryEntry entry;
+        this->regs.recorder().publish(&entry);
+        auto *dict = OSDynamicCast(OSDictionary, entry.getProperty("LRedMMIOTrace"));
+        auto *data = dict ? OSDynamicCast(OSData, dict->getObject("Records")) : nullptr;
+        if (!data) { return {}; }
+        auto *records = static_cast<const MMIORecord *>(data->getBytesNoCopy());
+        return {records, records + data->getLength() / sizeof(MMIORecord)};
+    }
+
+    /** Registers written, in order */
+    std::vector<uint32_t> writes() {
+        std::vector<uint32_t> ret;
+        for (auto &record : this->trace()) {
+            if (record.access == MMIOAccess::Write) { ret.push_back(record.reg); }
+        }
+        return ret;
+    }
+};
+
+HOST_TEST(parseSortsAndMergesTheSettings) {
+    GoldenSettings golden;
+    CHECK(golden.parse(plainTable));
+    CHECK_EQ(golden.count(), 4U);
+
+    FakeMMIO mmio;
+    mmio[0x2684] = 0xFFFFFF00;
+    mmio[0x260D] = 0xFFFFFFFF;
+    mmio[0x2540] = 0xFFFFFFFF;
+    mmio[0x22C1] = 0xFFFFFFFF;
+    golden.apply(mmio.regs);
+    // Both settings of 0x2684 in one masked write
+    CHECK_EQ(mmio[0x2684], 0xFFFFFF41U);
+    CHECK_EQ(mmio[0x260D], 0x0FF00400U);
+    CHECK_EQ(mmio[0x2540], 0xFFFFFFF0U);
+    CHECK_EQ(mmio[0x22C1], 1U);
+    CHECK(mmio.writes() == (std::vector<uint32_t> {0x22C1, 0x2540, 0x260D, 0x2684}));
+}
+
+HOST_TEST(parseKeepsTheOrderAroundSelectors) {
+    GoldenSettings golden;
+    CHECK(golden.parse(bankedTable));
+    CHECK_EQ(golden.count(), 7U);
+
+    FakeMMIO mmio;
+    golden.apply(mmio.regs);
+    CHECK(mmio.writes() ==
+          (std::vector<uint32_t> {0x2684, GRBM_GFX_INDEX, 0x2540, GRBM_GFX_INDEX, 0x2540, GRBM_GFX_INDEX, 0x22C1}));
+    CHECK_EQ(mmio[GRBM_GFX_INDEX], Broadcast);
+}
+
+HOST_TEST(parseRejectsBadTables) {
+    GoldenSettings golden;
+    CHECK(!golden.parse(nullptr));
+    std::vector<uint32_t> unterminated((GoldenSettings::MaxSettings + 1) * 3, 0x1000);
+    unterminated.push_back(GoldenSettings::EndOfTable);
+    CHECK(!golden.parse(unterminated.data()));
+    CHECK_EQ(golden.count(), 0U);
+    // A table that fills every setting is fine
+    std::vector<uint32_t> full(GoldenSettings::MaxSettings * 3, 0x1000);
+    full.push_back(GoldenSettings::EndOfTable);
+    CHECK(golden.parse(full.data()));
+    CHECK_EQ(golden.count(), 1U);
+}
+
+HOST_TEST(diffReportsOnlyTheMaskedBits) {
+    GoldenSettings golden;
+    CHECK(golden.parse(plainTable));
+    FakeMMIO mmio;
+    mmio[0x2684] = 0x41;
+    mmio[0x260D] = 0x0FF00400;
+    mmio[0x2540] = 0xABCD0005;
+    mmio[0x22C1] = 1;
+    GoldenMismatch mismatches[4];
+    CHECK_EQ(golden.diff(mmio.regs, mismatches, arrsize(mismatches)), 1U);
+    CHECK_EQ(mismatches[0].reg, 0x2540U);
+    CHECK_EQ(mismatches[0].mask, 0xFU);
+    CHECK_EQ(mismatches[0].expected, 0U);
+    CHECK_EQ(mismatches[0].actual, 0xABCD0005U);
+
+    // Only reads, and none of the registers changed
+    CHECK(mmio.writes().empty());
+    golden.apply(mmio.regs);
+    CHECK_EQ(golden.diff(mmio.regs, mismatches, arrsize(mismatches)), 0U);
+}
+
+HOST_TEST(diffSelectsTheBankOfEachSetting) {
+    GoldenSettings golden;
+    CHECK(golden.parse(bankedTable));
+    FakeMMIO mmio;
+    mmio[GRBM_GFX_INDEX] = 0x12345678;
+    GoldenMismatch mismatches[8];
+    auto total = golden.diff(mmio.regs, mismatches, arrsize(mismatches));
+    // Neither setting of 0x2540 holds and each is checked in its own bank; the selector isn't a mismatch itself
+    CHECK_EQ(total, 4U);
+    size_t banked = 0;
+    for (size_t i = 0; i < total; i++) {
+        CHECK(mismatches[i].reg != GRBM_GFX_INDEX);
+        if (mismatches[i].reg == 0x2540) { banked++; }
+    }
+    CHECK_EQ(banked, 2U);
+
+    uint32_t selected = 0x12345678;
+    size_t readsInBank = 0;
+    for (auto &record : mmio.trace()) {
+        if (record.reg == GRBM_GFX_INDEX && record.access == MMIOAccess::Write) { selected = record.value; }
+        if (record.reg == 0x2540 && record.access == MMIOAccess::Read) {
+            CHECK(selected == 0 || selected == 0x10000);
+            readsInBank++;
+        }
+    }
+    CHECK_EQ(readsInBank, 2U);
+    // Back to broadcast, and SRBM_GFX_CNTL, which the table never selects, is left alone
+    CHECK_EQ(mmio[GRBM_GFX_INDEX], Broadcast);
+    for (auto reg : mmio.writes()) { CHECK(reg == GRBM_GFX_INDEX); }
+    CHECK_EQ(mmio[SRBM_GFX_CNTL], 0U);
+}
+
+HOST_TEST(reportPublishesTheDifferences) {
+    GoldenSettings golden;
+    CHECK(golden.parse(plainTable));
+    FakeMMIO mmio;
+    mmio[0x2540] = 0x7;
+    IORegistryEntry entry;
+    CHECK_EQ(golden.report(mmio.regs, &entry), 4U);
+    auto *list = OSDynamicCast(OSArray, entry.getProperty("LRedGoldenDiff"));
+    CHECK(list && list->getCount() == 4);
+    auto *first = list ? OSDynamicCast(OSDictionary, list->getObject(0)) : nullptr;
+    auto *reg = first ? OSDynamicCast(OSNumber, first->getObject("Register")) : nullptr;
+    auto *actual = first ? OSDynamicCast(OSNumber, first->getObject("Actual")) : nullptr;
+    CHECK(reg && actual);
+    if (reg && actual) {
+        CHECK_EQ(reg->unsigned32BitValue(), 0x22C1U);
+        CHECK_EQ(actual->unsigned32BitValue(), 0U);
+    }
+}
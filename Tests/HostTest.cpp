@@ -0,0 +1,29 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+#include "HostTest.hpp"
+#include <cstring>
+
+unsigned hostFailures = 0;
+
+// Tests register in reverse order of definition, run them in file order
+static void runAll(HostTest *test, const char *filter, size_t &ran) {
+    if (!test) { return; }
+    runAll(test->next, filter, ran);
+    if (filter && !strstr(test->name, filter)) { return; }
+    auto before = hostFailures;
+    test->run();
+    printf("%-40s %s\n", test->name, hostFailures == before ? "ok" : "FAILED");
+    ran++;
+}
+
+int main(int argc, char **argv) {
+    size_t ran = 0;
+    runAll(HostTest::first(), argc > 1 ? argv[1] : nullptr, ran);
+    if (hostFailures) {
+        printf("%u checks failed\n", hostFailures);
+        return 1;
+    }
+    printf("%zu tests passed\n", ran);
+    return 0;
+}
@@ -0,0 +1,65 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+#ifndef HostTest_hpp
+#define HostTest_hpp
+#include <chrono>
+#include <cstdio>
+
+/**
+ * Just enough of a test runner for the host tests.
+ * Every `HOST_TEST` registers itself; HostTest.cpp runs them all and fails when any `CHECK` did.
+ */
+struct HostTest {
+    const char *name;
+    void (*run)();
+    HostTest *next;
+
+    static HostTest *&first() {
+        static HostTest *first = nullptr;
+        return first;
+    }
+
+    HostTest(const char *name, void (*run)()) : name {name}, run {run}, next {first()} { first() = this; }
+};
+
+extern unsigned hostFailures;
+
+#define HOST_TEST(name)                               \
+    static void name();                               \
+    static HostTest name##Registration {#name, name}; \
+    static void name()
+
+#define CHECK(cond)                                                                 \
+    do {                                                                            \
+        if (!(cond)) {                                                              \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            hostFailures++;                                                         \
+        }                                                                           \
+    } while (0)
+
+#define CHECK_EQ(actual, expected)                                                                                 \
+    do {                                                                                                           \
+        auto actualValue = (actual);                                                                               \
+        auto expectedValue = (expected);                                                                           \
+        if (!(actualValue == expectedValue)) {                                                                     \
+            fprintf(stderr, "%s:%d: %s is 0x%llX, expected 0x%llX\n", __FILE__, __LINE__, #actual,                \
+                static_cast<unsigned long long>(actualValue), static_cast<unsigned long long>(expectedValue));    \
+            hostFailures++;                                                                                        \
+        }                                                                                                          \
+    } while (0)
+
+/** Nanoseconds per call of `body`, the best of a few rounds */
+template<typename F>
+double hostBenchmark(size_t iterations, F body) {
+    double best = 0;
+    for (int round = 0; round < 5; round++) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; i++) { body(i); }
+        auto ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        if (!round || ns < best) { best = ns; }
+    }
+    return best / static_cast<double>(iterations);
+}
+
+#endif /* HostTest_hpp */
@@ -0,0 +1,104 @@
+#!/usr/bin/python3
+# Writes small x86_64 kexts for the PatchPlanGen.py test, and what the plan for them has to contain.
+# Usage: KextPlanFixture.py <output directory>
+
+import os
+import struct
+import sys
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "Scripts"))
+import PatchPlanGen  # noqa: E402
+
+LC_SEGMENT_64 = 0x19
+LC_SYMTAB = 0x2
+LC_UUID = 0x1B
+MH_KEXT_BUNDLE = 0xB
+N_EXT = 0x01
+
+
+def macho(uuid: bytes, segments: list[tuple[str, int, bytes, int]], symbols: list[tuple[str, int, int]]) -> bytes:
+    """`segments` are (name, vmaddr, file contents, vmsize), `symbols` are (name, n_type, n_value)"""
+    strings = b"\0"
+    nlist = b""
+    for name, n_type, n_value in symbols:
+        nlist += struct.pack("<IBBHQ", len(strings), n_type, 1, 0, n_value)
+        strings += name.encode() + b"\0"
+
+    ncmds = len(segments) + 3
+    sizeofcmds = 72 * (len(segments) + 1) + 24 + 24
+    fileoff = 0x1000
+    layout = []
+    for name, vmaddr, contents, vmsize in segments:
+        layout.append((name, vmaddr, vmsize, fileoff, contents))
+        fileoff += len(contents)
+    symoff = fileoff
+    stroff = symoff + len(nlist)
+    linkedit = nlist + strings
+
+    cmds = b""
+    for name, vmaddr, vmsize, offset, contents in layout:
+        cmds += struct.pack("<II16sQQQQiiII", LC_SEGMENT_64, 72, name.encode(), vmaddr, vmsize, offset, len(contents),
+            7, 5, 0, 0)
+    last = max(vmaddr + vmsize for _, vmaddr, vmsize, _, _ in layout)
+    cmds += struct.pack("<II16sQQQQiiII", LC_SEGMENT_64, 72, b"__LINKEDIT", last, 0x1000, symoff, len(linkedit), 1,
+        1, 0, 0)
+    cmds += struct.pack("<IIIIII", LC_SYMTAB, 24, symoff, len(symbols), stroff, len(strings))
+    cmds += struct.pack("<II16s", LC_UUID, 24, uuid)
+
+    data = bytearray(struct.pack("<IiiIIIII", 0xFEEDFACF, PatchPlanGen.CPU_TYPE_X86_64, 3, MH_KEXT_BUNDLE, ncmds,
+        sizeofcmds, 0, 0) + cmds)
+    data += b"\0" * (0x1000 - len(data))
+    for _, _, _, _, contents in layout:
+        data += contents
+    return bytes(data + linkedit)
+
+
+def fat(thin: bytes) -> bytes:
+    return struct.pack(">IIiiIII", PatchPlanGen.FAT_MAGIC, 1, PatchPlanGen.CPU_TYPE_X86_64, 3, 0x1000, len(thin),
+        12) + b"\0" * (0x1000 - 28) + thin
+
+
+def main():
+    out = sys.argv[1]
+    source_dir = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "LegacyRed")
+    wanted = sorted(PatchPlanGen.requested_symbols(source_dir))[:3]
+    patterns = {name: (find, mask) for name, find, mask in PatchPlanGen.requested_patterns(source_dir)}
+
+    # A masked pattern twice in `__TEXT`, the plan has the first one; an exact one in `__DATA`, which sits at a
+    # different offset in memory than in the file
+    text = bytearray(b"\x90" * 0x3000)
+    text[0x1234:0x1238] = b"\x48\x83\xF8\x02"
+    text[0x2345:0x2349] = b"\x41\x83\xF9\x02"
+    data = bytearray(0x800)
+    find, _ = patterns["kVRAMInfoNullCheck"]
+    data[0x100:0x100 + len(find)] = find
+    symbols = [(name, 0x0E | N_EXT, 0x100 * (i + 1)) for i, name in enumerate(wanted)]
+    symbols += [("_unrelated", 0x0E | N_EXT, 0x800), ("stab", 0x24, 0x900)]
+    fixture_uuid = bytes(range(0x10, 0x20))
+    with open(os.path.join(out, "fixture.kext"), "wb") as f:
+        f.write(macho(fixture_uuid, [("__TEXT", 0, bytes(text), 0x3000), ("__DATA", 0x8000, bytes(data), 0x1000)],
+            symbols))
+
+    # Symbols only, in a fat binary
+    symbols_uuid = bytes(range(0x20, 0x30))
+    with open(os.path.join(out, "symbols.kext"), "wb") as f:
+        f.write(fat(macho(symbols_uuid, [("__TEXT", 0, b"\x90" * 0x1000, 0x1000)], [(wanted[0], 0x0F, 0x40)])))
+
+    # Nothing of ours, so it gets no plan
+    with open(os.path.join(out, "unrelated.kext"), "wb") as f:
+        f.write(macho(bytes(range(0x30, 0x40)), [("__TEXT", 0, b"\x90" * 0x1000, 0x1000)], [("_other", 0x0F, 0)]))
+
+    with open(os.path.join(out, "kextplan_expect.hpp"), "w") as f:
+        f.write("// Written by KextPlanFixture.py\n")
+        f.write("static const uint8_t fixtureUUID[16] = {%s};\n" % PatchPlanGen.format_uuid(fixture_uuid))
+        f.write("static const uint8_t symbolsUUID[16] = {%s};\n" % PatchPlanGen.format_uuid(symbols_uuid))
+        f.write("static const KextPlanSymbol fixtureSymbols[] = {\n")
+        for name, _, value in symbols[:len(wanted)]:
+            f.write('    {"%s", 0x%X},\n' % (name, value))
+        f.write("};\n")
+        f.write("static const uint32_t fixtureStartHWEngines = 0x1234;\n")
+        f.write("static const uint32_t fixtureVRAMInfoNullCheck = 0x8100;\n")
+
+
+if __name__ == "__main__":
+    main()
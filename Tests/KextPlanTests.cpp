@@ -0,0 +1,54 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+// Built against the plan PatchPlanGen.py generates for the kexts of KextPlanFixture.py, with -pedantic-errors
+
+#include "HostTest.hpp"
+#include "kern_kextplans.hpp"
+#include "kern_patches.hpp"
+#include "kextplan_expect.hpp"
+
+HOST_TEST(planHoldsKextsWithSomethingToPlan) {
+    // The fixture, the kext with symbols only and the terminating entry; the unrelated kext is left out
+    CHECK_EQ(arrsize(kextPlans), 3U);
+    CHECK(!memcmp(kextPlans[0].uuid, fixtureUUID, sizeof(fixtureUUID)));
+    CHECK(!memcmp(kextPlans[1].uuid, symbolsUUID, sizeof(symbolsUUID)));
+    CHECK(!kextPlans[2].count && !kextPlans[2].patternCount);
+}
+
+HOST_TEST(planHasSortedSymbolOffsets) {
+    auto &plan = kextPlans[0];
+    CHECK_EQ(plan.count, arrsize(fixtureSymbols));
+    for (size_t i = 0; i < plan.count && i < arrsize(fixtureSymbols); i++) {
+        CHECK(!strcmp(plan.symbols[i].symbol, fixtureSymbols[i].symbol));
+        CHECK_EQ(plan.symbols[i].offset, fixtureSymbols[i].offset);
+        if (i) { CHECK(strcmp(plan.symbols[i - 1].symbol, plan.symbols[i].symbol) < 0); }
+    }
+}
+
+HOST_TEST(planHasFirstPatternMatches) {
+    auto &plan = kextPlans[0];
+    auto &hwEngines = kStartHWEngines.original;
+    auto &vramInfo = kVRAMInfoNullCheck.original;
+    auto &fbCount = kAGDPFBCountCheck.original;
+    CHECK_EQ(plan.patternOffset(hwEngines.find, hwEngines.findMask(), kStartHWEngines.size), fixtureStartHWEngines);
+    // Exact patterns come without a mask at runtime
+    CHECK(!vramInfo.findMask());
+    CHECK_EQ(plan.patternOffset(vramInfo.find, vramInfo.findMask(), kVRAMInfoNullCheck.size),
+        fixtureVRAMInfoNullCheck);
+    CHECK_EQ(plan.patternOffset(fbCount.find, fbCount.findMask(), kAGDPFBCountCheck.size), KextPlan::NoOffset);
+    // The patched bytes are a different pattern
+    CHECK_EQ(plan.patternOffset(kStartHWEngines.patched.find, kStartHWEngines.patched.findMask(),
+                 kStartHWEngines.size),
+        KextPlan::NoOffset);
+}
+
+HOST_TEST(planWithoutPatternsHasNoPatternArray) {
+    auto &plan = kextPlans[1];
+    CHECK_EQ(plan.count, 1U);
+    CHECK(!plan.patterns);
+    CHECK_EQ(plan.patternCount, 0U);
+    CHECK_EQ(plan.patternOffset(kStartHWEngines.original.find, kStartHWEngines.original.findMask(),
+                 kStartHWEngines.size),
+        KextPlan::NoOffset);
+}
@@ -0,0 +1,107 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+#include "MMIOReplay.hpp"
+#include "kern_amd.hpp"
+#include <IOKit/IORegistryEntry.h>
+#include <algorithm>
+#include <libkern/c++/OSData.h>
+
+static uint32_t widthMask(uint8_t width) { return width >= 32 ? ~0U : (1U << width) - 1; }
+
+uint32_t &MMIOReplay::slot(uint32_t reg) {
+    if (reg < this->memory.size()) { return this->memory[reg]; }
+    auto it = std::find(this->indirectRegs.begin(), this->indirectRegs.end(), reg);
+    if (it != this->indirectRegs.end()) { return this->indirectValues[it - this->indirectRegs.begin()]; }
+    this->indirectRegs.push_back(reg);
+    this->indirectValues.push_back(0);
+    return this->indirectValues.back();
+}
+
+uint32_t MMIOReplay::reg(uint32_t reg) const {
+    if (reg < this->memory.size()) { return this->memory[reg]; }
+    auto it = std::find(this->indirectRegs.begin(), this->indirectRegs.end(), reg);
+    return it == this->indirectRegs.end() ? 0 : this->indirectValues[it - this->indirectRegs.begin()];
+}
+
+void MMIOReplay::access(size_t index, const MMIORecord &record, RegisterAccess &regs) {
+    auto mask = widthMask(record.width);
+    auto &value = this->slot(record.reg);
+    if (record.access == MMIOAccess::Write) {
+        if (std::find(this->writtenRegs.begin(), this->writtenRegs.end(), record.reg) == this->writtenRegs.end()) {
+            this->writtenRegs.push_back(record.reg);
+            this->seen.push_back(record.reg);
+        }
+        if (record.source == MMIOSource::Controller) {
+            value = (value & ~mask) | (record.value & mask);
+            regs.recorder().record(MMIOAccess::Write, record.reg, record.value, false, record.width, record.source);
+            return;
+        }
+        regs.write(record.reg, record.value);
+        // The data register of the buffer is shared, keep what went through it
+        if (record.indirect) { value = this->memory[mmPCIE_DATA2]; }
+        return;
+    }
+
+    auto known = std::find(this->seen.begin(), this->seen.end(), record.reg) != this->seen.end();
+    if (!known) { this->seen.push_back(record.reg); }
+    if (known && (value & mask) != (record.value & mask)) {
+        this->changed.push_back({index, record.reg, value & mask, record.value & mask});
+    }
+    value = (value & ~mask) | (record.value & mask);
+    if (record.source == MMIOSource::Controller) {
+        regs.recorder().record(MMIOAccess::Read, record.reg, record.value, false, record.width, record.source);
+        return;
+    }
+    // Serve the read from where RegisterAccess will look for it
+    if (record.indirect) { this->memory[mmPCIE_DATA2] = value; }
+    (void)regs.read(record.reg);
+}
+
+bool MMIOReplay::replay(const MMIORecord *records, size_t count) {
+    // Everything we accessed directly has to be mapped, nothing we went through the index for may be.
+    // The controller picks its own path, its registers are kept apart when they're past the mapping
+    uint32_t mapped = mmPCIE_DATA2 + 1, firstIndirect = ~0U;
+    for (size_t i = 0; i < count; i++) {
+        auto &record = records[i];
+        if (record.source != MMIOSource::LRed) { continue; }
+        if (record.indirect) {
+            firstIndirect = std::min(firstIndirect, record.reg);
+        } else {
+            mapped = std::max(mapped, record.reg + 1);
+        }
+    }
+    if (mapped > firstIndirect) {
+        fprintf(stderr, "replay: 0x%X was accessed directly but 0x%X through the index\n", mapped - 1, firstIndirect);
+        return false;
+    }
+
+    this->memory.assign(mapped, 0);
+    this->indirectRegs.clear();
+    this->indirectValues.clear();
+    this->writtenRegs.clear();
+    this->seen.clear();
+    this->changed.clear();
+    this->rerecorded.clear();
+    RegisterAccess regs;
+    if (!regs.init(this->memory.data(), this->memory.size() * sizeof(uint32_t)) ||
+        !regs.recorder().enable(count ? count : 1)) {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) { this->access(i, records[i], regs); }
+
+    IORegistryEntry entry;
+    regs.recorder().publish(&entry);
+    auto *dict = OSDynamicCast(OSDictionary, entry.getProperty("LRedMMIOTrace"));
+    auto *data = dict ? OSDynamicCast(OSData, dict->getObject("Records")) : nullptr;
+    auto *replayed = data ? static_cast<const MMIORecord *>(data->getBytesNoCopy()) : nullptr;
+    auto replayedCount = data ? data->getLength() / sizeof(MMIORecord) : 0;
+    this->rerecorded.assign(replayed, replayed + replayedCount);
+    for (this->diverged = 0; this->diverged < count; this->diverged++) {
+        if (this->diverged >= replayedCount ||
+            memcmp(&records[this->diverged], &replayed[this->diverged], sizeof(MMIORecord))) {
+            break;
+        }
+    }
+    return this->diverged == count;
+}
@@ -0,0 +1,53 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+#ifndef MMIOReplay_hpp
+#define MMIOReplay_hpp
+#include "kern_regaccess.hpp"
+#include <vector>
+
+/**
+ * Replays a trace recorded with `-lredmmiorec` against plain memory standing in for RMMIO.
+ * Our accesses go through `RegisterAccess` again and each read is served the value the hardware gave when the
+ * trace was recorded; controller accesses, which CAIL made on its own, are applied to the memory directly.
+ * The replay records a trace of its own, which has to come out the same as the one it was given.
+ */
+class MMIOReplay {
+    public:
+    struct Change {
+        size_t index;
+        uint32_t reg;
+        uint32_t expected;
+        uint32_t actual;
+    };
+
+    /** Sizes the mapping so that the accesses that were indirect when recording are indirect again */
+    bool replay(const MMIORecord *records, size_t count);
+
+    /** Value of the register once replayed, indirect ones included */
+    uint32_t reg(uint32_t reg) const;
+    /** Registers written during the trace, in the order of their first write */
+    const std::vector<uint32_t> &written() const { return this->writtenRegs; }
+    /** Reads that returned something else than the last value written or read; the hardware changed those */
+    const std::vector<Change> &changes() const { return this->changed; }
+    /** What the replay recorded */
+    const std::vector<MMIORecord> &trace() const { return this->rerecorded; }
+    /** Index of the first record that didn't replay the same, `count` when all did */
+    size_t divergence() const { return this->diverged; }
+
+    private:
+    std::vector<uint32_t> memory;
+    std::vector<uint32_t> indirectRegs;
+    std::vector<uint32_t> indirectValues;
+    std::vector<uint32_t> writtenRegs;
+    /** Registers written or read so far, the first read of a register can't tell whether it changed */
+    std::vector<uint32_t> seen;
+    std::vector<Change> changed;
+    std::vector<MMIORecord> rerecorded;
+    size_t diverged {0};
+
+    uint32_t &slot(uint32_t reg);
+    void access(size_t index, const MMIORecord &record, RegisterAccess &regs);
+};
+
+#endif /* MMIOReplay_hpp */
@@ -0,0 +1,103 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+#include "HostTest.hpp"
+#include "MMIOReplay.hpp"
+#include "kern_amd.hpp"
+#include <IOKit/IORegistryEntry.h>
+#include <libkern/c++/OSData.h>
+
+static constexpr size_t MappedRegs = 0x100;
+static constexpr uint32_t Direct = 0x40;
+static constexpr uint32_t Indirect = 0x3000;
+static constexpr uint32_t ControllerReg = 0x80;
+
+/** A boot as the kext would record it: our accesses through RegisterAccess, the controller's next to them */
+struct RecordedBoot {
+    uint32_t memory[MappedRegs] {};
+    RegisterAccess regs;
+    std::vector<MMIORecord> records;
+
+    RecordedBoot() {
+        CHECK(this->regs.init(this->memory, sizeof(this->memory)));
+        CHECK(this->regs.recorder().enable(64));
+        this->memory[Direct] = 0x1234;
+        (void)this->regs.read(Direct);
+        this->regs.write(Direct, 0x5678);
+        this->controller(MMIOAccess::Write, ControllerReg, 0xAB, 8);
+        this->memory[mmPCIE_DATA2] = 0xF0;
+        static const RegOp ops[] = {
+            {Indirect, 0x0F, 0x05},
+            {Direct, ~0U, 0x9ABC},
+        };
+        this->regs.apply(ops);
+        this->controller(MMIOAccess::Read, ControllerReg, 0xAB, 8);
+        // The hardware cleared a bit behind our back
+        this->memory[Direct] = 0x9AB8;
+        (void)this->regs.read(Direct);
+
+        IORegistryEntry entry;
+        this->regs.recorder().publish(&entry);
+        auto *dict = OSDynamicCast(OSDictionary, entry.getProperty("LRedMMIOTrace"));
+        auto *data = dict ? OSDynamicCast(OSData, dict->getObject("Records")) : nullptr;
+        CHECK(data);
+        if (!data) { return; }
+        auto *begin = static_cast<const MMIORecord *>(data->getBytesNoCopy());
+        this->records.assign(begin, begin + data->getLength() / sizeof(MMIORecord));
+    }
+
+    /** Same as the wrappers in kern_gfxcon.cpp, which don't go through RegisterAccess */
+    void controller(MMIOAccess access, uint32_t reg, uint32_t value, uint8_t width) {
+        if (access == MMIOAccess::Write) { this->memory[reg] = value; }
+        this->regs.recorder().record(access, reg, value, false, width, MMIOSource::Controller);
+    }
+};
+
+HOST_TEST(replayRecordsTheSameTrace) {
+    RecordedBoot boot;
+    CHECK_EQ(boot.records.size(), 8U);
+    MMIOReplay replay;
+    CHECK(replay.replay(boot.records.data(), boot.records.size()));
+    CHECK_EQ(replay.divergence(), boot.records.size());
+    CHECK_EQ(replay.trace().size(), boot.records.size());
+}
+
+HOST_TEST(replayEndsWithTheRecordedRegisters) {
+    RecordedBoot boot;
+    MMIOReplay replay;
+    CHECK(replay.replay(boot.records.data(), boot.records.size()));
+    CHECK(replay.written() == (std::vector<uint32_t> {Direct, ControllerReg, Indirect}));
+    CHECK_EQ(replay.reg(Direct), boot.memory[Direct]);
+    CHECK_EQ(replay.reg(ControllerReg), 0xABU);
+    CHECK_EQ(replay.reg(Indirect), 0xF5U);
+}
+
+HOST_TEST(replayFindsWhatTheHardwareChanged) {
+    RecordedBoot boot;
+    MMIOReplay replay;
+    CHECK(replay.replay(boot.records.data(), boot.records.size()));
+    // First reads only tell what a register was, the last read found a value nobody wrote
+    CHECK_EQ(replay.changes().size(), 1U);
+    if (replay.changes().size() == 1) {
+        auto &change = replay.changes()[0];
+        CHECK_EQ(change.index, boot.records.size() - 1);
+        CHECK_EQ(change.reg, Direct);
+        CHECK_EQ(change.expected, 0x9ABCU);
+        CHECK_EQ(change.actual, 0x9AB8U);
+    }
+}
+
+HOST_TEST(replayStopsWhereTheTraceDiverges) {
+    RecordedBoot boot;
+    // A write recorded as indirect below a register that was accessed directly can't come from the same mapping
+    auto records = boot.records;
+    records[1].indirect = true;
+    MMIOReplay replay;
+    CHECK(!replay.replay(records.data(), records.size()));
+
+    // A record RegisterAccess wouldn't have made that way
+    records = boot.records;
+    records[1].width = 16;
+    CHECK(!replay.replay(records.data(), records.size()));
+    CHECK_EQ(replay.divergence(), 1U);
+}
@@ -0,0 +1,40 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+// Replays a trace exported with `Scripts/MMIOTrace.py export` and prints the registers it left behind.
+// Usage: build/mmioreplay trace.bin
+
+#include "MMIOReplay.hpp"
+#include <cstdio>
+#include <vector>
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <exported trace>\n", argv[0]);
+        return 2;
+    }
+    auto *file = fopen(argv[1], "rb");
+    if (!file) {
+        perror(argv[1]);
+        return 2;
+    }
+    std::vector<MMIORecord> records;
+    MMIORecord record;
+    while (fread(&record, sizeof(record), 1, file) == 1) { records.push_back(record); }
+    fclose(file);
+
+    MMIOReplay replay;
+    auto same = replay.replay(records.data(), records.size());
+    for (auto &change : replay.changes()) {
+        printf("%6zu  0x%05X changed from 0x%08X to 0x%08X\n", change.index, change.reg, change.expected,
+            change.actual);
+    }
+    for (auto reg : replay.written()) { printf("0x%05X = 0x%08X\n", reg, replay.reg(reg)); }
+    printf("%zu accesses, %zu registers written, %zu changed by the hardware\n", records.size(),
+        replay.written().size(), replay.changes().size());
+    if (!same) {
+        printf("Replay diverged at access %zu\n", replay.divergence());
+        return 1;
+    }
+    return 0;
+}
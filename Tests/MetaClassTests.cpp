@@ -0,0 +1,92 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+#include "HostTest.hpp"
+#include "kern_metaclass.hpp"
+
+static OSMetaClass metas[512];
+
+HOST_TEST(aliasesResolveBothWays) {
+    MetaClassAliasTable table;
+    CHECK(table.add(&metas[0], &metas[1]));
+    CHECK(table.lookup(&metas[0]) == &metas[1]);
+    CHECK(table.lookup(&metas[1]) == &metas[0]);
+    CHECK(!table.lookup(&metas[2]));
+    // The same pair again is fine, a different alias for a metaclass isn't
+    CHECK(table.add(&metas[1], &metas[0]));
+    CHECK(!table.add(&metas[0], &metas[2]));
+    CHECK_EQ(table.size(), 2U);
+}
+
+HOST_TEST(aliasesRollBackWhenTheSecondInsertFails) {
+    MetaClassAliasTable table;
+    // Fill the probe window of metas[1] with pairs that don't use it, until only its own add is left to fail
+    size_t added = 0;
+    for (size_t i = 2; i + 1 < arrsize(metas) && table.size() < 14; i += 2) {
+        if (table.add(&metas[i], &metas[i + 1])) { added += 2; }
+    }
+    CHECK_EQ(table.size(), added);
+    size_t rolledBack = 0;
+    for (size_t first = 0; first < arrsize(metas); first++) {
+        for (size_t second = 0; second < arrsize(metas); second++) {
+            if (first == second || table.lookup(&metas[first]) || table.lookup(&metas[second])) { continue; }
+            auto before = table.size();
+            if (table.add(&metas[first], &metas[second])) {
+                CHECK_EQ(table.size(), before + 2);
+                CHECK(rolledBack);
+                return;
+            }
+            // Neither direction may be left behind
+            CHECK_EQ(table.size(), before);
+            CHECK(!table.lookup(&metas[first]));
+            CHECK(!table.lookup(&metas[second]));
+            rolledBack++;
+        }
+    }
+    CHECK(!"no pair fit the table");
+}
+
+HOST_TEST(aliasHitsAreCountedPerDirection) {
+    MetaClassAliasTable table;
+    CHECK(!table.hitCounter(&metas[0]));
+    CHECK(table.add(&metas[0], &metas[1]));
+    for (int i = 0; i < 3; i++) { table.lookup(&metas[0]); }
+    table.lookup(&metas[1]);
+    table.lookup(&metas[2]);
+    CHECK_EQ(table.hits(&metas[0]), 3U);
+    CHECK_EQ(table.hits(&metas[1]), 1U);
+    CHECK_EQ(table.hits(&metas[2]), 0U);
+}
+
+/** What the hook did before: a scan of every pair on each failed cast */
+static const OSMetaClass *lookupPairs(const OSMetaClass *(&pairs)[4][2], const OSMetaClass *toMeta) {
+    for (const auto &ent : pairs) {
+        if (ent[0] == toMeta) {
+            return ent[1];
+        } else if (ent[1] == toMeta) {
+            return ent[0];
+        }
+    }
+    return nullptr;
+}
+
+HOST_TEST(benchAliasTableVersusPairScan) {
+    // The real alias, and nearly every failed cast being to some unrelated metaclass
+    MetaClassAliasTable table;
+    CHECK(table.add(&metas[0], &metas[1]));
+    const OSMetaClass *pairs[4][2] = {{&metas[0], &metas[1]}};
+
+    static constexpr size_t CastCount = 4096;
+    static const OSMetaClass *casts[CastCount];
+    for (size_t i = 0; i < CastCount; i++) { casts[i] = &metas[2 + (i * 2654435761U) % (arrsize(metas) - 2)]; }
+
+    volatile uintptr_t sink = 0;
+    auto scan = hostBenchmark(CastCount * 64, [&](size_t i) {
+        sink = sink + reinterpret_cast<uintptr_t>(lookupPairs(pairs, casts[i % CastCount]));
+    });
+    auto filtered = hostBenchmark(CastCount * 64, [&](size_t i) {
+        sink = sink + reinterpret_cast<uintptr_t>(table.lookup(casts[i % CastCount]));
+    });
+    CHECK_EQ(sink, 0U);
+    printf("  failed cast: pair scan %.2f ns, alias table %.2f ns\n", scan, filtered);
+}
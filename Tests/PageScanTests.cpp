@@ -0,0 +1,513 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+#include "HostTest.hpp"
+#include "kern_pagescan.hpp"
+#include "kern_patches.hpp"
+#include <atomic>
+#include <random>
+#include <thread>
+
+static const uint8_t modelReplace[20] = {'i', 'M', 'a', 'c', 'P', 'r', 'o', '1', ',', '1'};
+
+static void addRealNeedles(PageScanner &scanner) {
+    scanner.addNeedle({"VideoToolboxDRM", "", PageTarget::SharedCache,
+        reinterpret_cast<const uint8_t *>(kVideoToolboxDRMModelOriginal), arrsize(kVideoToolboxDRMModelOriginal),
+        modelReplace, arrsize(modelReplace), 1});
+    scanner.addNeedle({"BoardId", "", PageTarget::SharedCache, kBoardIdOriginal, arrsize(kBoardIdOriginal),
+        kBoardIdPatched, arrsize(kBoardIdPatched), 0});
+    scanner.addNeedle({"CoreLSKD", "", PageTarget::CoreLSKD, kCoreLSKD.original.find, kCoreLSKD.size,
+        kCoreLSKD.patched.find, kCoreLSKD.size, 1});
+}
+
+/** What the hook did before: one `KernelPatcher::findAndReplace` per needle */
+static bool findAndReplace(uint8_t *data, size_t size, const uint8_t *find, size_t findSize, const uint8_t *replace,
+    size_t replaceSize) {
+    for (size_t i = 0; i + findSize <= size; i++) {
+        if (memcmp(data + i, find, findSize)) { continue; }
+        memcpy(data + i, replace, replaceSize);
+        return true;
+    }
+    return false;
+}
+
+static void fillRandom(uint8_t *page, std::mt19937 &rng) {
+    for (size_t i = 0; i < PAGE_SIZE; i++) { page[i] = static_cast<uint8_t>(rng()); }
+}
+
+HOST_TEST(scanPatchesFirstMatchOfEachNeedle) {
+    PageScanner scanner;
+    CHECK(scanner.init());
+    addRealNeedles(scanner);
+
+    std::mt19937 rng {1};
+    uint8_t page[PAGE_SIZE];
+    fillRandom(page, rng);
+    memcpy(page + 100, kVideoToolboxDRMModelOriginal, arrsize(kVideoToolboxDRMModelOriginal));
+    memcpy(page + 2000, kBoardIdOriginal, arrsize(kBoardIdOriginal));
+    memcpy(page + 3000, kBoardIdOriginal, arrsize(kBoardIdOriginal));
+
+    uint16_t offsets[MaxPageNeedles];
+    CHECK(scanner.patchPage(page, PAGE_SIZE, PageTarget::SharedCache, offsets));
+    CHECK_EQ(offsets[0], 100);
+    CHECK_EQ(offsets[1], 2000);
+    CHECK_EQ(offsets[2], NoPageNeedle);
+    CHECK(!memcmp(page + 100, modelReplace, arrsize(modelReplace)));
+    CHECK(!memcmp(page + 2000, kBoardIdPatched, arrsize(kBoardIdPatched)));
+    // Like `findAndReplace`, a needle is replaced once per page
+    CHECK(!memcmp(page + 3000, kBoardIdOriginal, arrsize(kBoardIdOriginal)));
+}
+
+HOST_TEST(scanFindsNeedlesAtPageEdges) {
+    PageScanner scanner;
+    CHECK(scanner.init());
+    addRealNeedles(scanner);
+
+    uint8_t page[PAGE_SIZE] {};
+    memcpy(page, kBoardIdOriginal, arrsize(kBoardIdOriginal));
+    memcpy(page + PAGE_SIZE - arrsize(kVideoToolboxDRMModelOriginal), kVideoToolboxDRMModelOriginal,
+        arrsize(kVideoToolboxDRMModelOriginal));
+
+    uint16_t offsets[MaxPageNeedles];
+    CHECK(scanner.patchPage(page, PAGE_SIZE, PageTarget::SharedCache, offsets));
+    CHECK_EQ(offsets[0], PAGE_SIZE - arrsize(kVideoToolboxDRMModelOriginal));
+    CHECK_EQ(offsets[1], 0);
+}
+
+HOST_TEST(scanOnlyMatchesNeedlesOfTheTarget) {
+    PageScanner scanner;
+    CHECK(scanner.init());
+    addRealNeedles(scanner);
+
+    uint8_t page[PAGE_SIZE] {};
+    memcpy(page + 64, kCoreLSKD.original.find, kCoreLSKD.size);
+    memcpy(page + 512, kBoardIdOriginal, arrsize(kBoardIdOriginal));
+
+    uint16_t offsets[MaxPageNeedles];
+    CHECK(!scanner.patchPage(page, PAGE_SIZE, PageTarget::CoreLSKDMSE, offsets));
+    CHECK(!scanner.patchPage(page, PAGE_SIZE, PageTarget::Irrelevant, offsets));
+    CHECK(scanner.patchPage(page, PAGE_SIZE, PageTarget::CoreLSKD, offsets));
+    CHECK_EQ(offsets[2], 64);
+    CHECK(!memcmp(page + 64, kCoreLSKD.patched.find, kCoreLSKD.size));
+    CHECK(!memcmp(page + 512, kBoardIdOriginal, arrsize(kBoardIdOriginal)));
+}
+
+// Needles sharing their first byte go through the same bitmask entry
+static const uint8_t sharedA[] = {0x48, 0x89, 0xE5, 0x41, 0x57, 0x41, 0x56};
+static const uint8_t sharedB[] = {0x48, 0x8B, 0x05, 0x00, 0x00};
+static const uint8_t sharedC[] = {0x48, 0x89, 0xE5, 0x53};
+static const uint8_t replaceX[] = {0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC};
+
+HOST_TEST(scanMatchesPerNeedleSearch) {
+    const uint8_t *finds[] = {sharedA, sharedB, sharedC};
+    const size_t sizes[] = {arrsize(sharedA), arrsize(sharedB), arrsize(sharedC)};
+    PageScanner scanner;
+    CHECK(scanner.init());
+    for (size_t n = 0; n < arrsize(finds); n++) {
+        scanner.addNeedle({"Shared", "", PageTarget::SharedCache, finds[n], sizes[n], replaceX, sizes[n], 0});
+    }
+
+    std::mt19937 rng {2};
+    uint8_t page[PAGE_SIZE], expected[PAGE_SIZE];
+    for (int trial = 0; trial < 2000; trial++) {
+        // Random bytes drawn from a tiny alphabet, so that partial matches are everywhere
+        for (auto &byte : page) { byte = static_cast<uint8_t>(0x41 + rng() % 8); }
+        for (size_t n = 0; n < arrsize(finds); n++) {
+            auto copies = rng() % 3;
+            for (size_t c = 0; c < copies; c++) { memcpy(page + rng() % (PAGE_SIZE - sizes[n]), finds[n], sizes[n]); }
+        }
+        memcpy(expected, page, PAGE_SIZE);
+        uint16_t offsets[MaxPageNeedles];
+        scanner.patchPage(page, PAGE_SIZE, PageTarget::SharedCache, offsets);
+
+        // The single walk patches in page order, so replay the same order one needle at a time
+        for (size_t i = 0, done = 0; i < PAGE_SIZE; i++) {
+            for (size_t n = 0; n < arrsize(finds); n++) {
+                if ((done & (1U << n)) || i + sizes[n] > PAGE_SIZE || memcmp(expected + i, finds[n], sizes[n])) {
+                    continue;
+                }
+                CHECK_EQ(offsets[n], i);
+                findAndReplace(expected + i, sizes[n], finds[n], sizes[n], replaceX, sizes[n]);
+                done |= 1U << n;
+            }
+        }
+        CHECK(!memcmp(page, expected, PAGE_SIZE));
+        if (hostFailures) { break; }
+    }
+}
+
+HOST_TEST(benchScanVersusPerNeedle) {
+    PageScanner scanner;
+    CHECK(scanner.init());
+    addRealNeedles(scanner);
+
+    static constexpr size_t PageCount = 256;
+    static uint8_t pages[PageCount][PAGE_SIZE];
+    std::mt19937 rng {3};
+    for (auto &page : pages) { fillRandom(page, rng); }
+
+    // The pages don't hold any needle, which is what nearly every validated page looks like
+    uint16_t offsets[MaxPageNeedles];
+    auto single = hostBenchmark(PageCount * 16, [&](size_t i) {
+        scanner.patchPage(pages[i % PageCount], PAGE_SIZE, PageTarget::SharedCache, offsets);
+    });
+    auto perNeedle = hostBenchmark(PageCount * 16, [&](size_t i) {
+        auto *page = pages[i % PageCount];
+        findAndReplace(page, PAGE_SIZE, reinterpret_cast<const uint8_t *>(kVideoToolboxDRMModelOriginal),
+            arrsize(kVideoToolboxDRMModelOriginal), modelReplace, arrsize(modelReplace));
+        findAndReplace(page, PAGE_SIZE, kBoardIdOriginal, arrsize(kBoardIdOriginal), kBoardIdPatched,
+            arrsize(kBoardIdPatched));
+    });
+    printf("  shared cache page: single walk %.0f ns, one search per needle %.0f ns\n", single, perNeedle);
+}
+
+HOST_TEST(benchCoreLSKDPageEngines) {
+    // With -lreduserpatch the CoreLSKD needles leave the scanner, the hook still classifies the page but stops there
+    PageScanner pageHook, userPatcher;
+    CHECK(pageHook.init());
+    CHECK(userPatcher.init());
+    addRealNeedles(pageHook);
+    userPatcher.addNeedle({"BoardId", "", PageTarget::SharedCache, kBoardIdOriginal, arrsize(kBoardIdOriginal),
+        kBoardIdPatched, arrsize(kBoardIdPatched), 0});
+
+    static constexpr size_t PageCount = 64;
+    static uint8_t pages[PageCount][PAGE_SIZE];
+    std::mt19937 rng {4};
+    for (auto &page : pages) { fillRandom(page, rng); }
+    auto hook = hostBenchmark(PageCount * 16, [&](size_t i) {
+        pageHook.processPage(1, (i % PageCount) * PAGE_SIZE, pages[i % PageCount], PageTarget::CoreLSKD);
+    });
+    auto handedOver = hostBenchmark(PageCount * 16, [&](size_t i) {
+        userPatcher.processPage(1, (i % PageCount) * PAGE_SIZE, pages[i % PageCount], PageTarget::CoreLSKD);
+    });
+    printf("  CoreLSKD page in the hook: page hook %.0f ns, UserPatcher %.0f ns\n", hook, handedOver);
+}
+
+HOST_TEST(benchSystemWideValidation) {
+    // Every page validated on the system goes through the hook while it's routed. With -lreduserpatch the shared cache
+    // needles keep it routed, so this is the cost every process pays for them, against not routing it at all.
+    PageScanner pageHook, userPatcher;
+    CHECK(pageHook.init());
+    CHECK(userPatcher.init());
+    addRealNeedles(pageHook);
+    userPatcher.addNeedle({"BoardId", "", PageTarget::SharedCache, kBoardIdOriginal, arrsize(kBoardIdOriginal),
+        kBoardIdPatched, arrsize(kBoardIdPatched), 0});
+
+    // Mostly pages of other files, some of the shared cache and the odd CoreLSKD one
+    static constexpr size_t VnodeCount = 64, PageCount = 64, StreamCount = 4096;
+    static uint8_t pages[PageCount][PAGE_SIZE];
+    std::mt19937 rng {5};
+    for (auto &page : pages) { fillRandom(page, rng); }
+    PageTarget targets[VnodeCount];
+    for (size_t v = 0; v < VnodeCount; v++) {
+        targets[v] = v < 4 ? PageTarget::SharedCache : v == 4 ? PageTarget::CoreLSKD : PageTarget::Irrelevant;
+    }
+    static uint32_t stream[StreamCount];
+    for (auto &entry : stream) { entry = rng() % VnodeCount; }
+
+    auto validate = [&](PageScanner &scanner, VnodeTargetCache &cache, size_t i) {
+        auto v = stream[i % StreamCount];
+        auto *vp = reinterpret_cast<const vnode *>(0xFFFFFF8040000000 + v * 0x100);
+        auto target = PageTarget::Irrelevant;
+        if (!cache.lookup(vp, 1, target)) {
+            target = targets[v];
+            cache.insert(vp, 1, target);
+        }
+        if (target == PageTarget::Irrelevant) { return; }
+        scanner.processPage(VnodeTargetCache::makeTag(vp, 1), (i % PageCount) * PAGE_SIZE, pages[i % PageCount],
+            target);
+    };
+    VnodeTargetCache hookCache, userPatcherCache;
+    auto hook = hostBenchmark(StreamCount * 4, [&](size_t i) { validate(pageHook, hookCache, i); });
+    auto handedOver = hostBenchmark(StreamCount * 4, [&](size_t i) { validate(userPatcher, userPatcherCache, i); });
+    printf("  per validated page system-wide: page hook %.0f ns, -lreduserpatch %.0f ns, not routed 0 ns\n", hook,
+        handedOver);
+}
+
+static const uint8_t budgetNeedle[] = {'b', 'u', 'd', 'g', 'e', 't', '-', 'n', 'e', 'e', 'd', 'l', 'e'};
+static const uint8_t budgetReplace[] = {'B', 'U', 'D', 'G', 'E', 'T'};
+
+static void addBudgetNeedle(PageScanner &scanner, uint32_t budget) {
+    scanner.addNeedle({"Budget", "", PageTarget::SharedCache, budgetNeedle, arrsize(budgetNeedle), budgetReplace,
+        arrsize(budgetReplace), budget});
+}
+
+HOST_TEST(budgetFastPathIsOptIn) {
+    PageScanner scanner;
+    CHECK(scanner.init());
+    addBudgetNeedle(scanner, 1);
+    static uint8_t page[PAGE_SIZE] {};
+    memcpy(page + 300, budgetNeedle, arrsize(budgetNeedle));
+    scanner.processPage(1, 0, page, PageTarget::SharedCache);
+    CHECK_EQ(scanner.budgetsMet(), 1U);
+    CHECK(!scanner.isComplete());
+
+    PageScanner optedIn;
+    CHECK(optedIn.init());
+    optedIn.setUseBudget(true);
+    addBudgetNeedle(optedIn, 1);
+    memcpy(page + 300, budgetNeedle, arrsize(budgetNeedle));
+    optedIn.processPage(1, 0, page, PageTarget::SharedCache);
+    CHECK(optedIn.isComplete());
+    CHECK(!optedIn.hasUnplanned());
+}
+
+HOST_TEST(budgetIgnoresReplayedPages) {
+    PageScanner scanner;
+    CHECK(scanner.init());
+    scanner.setUseBudget(true);
+    addBudgetNeedle(scanner, 2);
+    static uint8_t page[PAGE_SIZE] {};
+    // The same page validated again comes from the plan and isn't a second site
+    for (int i = 0; i < 3; i++) {
+        memcpy(page + 300, budgetNeedle, arrsize(budgetNeedle));
+        scanner.processPage(1, 0, page, PageTarget::SharedCache);
+    }
+    CHECK_EQ(scanner.applied(0), 1U);
+    CHECK_EQ(scanner.planHits(), 2U);
+    CHECK(!scanner.isComplete());
+}
+
+HOST_TEST(budgetZeroDoesNotHoldCompletion) {
+    PageScanner scanner;
+    CHECK(scanner.init());
+    scanner.setUseBudget(true);
+    addBudgetNeedle(scanner, 0);
+    static const uint8_t other[] = {'o', 't', 'h', 'e', 'r', '-', 'n', 'e', 'e', 'd', 'l', 'e'};
+    static const uint8_t otherReplace[] = {'O', 'T', 'H', 'E', 'R'};
+    scanner.addNeedle({"Other", "", PageTarget::SharedCache, other, arrsize(other), otherReplace,
+        arrsize(otherReplace), 1});
+    static uint8_t page[PAGE_SIZE] {};
+    for (uint64_t i = 0; i < 8; i++) {
+        memcpy(page + 300, budgetNeedle, arrsize(budgetNeedle));
+        scanner.processPage(1, i * PAGE_SIZE, page, PageTarget::SharedCache);
+    }
+    CHECK_EQ(scanner.applied(0), 8U);
+    CHECK_EQ(scanner.budgetsMet(), 0U);
+    CHECK(!scanner.isComplete());
+
+    memcpy(page + 300, other, arrsize(other));
+    scanner.processPage(1, 8 * PAGE_SIZE, page, PageTarget::SharedCache);
+    CHECK_EQ(scanner.budgetsMet(), 1U);
+    CHECK(scanner.isComplete());
+}
+
+HOST_TEST(budgetSplitPageKeepsScanning) {
+    PageScanner scanner;
+    CHECK(scanner.init());
+    scanner.setUseBudget(true);
+    addBudgetNeedle(scanner, 1);
+    static uint8_t pages[2][PAGE_SIZE] {};
+    memcpy(pages[0] + PAGE_SIZE - 6, budgetNeedle, 6);
+    memcpy(pages[1], budgetNeedle + 6, arrsize(budgetNeedle) - 6);
+    // The whole replacement lands on the lower page, which can only be patched once the upper one matched
+    scanner.processPage(1, PAGE_SIZE, pages[1], PageTarget::SharedCache);
+    scanner.processPage(1, 0, pages[0], PageTarget::SharedCache);
+    CHECK_EQ(scanner.splitsPatched(), 1U);
+    CHECK_EQ(scanner.budgetsMet(), 1U);
+    // The plan can't replay the halves, so the hook has to keep scanning
+    CHECK(scanner.hasUnplanned());
+    CHECK(!scanner.isComplete());
+}
+
+HOST_TEST(budgetPlanOverflowKeepsScanning) {
+    PageScanner scanner;
+    CHECK(scanner.init());
+    scanner.setUseBudget(true);
+    static constexpr size_t PageCount = PatchPlan::SlotCount + 32;
+    addBudgetNeedle(scanner, PageCount);
+    static uint8_t page[PAGE_SIZE] {};
+    for (uint64_t i = 0; i < PageCount; i++) {
+        memcpy(page + 300, budgetNeedle, arrsize(budgetNeedle));
+        scanner.processPage(1, i * PAGE_SIZE, page, PageTarget::SharedCache);
+    }
+    CHECK_EQ(scanner.budgetsMet(), 1U);
+    CHECK(scanner.hasUnplanned());
+    CHECK(!scanner.isComplete());
+}
+
+struct SplitCase {
+    const char *name;
+    PageTarget target;
+    const uint8_t *find;
+    size_t size;
+    const uint8_t *replace;
+    size_t replaceSize;
+};
+
+/**
+ * Places the needle across the boundary of two pages at every offset and validates them in either order, then pages
+ * the first one in again. Needles end up patched whole or not at all, never half rewritten in between, and nothing
+ * around them ever changes.
+ */
+static void checkSplitCorpus(const SplitCase &test, bool lowerFirst) {
+    static constexpr size_t MinShare = 4;
+    for (size_t share = 1; share < test.size; share++) {
+        PageScanner scanner;
+        CHECK(scanner.init());
+        addRealNeedles(scanner);
+
+        static uint8_t original[2 * PAGE_SIZE], expected[2 * PAGE_SIZE], file[2 * PAGE_SIZE];
+        memset(original, ' ', sizeof(original));
+        auto start = PAGE_SIZE - share;
+        memcpy(original + start, test.find, test.size);
+        memcpy(expected, original, sizeof(expected));
+        memcpy(expected + start, test.replace, test.replaceSize);
+
+        memcpy(file, original, sizeof(file));
+        auto first = lowerFirst ? 0 : 1;
+        scanner.processPage(1, first * PAGE_SIZE, file + first * PAGE_SIZE, test.target);
+        // Nothing is patched on the strength of one side alone
+        CHECK(!memcmp(file + first * PAGE_SIZE, original + first * PAGE_SIZE, PAGE_SIZE));
+        scanner.processPage(1, (1 - first) * PAGE_SIZE, file + (1 - first) * PAGE_SIZE, test.target);
+        CHECK(!memcmp(file, original, sizeof(file)) || !memcmp(file, expected, sizeof(file)));
+        memcpy(file + first * PAGE_SIZE, original + first * PAGE_SIZE, PAGE_SIZE);
+        scanner.processPage(1, first * PAGE_SIZE, file + first * PAGE_SIZE, test.target);
+
+        auto detected = share >= MinShare && test.size - share >= MinShare;
+        if (!detected) {
+            CHECK(!memcmp(file, original, sizeof(file)));
+        } else {
+            CHECK(!memcmp(file, original, sizeof(file)) || !memcmp(file, expected, sizeof(file)));
+            CHECK_EQ(scanner.splitsMissed() + scanner.splitsPatched(), 1U);
+        }
+        if (hostFailures) {
+            fprintf(stderr, "%s split after %zu bytes, %s page first\n", test.name, share,
+                lowerFirst ? "lower" : "upper");
+            return;
+        }
+    }
+}
+
+HOST_TEST(splitAtEveryOffset) {
+    static uint8_t boardIdReplace[arrsize(kBoardIdOriginal)];
+    memcpy(boardIdReplace, kBoardIdOriginal, sizeof(boardIdReplace));
+    memcpy(boardIdReplace, kBoardIdPatched, arrsize(kBoardIdPatched));
+    SplitCase cases[] = {
+        {"VideoToolboxDRM", PageTarget::SharedCache, reinterpret_cast<const uint8_t *>(kVideoToolboxDRMModelOriginal),
+            arrsize(kVideoToolboxDRMModelOriginal), modelReplace, arrsize(modelReplace)},
+        {"BoardId", PageTarget::SharedCache, kBoardIdOriginal, arrsize(kBoardIdOriginal), kBoardIdPatched,
+            arrsize(kBoardIdPatched)},
+        {"CoreLSKD", PageTarget::CoreLSKD, kCoreLSKD.original.find, kCoreLSKD.size, kCoreLSKD.patched.find,
+            kCoreLSKD.size},
+    };
+    for (auto &test : cases) {
+        checkSplitCorpus(test, true);
+        checkSplitCorpus(test, false);
+    }
+}
+
+HOST_TEST(splitNeverPatchesAnUnconfirmedSide) {
+    // Prefixes and suffixes of a needle are everywhere, only a real continuation on the next page may be patched
+    for (size_t share = 4; share < arrsize(kBoardIdOriginal); share++) {
+        PageScanner scanner;
+        CHECK(scanner.init());
+        addRealNeedles(scanner);
+        static uint8_t pages[2][PAGE_SIZE];
+        memset(pages, ' ', sizeof(pages));
+        memcpy(pages[0] + PAGE_SIZE - share, kBoardIdOriginal, share);
+        // The rest of the needle follows, except for its last byte
+        memcpy(pages[1], kBoardIdOriginal + share, arrsize(kBoardIdOriginal) - share - 1);
+        scanner.processPage(1, 0, pages[0], PageTarget::SharedCache);
+        scanner.processPage(1, PAGE_SIZE, pages[1], PageTarget::SharedCache);
+        CHECK(!memcmp(pages[0] + PAGE_SIZE - share, kBoardIdOriginal, share));
+        CHECK_EQ(scanner.splitsPatched(), 0U);
+    }
+}
+
+static const vnode *fakeVnode(uintptr_t address) { return reinterpret_cast<const vnode *>(address); }
+
+HOST_TEST(vnodeCacheRemembersEveryTarget) {
+    VnodeTargetCache cache;
+    PageTarget targets[] = {PageTarget::SharedCache, PageTarget::CoreLSKD, PageTarget::CoreLSKDMSE,
+        PageTarget::Irrelevant};
+    for (size_t i = 0; i < arrsize(targets); i++) {
+        auto *vp = fakeVnode(0xFFFFFF8012340000 + i * 0x1000);
+        auto target = PageTarget::SharedCache;
+        CHECK(!cache.lookup(vp, 7, target));
+        cache.insert(vp, 7, targets[i]);
+        CHECK(cache.lookup(vp, 7, target));
+        CHECK(target == targets[i]);
+    }
+#ifdef DEBUG
+    CHECK_EQ(cache.hits, arrsize(targets));
+    CHECK_EQ(cache.misses, arrsize(targets));
+#endif
+}
+
+HOST_TEST(vnodeCacheMissesRecycledVnodes) {
+    VnodeTargetCache cache;
+    auto *vp = fakeVnode(0xFFFFFF8023456780);
+    auto target = PageTarget::Irrelevant;
+    cache.insert(vp, 41, PageTarget::CoreLSKD);
+    // Same address, new identity
+    CHECK(!cache.lookup(vp, 42, target));
+    // Only the low 21 bits of the ID are kept, an ID that wrapped around all of them is the one case that aliases
+    CHECK(cache.lookup(vp, 41 + (1U << 21), target));
+    CHECK(!cache.lookup(fakeVnode(0xFFFFFF8023456790), 41, target));
+}
+
+HOST_TEST(vnodeCacheEvictsOnCollision) {
+    VnodeTargetCache cache;
+    // Find two vnodes sharing a slot, the later insert wins it
+    auto *first = fakeVnode(0xFFFFFF8000000000);
+    const vnode *second = nullptr;
+    for (uintptr_t addr = 0xFFFFFF8000000010; !second; addr += 0x10) {
+        VnodeTargetCache probe;
+        auto target = PageTarget::Irrelevant;
+        probe.insert(first, 1, PageTarget::SharedCache);
+        probe.insert(fakeVnode(addr), 1, PageTarget::CoreLSKD);
+        if (!probe.lookup(first, 1, target)) { second = fakeVnode(addr); }
+    }
+    auto target = PageTarget::Irrelevant;
+    cache.insert(first, 1, PageTarget::SharedCache);
+    cache.insert(second, 1, PageTarget::CoreLSKD);
+    CHECK(!cache.lookup(first, 1, target));
+    CHECK(cache.lookup(second, 1, target));
+    CHECK(target == PageTarget::CoreLSKD);
+}
+
+HOST_TEST(vnodeCacheNeverReturnsAnotherVnodesTarget) {
+    // Writers and readers race on the same slots, a slot is one word so a hit is always for the right vnode
+    static VnodeTargetCache cache;
+    static constexpr size_t VnodeCount = 1024;
+    auto targetOf = [](size_t i) { return static_cast<PageTarget>(i % 4); };
+    std::atomic<bool> wrong {false};
+    std::thread writers[2], readers[2];
+    for (size_t t = 0; t < 2; t++) {
+        writers[t] = std::thread([&, t] {
+            for (size_t round = 0; round < 200; round++) {
+                for (size_t i = t; i < VnodeCount; i += 2) {
+                    cache.insert(fakeVnode(0xFFFFFF8040000000 + i * 0x130), 3, targetOf(i));
+                }
+            }
+        });
+        readers[t] = std::thread([&] {
+            for (size_t round = 0; round < 200; round++) {
+                for (size_t i = 0; i < VnodeCount; i++) {
+                    auto target = PageTarget::Irrelevant;
+                    if (cache.lookup(fakeVnode(0xFFFFFF8040000000 + i * 0x130), 3, target) && target != targetOf(i)) {
+                        wrong = true;
+                    }
+                }
+            }
+        });
+    }
+    for (auto &thread : writers) { thread.join(); }
+    for (auto &thread : readers) { thread.join(); }
+    CHECK(!wrong);
+}
+
+HOST_TEST(benchVnodeCacheLookup) {
+    VnodeTargetCache cache;
+    static constexpr size_t VnodeCount = 64;
+    for (size_t i = 0; i < VnodeCount; i++) {
+        cache.insert(fakeVnode(0xFFFFFF8050000000 + i * 0x130), 9, PageTarget::Irrelevant);
+    }
+    size_t found = 0;
+    auto ns = hostBenchmark(1 << 20, [&](size_t i) {
+        auto target = PageTarget::SharedCache;
+        found += cache.lookup(fakeVnode(0xFFFFFF8050000000 + (i % VnodeCount) * 0x130), 9, target);
+    });
+    printf("  lookup of a cached vnode: %.1f ns (%zu hits)\n", ns, found);
+}
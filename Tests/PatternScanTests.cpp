@@ -0,0 +1,113 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+#include "HostTest.hpp"
+#include "kern_patches.hpp"
+#include "kern_patternscan.hpp"
+#include <random>
+#include <vector>
+
+/** `KernelPatcher::findPattern`, one pattern at a time */
+static size_t findPattern(const uint8_t *data, size_t dataSize, const uint8_t *pattern, const uint8_t *mask,
+    size_t size) {
+    for (size_t i = 0; i + size <= dataSize; i++) {
+        size_t j = 0;
+        while (j < size && !((data[i + j] ^ pattern[j]) & (mask ? mask[j] : 0xFF))) { j++; }
+        if (j == size) { return i; }
+    }
+    return PatternScanner::NotFound;
+}
+
+HOST_TEST(scanAnchorsOnAFullyUnmaskedByte) {
+    // Leading wildcards and a half-masked byte; the anchor is the first fully unmasked byte, two bytes in
+    static const uint8_t pattern[] = {0x00, 0x40, 0x83, 0xF0, 0x02};
+    static const uint8_t mask[] = {0x00, 0xF0, 0xFF, 0xF0, 0xFF};
+    uint8_t data[64];
+    memset(data, 0x83, sizeof(data));
+
+    // At the very start, so the anchor sits past the first bytes of the data
+    memcpy(data, "\x99\x4A\x83\xF7\x02", 5);
+    PatternScanner scanner;
+    auto slot = scanner.add(pattern, mask, sizeof(pattern));
+    scanner.scan(data, sizeof(data));
+    CHECK_EQ(scanner.offset(slot), 0U);
+
+    // At the very end, where the anchor byte is followed by too few bytes for the rest of the pattern
+    memset(data, 0x83, sizeof(data));
+    memcpy(data + sizeof(data) - 5, "\x11\x45\x83\xF1\x02", 5);
+    PatternScanner tail;
+    slot = tail.add(pattern, mask, sizeof(pattern));
+    tail.scan(data, sizeof(data));
+    CHECK_EQ(tail.offset(slot), sizeof(data) - 5);
+    tail.scan(data, sizeof(data) - 1);
+    CHECK_EQ(tail.offset(slot), PatternScanner::NotFound);
+}
+
+HOST_TEST(scanMatchesFindPattern) {
+    std::mt19937 rng {5};
+    std::vector<uint8_t> data(1 << 14);
+    static uint8_t bytes[PatternScanner::MaxPatterns][12], masks[PatternScanner::MaxPatterns][12];
+    for (int trial = 0; trial < 200; trial++) {
+        // A small alphabet, so partial matches are everywhere
+        for (auto &byte : data) { byte = static_cast<uint8_t>(0xF0 | rng() % 4); }
+
+        PatternScanner scanner;
+        size_t sizes[PatternScanner::MaxPatterns];
+        bool masked[PatternScanner::MaxPatterns];
+        for (size_t p = 0; p < PatternScanner::MaxPatterns; p++) {
+            sizes[p] = 1 + rng() % 12;
+            masked[p] = rng() % 2;
+            for (size_t i = 0; i < sizes[p]; i++) {
+                bytes[p][i] = static_cast<uint8_t>(0xF0 | rng() % 4);
+                // Exact, wildcard and nibble masks
+                static const uint8_t maskBytes[] = {0xFF, 0xFF, 0x00, 0xF0, 0x0F};
+                masks[p][i] = maskBytes[rng() % arrsize(maskBytes)];
+            }
+            CHECK_EQ(scanner.add(bytes[p], masked[p] ? masks[p] : nullptr, sizes[p]), p);
+        }
+        CHECK_EQ(scanner.add(bytes[0], nullptr, 1), PatternScanner::NotFound);
+
+        scanner.scan(data.data(), data.size());
+        for (size_t p = 0; p < PatternScanner::MaxPatterns; p++) {
+            CHECK_EQ(scanner.offset(p),
+                findPattern(data.data(), data.size(), bytes[p], masked[p] ? masks[p] : nullptr, sizes[p]));
+        }
+        if (hostFailures) { break; }
+    }
+}
+
+HOST_TEST(benchScanVersusFindPattern) {
+    // Instruction-like bytes, without the patterns in them: every pattern is searched to the end
+    std::mt19937 rng {6};
+    std::vector<uint8_t> image(1 << 20);
+    static const uint8_t common[] = {0x48, 0x89, 0x8B, 0x83, 0x00, 0xFF, 0xE8, 0x0F, 0x85, 0xC0};
+    for (auto &byte : image) { byte = rng() % 2 ? common[rng() % arrsize(common)] : static_cast<uint8_t>(rng()); }
+    for (size_t i = 0; i + 4 <= image.size(); i++) {
+        if (image[i] >> 4 == 4 && image[i + 1] == 0x83 && image[i + 2] >> 4 == 0xF && image[i + 3] == 2) {
+            image[i + 3] = 3;
+        }
+    }
+
+    struct {
+        const uint8_t *find, *mask;
+        size_t size;
+    } patterns[] = {
+        {kVRAMInfoNullCheck.original.find, kVRAMInfoNullCheck.original.findMask(), kVRAMInfoNullCheck.size},
+        {kStartHWEngines.original.find, kStartHWEngines.original.findMask(), kStartHWEngines.size},
+        {kAGDPFBCountCheck.original.find, kAGDPFBCountCheck.original.findMask(), kAGDPFBCountCheck.size},
+    };
+    auto single = hostBenchmark(4, [&](size_t) {
+        PatternScanner scanner;
+        for (auto &pattern : patterns) { scanner.add(pattern.find, pattern.mask, pattern.size); }
+        scanner.scan(image.data(), image.size());
+    });
+    size_t found = 0;
+    auto perPattern = hostBenchmark(4, [&](size_t) {
+        for (auto &pattern : patterns) {
+            found += findPattern(image.data(), image.size(), pattern.find, pattern.mask, pattern.size) !=
+                     PatternScanner::NotFound;
+        }
+    });
+    printf("  1 MiB image, %zu patterns: single walk %.2f ms, one search per pattern %.2f ms (%zu found)\n",
+        arrsize(patterns), single / 1e6, perPattern / 1e6, found);
+}
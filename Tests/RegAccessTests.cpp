@@ -0,0 +1,162 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+#include "HostTest.hpp"
+#include "kern_amd.hpp"
+#include "kern_regaccess.hpp"
+#include <libkern/c++/OSData.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// A plain buffer stands in for the BAR; registers past it go through `mmPCIE_INDEX2`/`mmPCIE_DATA2`
+static constexpr size_t MappedRegs = 64;
+static constexpr uint32_t DirectA = 0x20;
+static constexpr uint32_t DirectB = 0x21;
+static constexpr uint32_t IndirectA = 0x100;
+static constexpr uint32_t IndirectB = 0x200;
+
+struct FakeBAR {
+    volatile uint32_t regs[MappedRegs] {};
+    RegisterAccess access;
+
+    FakeBAR() { CHECK(this->access.init(this->regs, sizeof(this->regs))); }
+
+    uint64_t forwarded() { return *this->access.forwardedReads(); }
+    uint64_t served() { return *this->access.servedReads(); }
+
+    /** What the recorder published */
+    std::vector<MMIORecord> trace() {
+        IORegistryEntry entry;
+        this->access.recorder().publish(&entry);
+        auto *dict = OSDynamicCast(OSDictionary, entry.getProperty("LRedMMIOTrace"));
+        auto *data = dict ? OSDynamicCast(OSData, dict->getObject("Records")) : nullptr;
+        if (!data) { return {}; }
+        auto *records = static_cast<const MMIORecord *>(data->getBytesNoCopy());
+        return {records, records + data->getLength() / sizeof(MMIORecord)};
+    }
+};
+
+static bool isRecord(const MMIORecord &record, MMIOAccess access, uint32_t reg, uint32_t value, bool indirect) {
+    return record.access == access && record.reg == reg && record.value == value && record.indirect == indirect;
+}
+
+HOST_TEST(applyReplacesOnlyTheMaskedBits) {
+    FakeBAR bar;
+    bar.regs[DirectA] = 0xAAAA5555;
+    bar.regs[DirectB] = 0xAAAA5555;
+    static const RegOp ops[] = {
+        {DirectA, 0xFF00, 0x1234},
+        {DirectB, ~0U, 0x1234},
+    };
+    bar.access.apply(ops);
+    CHECK_EQ(bar.regs[DirectA], 0xAAAA1255U);
+    CHECK_EQ(bar.regs[DirectB], 0x1234U);
+    // Only the masked one had to be read
+    CHECK_EQ(bar.forwarded(), 1U);
+}
+
+HOST_TEST(applyRunsTheOperationsInOrder) {
+    FakeBAR bar;
+    CHECK(bar.access.recorder().enable(64));
+    bar.regs[DirectA] = 0xF0;
+    static const RegOp ops[] = {
+        {DirectA, 0x0F, 0x03},
+        {DirectA, 0xF0, 0x50},
+        {DirectA, 0x100, 0x100},
+    };
+    bar.access.apply(ops);
+    CHECK_EQ(bar.regs[DirectA], 0x153U);
+    auto trace = bar.trace();
+    CHECK_EQ(trace.size(), 6U);
+    if (trace.size() == 6) {
+        CHECK(isRecord(trace[0], MMIOAccess::Read, DirectA, 0xF0, false));
+        CHECK(isRecord(trace[1], MMIOAccess::Write, DirectA, 0xF3, false));
+        CHECK(isRecord(trace[2], MMIOAccess::Read, DirectA, 0xF3, false));
+        CHECK(isRecord(trace[3], MMIOAccess::Write, DirectA, 0x53, false));
+        CHECK(isRecord(trace[4], MMIOAccess::Read, DirectA, 0x53, false));
+        CHECK(isRecord(trace[5], MMIOAccess::Write, DirectA, 0x153, false));
+    }
+}
+
+HOST_TEST(applyGoesThroughTheIndexPastTheMapping) {
+    FakeBAR bar;
+    CHECK(bar.access.recorder().enable(64));
+    // All indirect registers share the data register of the buffer, a run on one register builds on itself
+    bar.regs[mmPCIE_DATA2] = 0xFF;
+    static const RegOp ops[] = {
+        {IndirectA, 0x0F, 0x01},
+        {DirectA, ~0U, 0x77},
+        {IndirectA, 0xF0, 0x20},
+        {IndirectB, ~0U, 0x1234},
+    };
+    bar.access.apply(ops);
+    CHECK_EQ(bar.regs[DirectA], 0x77U);
+    CHECK_EQ(bar.regs[mmPCIE_INDEX2], IndirectB);
+    CHECK_EQ(bar.regs[mmPCIE_DATA2], 0x1234U);
+    auto trace = bar.trace();
+    CHECK_EQ(trace.size(), 6U);
+    if (trace.size() == 6) {
+        CHECK(isRecord(trace[0], MMIOAccess::Read, IndirectA, 0xFF, true));
+        CHECK(isRecord(trace[1], MMIOAccess::Write, IndirectA, 0xF1, true));
+        CHECK(isRecord(trace[2], MMIOAccess::Write, DirectA, 0x77, false));
+        CHECK(isRecord(trace[3], MMIOAccess::Read, IndirectA, 0xF1, true));
+        CHECK(isRecord(trace[4], MMIOAccess::Write, IndirectA, 0x21, true));
+        CHECK(isRecord(trace[5], MMIOAccess::Write, IndirectB, 0x1234, true));
+    }
+}
+
+HOST_TEST(applyKeepsTheShadowCurrent) {
+    FakeBAR bar;
+    static const RegShadow shadowed[] = {
+        {DirectA, RegPolicy::WriteThrough},
+        {DirectB, RegPolicy::Immutable},
+    };
+    CHECK(bar.access.shadow(shadowed));
+    bar.regs[DirectA] = 1;
+    bar.regs[DirectB] = 2;
+    CHECK_EQ(bar.access.read(DirectA), 1U);
+    CHECK_EQ(bar.access.read(DirectB), 2U);
+    CHECK_EQ(bar.forwarded(), 2U);
+
+    static const RegOp ops[] = {
+        {DirectA, 0xF0, 0x50},
+        {DirectB, ~0U, 3},
+    };
+    bar.access.apply(ops);
+    CHECK_EQ(bar.forwarded(), 3U);
+    // The write-through value is what apply wrote, even though the buffer says otherwise now
+    bar.regs[DirectA] = 0xDEAD;
+    bar.regs[DirectB] = 4;
+    CHECK_EQ(bar.access.read(DirectA), 0x51U);
+    CHECK_EQ(bar.served(), 1U);
+    // The immutable one was written after all, so it's read again
+    CHECK_EQ(bar.access.read(DirectB), 4U);
+    CHECK_EQ(bar.forwarded(), 4U);
+    CHECK_EQ(bar.access.read(DirectB), 4U);
+    CHECK_EQ(bar.served(), 2U);
+}
+
+HOST_TEST(shadowNeverFallsBehindTheRegister) {
+    FakeBAR bar;
+    static const RegShadow shadowed[] = {{DirectA, RegPolicy::WriteThrough}};
+    CHECK(bar.access.shadow(shadowed));
+    // One thread keeps dropping the shadow and reading the register back in, which must not bring back a value
+    // from before a write that finished in the meantime
+    std::atomic<bool> done {false};
+    std::thread reloader {[&bar, &done] {
+        while (!done.load(std::memory_order_relaxed)) {
+            bar.access.invalidate();
+            (void)bar.access.read(DirectA);
+        }
+    }};
+    size_t stale = 0;
+    for (uint32_t i = 1; i <= 1000000; i++) {
+        bar.access.write(DirectA, i);
+        if (bar.access.read(DirectA) != i) { stale++; }
+    }
+    done = true;
+    reloader.join();
+    CHECK_EQ(stale, 0U);
+    CHECK(bar.served() > 0);
+}
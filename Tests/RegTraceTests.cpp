@@ -0,0 +1,160 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+#include "HostTest.hpp"
+#include "kern_regtrace.hpp"
+#include <Headers/kern_util.hpp>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+static RegTraceRecord makeRecord(uint32_t reg) {
+    // Every field follows from the register, so a record mixed from two pushes shows
+    return {0, reg * 7ULL, reg * 3ULL, reg, reg ^ 0xA5A5A5A5, 4, static_cast<uint8_t>(reg), {}};
+}
+
+static bool isConsistent(const RegTraceRecord &record) {
+    auto expected = makeRecord(record.reg);
+    return record.timestamp == expected.timestamp && record.caller == expected.caller &&
+           record.value == expected.value && record.width == expected.width && record.cpu == expected.cpu;
+}
+
+/** Registers whose histogram probe starts at the same bucket as register 1 */
+static std::vector<uint32_t> collidingRegisters(size_t count) {
+    auto bucketOf = [](uint32_t reg) { return (reg * 0x9E3779B1U) >> (32 - RegTraceHistogram::Bits); };
+    std::vector<uint32_t> ret;
+    for (uint32_t reg = 1; ret.size() < count; reg++) {
+        if (bucketOf(reg) == bucketOf(1)) { ret.push_back(reg); }
+    }
+    return ret;
+}
+
+HOST_TEST(ringReturnsRecordsOldestFirst) {
+    RegTraceRing ring;
+    for (uint32_t i = 0; i < 3; i++) { ring.push(makeRecord(i)); }
+    RegTraceRecord out[RegTraceRing::Size];
+    CHECK_EQ(ring.snapshot(out, arrsize(out)), 3U);
+    for (uint32_t i = 0; i < 3; i++) {
+        CHECK_EQ(out[i].sequence, i + 1ULL);
+        CHECK_EQ(out[i].reg, i);
+        CHECK(isConsistent(out[i]));
+    }
+    CHECK_EQ(ring.snapshot(out, 2), 2U);
+    CHECK_EQ(out[1].reg, 1U);
+}
+
+HOST_TEST(ringKeepsTheLatestOnceItWraps) {
+    RegTraceRing ring;
+    static constexpr uint32_t pushed = RegTraceRing::Size * 3 + 10;
+    for (uint32_t i = 0; i < pushed; i++) { ring.push(makeRecord(i)); }
+    CHECK_EQ(ring.written(), static_cast<uint64_t>(pushed));
+    RegTraceRecord out[RegTraceRing::Size];
+    CHECK_EQ(ring.snapshot(out, arrsize(out)), RegTraceRing::Size);
+    for (size_t i = 0; i < RegTraceRing::Size; i++) {
+        auto reg = static_cast<uint32_t>(pushed - RegTraceRing::Size + i);
+        CHECK_EQ(out[i].reg, reg);
+        CHECK_EQ(out[i].sequence, reg + 1ULL);
+        CHECK(isConsistent(out[i]));
+    }
+}
+
+HOST_TEST(ringSnapshotsNeverHoldTornRecords) {
+    RegTraceRing ring;
+    std::atomic<bool> done {false};
+    std::vector<std::thread> writers;
+    for (uint32_t w = 0; w < 2; w++) {
+        writers.emplace_back([&ring, &done, w] {
+            for (uint32_t i = w; !done.load(std::memory_order_relaxed); i += 2) { ring.push(makeRecord(i)); }
+        });
+    }
+    size_t torn = 0, unordered = 0, seen = 0;
+    RegTraceRecord out[RegTraceRing::Size];
+    for (size_t round = 0; round < 20000; round++) {
+        auto count = ring.snapshot(out, arrsize(out));
+        seen += count;
+        for (size_t i = 0; i < count; i++) {
+            if (!isConsistent(out[i])) { torn++; }
+            if (i && out[i].sequence <= out[i - 1].sequence) { unordered++; }
+        }
+    }
+    done = true;
+    for (auto &writer : writers) { writer.join(); }
+    CHECK_EQ(torn, 0U);
+    CHECK_EQ(unordered, 0U);
+    CHECK(seen > 0);
+}
+
+HOST_TEST(histogramCountsEachRegister) {
+    RegTraceHistogram histogram;
+    // Register 0 is a register like any other
+    for (uint32_t reg = 0; reg < 16; reg++) {
+        for (uint32_t i = 0; i <= reg; i++) { histogram.add(reg); }
+    }
+    RegTraceCount out[RegTraceHistogram::Size];
+    auto count = histogram.snapshot(out, arrsize(out));
+    CHECK_EQ(count, 16U);
+    for (size_t i = 0; i < count; i++) { CHECK_EQ(out[i].count, out[i].reg + 1); }
+    CHECK_EQ(histogram.overflowed(), 0U);
+}
+
+HOST_TEST(histogramOverflowsPastTheProbe) {
+    RegTraceHistogram histogram;
+    auto regs = collidingRegisters(RegTraceHistogram::MaxProbe + 1);
+    for (size_t i = 0; i < RegTraceHistogram::MaxProbe; i++) { histogram.add(regs[i]); }
+    CHECK_EQ(histogram.overflowed(), 0U);
+    // No slot left in its probe, so it's only counted as overflow, however often it comes
+    auto last = regs[RegTraceHistogram::MaxProbe];
+    for (size_t i = 0; i < 5; i++) { histogram.add(last); }
+    CHECK_EQ(histogram.overflowed(), 5U);
+    // The ones that got a slot keep counting
+    histogram.add(regs[0]);
+    CHECK_EQ(histogram.overflowed(), 5U);
+
+    RegTraceCount out[RegTraceHistogram::Size];
+    auto count = histogram.snapshot(out, arrsize(out));
+    CHECK_EQ(count, RegTraceHistogram::MaxProbe);
+    for (size_t i = 0; i < count; i++) {
+        CHECK(out[i].reg != last);
+        CHECK_EQ(out[i].count, out[i].reg == regs[0] ? 2U : 1U);
+    }
+}
+
+HOST_TEST(histogramCountsConcurrentAdds) {
+    RegTraceHistogram histogram;
+    auto regs = collidingRegisters(RegTraceHistogram::MaxProbe);
+    static constexpr uint32_t perThread = 100000;
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 4; t++) {
+        // All of them race for the same probe window
+        threads.emplace_back([&histogram, &regs] {
+            for (uint32_t i = 0; i < perThread; i++) { histogram.add(regs[i % regs.size()]); }
+        });
+    }
+    for (auto &thread : threads) { thread.join(); }
+    RegTraceCount out[RegTraceHistogram::Size];
+    auto count = histogram.snapshot(out, arrsize(out));
+    CHECK_EQ(count, regs.size());
+    uint64_t total = 0;
+    for (size_t i = 0; i < count; i++) { total += out[i].count; }
+    CHECK_EQ(total, 4ULL * perThread);
+    CHECK_EQ(histogram.overflowed(), 0U);
+}
+
+HOST_TEST(tracerSpreadsCPUsOverItsRings) {
+    RegTracer tracer;
+    tracer.record(1, 4, 0x10, 1, 0, 1);
+    tracer.record(RegTracer::MaxCPUs + 1, 4, 0x10, 2, 0, 2);
+    tracer.record(2, 4, 0x20, 3, 0, 3);
+    CHECK_EQ(tracer.total(), 3U);
+    RegTraceRecord out[8];
+    CHECK_EQ(tracer.snapshot(out, arrsize(out)), 3U);
+    // Both CPUs that map to ring 1 come first, in order, with the CPU they were recorded on
+    CHECK_EQ(out[0].value, 1U);
+    CHECK_EQ(out[1].value, 2U);
+    CHECK_EQ(out[1].cpu, RegTracer::MaxCPUs + 1);
+    CHECK_EQ(out[2].reg, 0x20U);
+    RegTraceCount counts[8];
+    auto count = tracer.counts(counts, arrsize(counts));
+    CHECK_EQ(count, 2U);
+    for (size_t i = 0; i < count; i++) { CHECK_EQ(counts[i].count, counts[i].reg == 0x10 ? 2U : 1U); }
+}
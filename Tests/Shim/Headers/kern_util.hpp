@@ -0,0 +1,90 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+// Host stand-in for the parts of Lilu's kern_util.hpp that the tested sources use.
+
+#ifndef shim_kern_util_hpp
+#define shim_kern_util_hpp
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#define DBGLOG(module, str, ...) \
+    do { if (hostVerbose()) { fprintf(stderr, module ": " str "\n", ##__VA_ARGS__); } } while (0)
+#define SYSLOG(module, str, ...) fprintf(stderr, module ": " str "\n", ##__VA_ARGS__)
+#define DBGLOG_COND(cond, module, str, ...) \
+    do { if (cond) { DBGLOG(module, str, ##__VA_ARGS__); } } while (0)
+#define SYSLOG_COND(cond, module, str, ...) \
+    do { if (cond) { SYSLOG(module, str, ##__VA_ARGS__); } } while (0)
+#define PANIC(module, str, ...) \
+    do { fprintf(stderr, "panic: " module ": " str "\n", ##__VA_ARGS__), abort(); } while (0)
+#define PANIC_COND(cond, module, str, ...) \
+    do { if (cond) { PANIC(module, str, ##__VA_ARGS__); } } while (0)
+
+#define LIKELY(x)   __builtin_expect(!!(x), 1)
+#define UNLIKELY(x) __builtin_expect(!!(x), 0)
+#define PACKED      __attribute__((packed))
+
+#ifndef PAGE_SIZE
+#define PAGE_SIZE 4096
+#endif
+
+#ifndef NSEC_PER_SEC
+#define NSEC_PER_SEC 1000000000ULL
+#endif
+
+using mach_vm_address_t = uint64_t;
+
+/** `LRED_TEST_VERBOSE=1` shows the debug log of the tested code */
+inline bool hostVerbose() {
+    static bool verbose = getenv("LRED_TEST_VERBOSE") != nullptr;
+    return verbose;
+}
+
+/** Space separated, set by the tests before they call into code that checks boot-args */
+inline const char *&hostBootArgs() {
+    static const char *args = "";
+    return args;
+}
+
+inline bool checkKernelArgument(const char *name) {
+    auto length = strlen(name);
+    for (auto *arg = hostBootArgs(); (arg = strstr(arg, name)); arg += length) {
+        if ((arg == hostBootArgs() || arg[-1] == ' ') && (arg[length] == ' ' || !arg[length])) { return true; }
+    }
+    return false;
+}
+
+template<typename T, size_t N>
+constexpr size_t arrsize(const T (&)[N]) {
+    return N;
+}
+
+inline const char *safeString(const char *str) { return str ? str : "(null)"; }
+
+inline uint64_t mach_absolute_time() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * NSEC_PER_SEC + static_cast<uint64_t>(now.tv_nsec);
+}
+
+// Absolute time is in nanoseconds here
+inline void absolutetime_to_nanoseconds(uint64_t abstime, uint64_t *result) { *result = abstime; }
+inline void nanoseconds_to_absolutetime(uint64_t nanoseconds, uint64_t *result) { *result = nanoseconds; }
+
+namespace Buffer {
+template<typename T>
+T *create(size_t size) {
+    return static_cast<T *>(malloc(sizeof(T) * size));
+}
+
+template<typename T>
+void deleter(T *buffer) {
+    free(buffer);
+}
+}    // namespace Buffer
+
+#endif /* shim_kern_util_hpp */
@@ -0,0 +1,23 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+// Host stand-in for IOSimpleLock, a spinlock like the real one.
+
+#ifndef shim_IOLocks_h
+#define shim_IOLocks_h
+#include <atomic>
+
+struct IOSimpleLock {
+    std::atomic_flag held = ATOMIC_FLAG_INIT;
+};
+
+inline IOSimpleLock *IOSimpleLockAlloc() { return new IOSimpleLock; }
+inline void IOSimpleLockFree(IOSimpleLock *lock) { delete lock; }
+
+inline void IOSimpleLockLock(IOSimpleLock *lock) {
+    while (lock->held.test_and_set(std::memory_order_acquire)) {}
+}
+
+inline void IOSimpleLockUnlock(IOSimpleLock *lock) { lock->held.clear(std::memory_order_release); }
+
+#endif /* shim_IOLocks_h */
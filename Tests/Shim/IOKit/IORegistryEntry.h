@@ -0,0 +1,21 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+// Host stand-in for IORegistryEntry, a property table.
+
+#ifndef shim_IORegistryEntry_h
+#define shim_IORegistryEntry_h
+#include <libkern/c++/OSDictionary.h>
+
+class IORegistryEntry : public OSObject {
+    OSDictionary *properties {OSDictionary::withCapacity(0)};
+
+    public:
+    ~IORegistryEntry() override { this->properties->release(); }
+
+    bool setProperty(const char *key, OSObject *object) { return this->properties->setObject(key, object); }
+    OSObject *getProperty(const char *key) const { return this->properties->getObject(key); }
+    const char *getName() const { return "IORegistryEntry"; }
+};
+
+#endif /* shim_IORegistryEntry_h */
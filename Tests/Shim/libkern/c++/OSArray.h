@@ -0,0 +1,34 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+// Host stand-in for libkern's OSArray, retains what it holds like the real one.
+
+#ifndef shim_OSArray_h
+#define shim_OSArray_h
+#include <libkern/c++/OSObject.h>
+#include <vector>
+
+class OSArray : public OSObject {
+    std::vector<OSObject *> objects;
+
+    public:
+    ~OSArray() override {
+        for (auto *object : this->objects) { object->release(); }
+    }
+
+    static OSArray *withCapacity(unsigned int) { return new OSArray; }
+
+    bool setObject(OSObject *object) {
+        if (!object) { return false; }
+        object->retain();
+        this->objects.push_back(object);
+        return true;
+    }
+
+    OSObject *getObject(unsigned int index) const {
+        return index < this->objects.size() ? this->objects[index] : nullptr;
+    }
+    unsigned int getCount() const { return static_cast<unsigned int>(this->objects.size()); }
+};
+
+#endif /* shim_OSArray_h */
@@ -0,0 +1,26 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+// Host stand-in for libkern's OSData, always a copy.
+
+#ifndef shim_OSData_h
+#define shim_OSData_h
+#include <libkern/c++/OSObject.h>
+#include <vector>
+
+class OSData : public OSObject {
+    std::vector<unsigned char> bytes;
+
+    public:
+    static OSData *withBytes(const void *bytes, unsigned int length) {
+        auto *ret = new OSData;
+        auto *begin = static_cast<const unsigned char *>(bytes);
+        ret->bytes.assign(begin, begin + length);
+        return ret;
+    }
+
+    const void *getBytesNoCopy() const { return this->bytes.data(); }
+    unsigned int getLength() const { return static_cast<unsigned int>(this->bytes.size()); }
+};
+
+#endif /* shim_OSData_h */
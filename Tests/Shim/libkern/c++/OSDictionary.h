@@ -0,0 +1,39 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+// Host stand-in for libkern's OSDictionary, retains what it holds like the real one.
+
+#ifndef shim_OSDictionary_h
+#define shim_OSDictionary_h
+#include <libkern/c++/OSObject.h>
+#include <map>
+#include <string>
+
+class OSDictionary : public OSObject {
+    std::map<std::string, OSObject *> objects;
+
+    public:
+    ~OSDictionary() override {
+        for (auto &object : this->objects) { object.second->release(); }
+    }
+
+    static OSDictionary *withCapacity(unsigned int) { return new OSDictionary; }
+
+    bool setObject(const char *key, OSObject *object) {
+        if (!object) { return false; }
+        object->retain();
+        auto &slot = this->objects[key];
+        if (slot) { slot->release(); }
+        slot = object;
+        return true;
+    }
+
+    OSObject *getObject(const char *key) const {
+        auto it = this->objects.find(key);
+        return it == this->objects.end() ? nullptr : it->second;
+    }
+
+    unsigned int getCount() const { return static_cast<unsigned int>(this->objects.size()); }
+};
+
+#endif /* shim_OSDictionary_h */
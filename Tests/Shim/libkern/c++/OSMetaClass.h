@@ -0,0 +1,14 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+// Host stand-in for libkern's OSMetaClass, the tested sources only compare pointers to it.
+
+#ifndef shim_OSMetaClass_h
+#define shim_OSMetaClass_h
+
+class OSMetaClass {
+    public:
+    const char *getClassName() const { return "OSMetaClass"; }
+};
+
+#endif /* shim_OSMetaClass_h */
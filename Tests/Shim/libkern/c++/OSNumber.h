@@ -0,0 +1,25 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+// Host stand-in for libkern's OSNumber.
+
+#ifndef shim_OSNumber_h
+#define shim_OSNumber_h
+#include <cstdint>
+#include <libkern/c++/OSObject.h>
+
+class OSNumber : public OSObject {
+    uint64_t value {0};
+
+    public:
+    static OSNumber *withNumber(unsigned long long value, unsigned int) {
+        auto *ret = new OSNumber;
+        ret->value = value;
+        return ret;
+    }
+
+    uint32_t unsigned32BitValue() const { return static_cast<uint32_t>(this->value); }
+    uint64_t unsigned64BitValue() const { return this->value; }
+};
+
+#endif /* shim_OSNumber_h */
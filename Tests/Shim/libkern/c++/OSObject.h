@@ -0,0 +1,32 @@
+//  Copyright © 2023 ChefKiss Inc. Licensed under the Thou Shalt Not Profit License version 1.0. See LICENSE for
+//  details.
+
+// Host stand-in for libkern's OSObject, reference counted like the real one.
+
+#ifndef shim_OSObject_h
+#define shim_OSObject_h
+
+class OSObject {
+    mutable int references {1};
+
+    public:
+    virtual ~OSObject() = default;
+
+    void retain() const { this->references++; }
+    void release() const {
+        if (!--this->references) { delete this; }
+    }
+    int getRetainCount() const { return this->references; }
+};
+
+#define OSDynamicCast(type, inst) dynamic_cast<type *>(inst)
+
+#define OSSafeReleaseNULL(inst)  \
+    do {                         \
+        if (inst) {              \
+            (inst)->release();   \
+            (inst) = nullptr;    \
+        }                        \
+    } while (0)
+
+#endif /* shim_OSObject_h */